@@ -2,6 +2,45 @@
 adb wait-for-device
 adb shell mkdir /usr/share/tdk/
 adb push tdk-chx01-get-data.c /usr/
+adb push tdk-chx01-sysfs.c /usr/
+adb push tdk-chx01-sysfs.h /usr/
+adb push tdk-chx01-ring.h /usr/
+adb push tdk-chx01-frame.c /usr/
+adb push tdk-chx01-frame.h /usr/
+adb push tdk-chx01-pool.c /usr/
+adb push tdk-chx01-pool.h /usr/
+adb push tdk-chx01-csv.c /usr/
+adb push tdk-chx01-csv.h /usr/
+adb push tdk-chx01-capture.c /usr/
+adb push tdk-chx01-capture.h /usr/
+adb push tdk-chx01-logger.c /usr/
+adb push tdk-chx01-logger.h /usr/
+adb push tdk-chx01-replay.c /usr/
+adb push tdk-chx01-replay.h /usr/
+adb push tdk-chx01-rawcap.c /usr/
+adb push tdk-chx01-rawcap.h /usr/
+adb push tdk-chx01-latency.c /usr/
+adb push tdk-chx01-latency.h /usr/
+adb push tdk-chx01-soak.c /usr/
+adb push tdk-chx01-soak.h /usr/
+adb push tdk-chx01-firmware.c /usr/
+adb push tdk-chx01-firmware.h /usr/
+adb push tdk-chx01-startup.c /usr/
+adb push tdk-chx01-startup.h /usr/
+adb push tdk-chx01-control.c /usr/
+adb push tdk-chx01-control.h /usr/
+adb push tdk-chx01-hotplug.c /usr/
+adb push tdk-chx01-hotplug.h /usr/
+adb push tdk-chx01-algo.c /usr/
+adb push tdk-chx01-algo.h /usr/
+adb push tdk-chx01-session.c /usr/
+adb push tdk-chx01-get-data.h /usr/
+adb push tdk-chx01-ctl.c /usr/
+adb push tdk-chx01-cap2csv.c /usr/
+adb push tdk-chx01-synth.c /usr/
+adb push tdk-chx01-synth.h /usr/
+adb push tdk-chx01-synth-cli.c /usr/
+adb push tdk-chx01-benchmark.c /usr/
 
 adb push ./libInvnAlgoRangeFinder.a /usr/bin/
 adb push ./libInvnAlgoFloorTypeFxp.a /usr/bin/
@@ -15,5 +54,9 @@ adb push ./invn_algo_obstacleposition.h /usr/
 
 adb push ./invn/ /usr/
 adb push firmware/* /usr/share/tdk/
-adb shell "gcc /usr/tdk-chx01-get-data.c -o /usr/local/bin/tdk-chx01-get-data-app -L/usr/bin -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm"
+adb shell "gcc /usr/tdk-chx01-get-data.c /usr/tdk-chx01-sysfs.c /usr/tdk-chx01-frame.c /usr/tdk-chx01-pool.c /usr/tdk-chx01-csv.c /usr/tdk-chx01-capture.c /usr/tdk-chx01-logger.c /usr/tdk-chx01-replay.c /usr/tdk-chx01-rawcap.c /usr/tdk-chx01-latency.c /usr/tdk-chx01-soak.c /usr/tdk-chx01-firmware.c /usr/tdk-chx01-startup.c /usr/tdk-chx01-control.c /usr/tdk-chx01-hotplug.c /usr/tdk-chx01-algo.c /usr/tdk-chx01-session.c -o /usr/local/bin/tdk-chx01-get-data-app -L/usr/bin -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm -lpthread"
+adb shell "gcc /usr/tdk-chx01-ctl.c -o /usr/local/bin/tdk-chx01-ctl"
+adb shell "gcc /usr/tdk-chx01-cap2csv.c /usr/tdk-chx01-replay.c /usr/tdk-chx01-rawcap.c /usr/tdk-chx01-capture.c /usr/tdk-chx01-csv.c /usr/tdk-chx01-frame.c -o /usr/local/bin/tdk-chx01-cap2csv"
+adb shell "gcc /usr/tdk-chx01-synth-cli.c /usr/tdk-chx01-synth.c /usr/tdk-chx01-rawcap.c /usr/tdk-chx01-capture.c /usr/tdk-chx01-csv.c /usr/tdk-chx01-frame.c -o /usr/local/bin/tdk-chx01-synth -lm"
+adb shell "gcc -O2 -DCHX01_BENCH_ALGOS /usr/tdk-chx01-benchmark.c /usr/tdk-chx01-synth.c /usr/tdk-chx01-frame.c /usr/tdk-chx01-csv.c /usr/tdk-chx01-capture.c -o /usr/local/bin/tdk-chx01-benchmark -L/usr/bin -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm"
 
@@ -1,5 +1,5 @@
-gcc tdk-chx01-get-data.c -o tdk-chx01-get-data-app -L. -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm
+gcc tdk-chx01-get-data.c tdk-chx01-sysfs.c tdk-chx01-frame.c tdk-chx01-pool.c tdk-chx01-csv.c tdk-chx01-capture.c tdk-chx01-logger.c tdk-chx01-replay.c tdk-chx01-rawcap.c tdk-chx01-latency.c tdk-chx01-soak.c tdk-chx01-firmware.c tdk-chx01-startup.c tdk-chx01-control.c tdk-chx01-hotplug.c tdk-chx01-algo.c tdk-chx01-session.c -o tdk-chx01-get-data-app -L. -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm -lpthread
 
-gcc -shared -fPIC tdk-chx01-get-data.c -o libtdk-chx01-get-data.so -L. -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm
+gcc -shared -fPIC tdk-chx01-get-data.c tdk-chx01-sysfs.c tdk-chx01-frame.c tdk-chx01-pool.c tdk-chx01-csv.c tdk-chx01-capture.c tdk-chx01-logger.c tdk-chx01-replay.c tdk-chx01-rawcap.c tdk-chx01-latency.c tdk-chx01-soak.c tdk-chx01-firmware.c tdk-chx01-startup.c tdk-chx01-control.c tdk-chx01-hotplug.c tdk-chx01-algo.c tdk-chx01-session.c -o libtdk-chx01-get-data.so -L. -lInvnAlgoRangeFinder -lInvnAlgoFloorTypeFxp -lInvnAlgoCliffDetection -lInvnAlgoObstaclePosition -lm -lpthread
 
 cp libtdk-chx01-get-data.so /usr/lib/.
@@ -1,6 +1,11 @@
 
+# soak test: $1 seconds in one run, default 10, a new log every 10 seconds
+DURATION=${1:-10}
+
 adb wait-for-device
 adb shell tdk-chx01-fw -p ch101_v41b.bin
 adb shell tdk-chx01-fw -p ch201_v10a.bin
-adb shell tdk-chx01-get-data-app -d 10 -s 120 -f 5 -l /usr/chirp.csv
-adb pull /usr/chirp.csv ./
+adb shell tdk-chx01-get-data-app -n -d ${DURATION} -L 10 -s 120 -f 5 -l /usr/chirp.csv
+for f in $(adb shell ls /usr/chirp_*.csv); do
+	adb pull ${f} ./
+done
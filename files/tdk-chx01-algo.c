@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "invn_algo_rangefinder.h"
+#include "invn_algo_floor_type_fxp.h"
+#include "invn_algo_cliff_detection.h"
+#include "tdk-chx01-algo.h"
+#include "tdk-chx01-csv.h"
+
+#define ALGO_CACHE_LINE		64
+
+/* distance between the centers of the two sensors of a pitch-catch pair */
+#define PITCH_CATCH_DISTANCE_MM	28
+
+#define FLOOR_DATA_START_READ_IDX 8
+#define FLOOR_DATA_DECIMATION 1
+
+/*! \struct InvnRangeFinder
+ * InvnRangeFinder data structure that store internal algorithm state.
+ * The struct below shows one method to align the data buffer pointer to
+ * 32 bit for 32bit MCU. Other methods can be used to align memory using
+ * malloc or attribute((aligned, 4))
+ */
+union InvnRangeFinder {
+	uint8_t data[INVN_RANGEFINDER_DATA_STRUCTURE_SIZE];
+	uint32_t data32;
+};
+
+/*! \struct InvnFloorType
+ * InvnFloorType data structure that store internal algorithm state.
+ * The struct below shows one method to align the data buffer pointer to 32 bit
+ * for 32bit MCU. Other methods can be used to align memory using malloc or
+ * attribute((aligned, 4))
+ */
+union InvnFloorType {
+	uint8_t data[INVN_FLOOR_TYPE_DATA_STRUCTURE_SIZE];
+	uint32_t data32;
+};
+
+/*! \struct InvnCliffDetection
+ * InvnCliffDetection data structure that store internal algorithm state.
+ * The struct below shows one method to align the data buffer pointer to 32
+ * bit for 32bit MCU. Other methods can be used to align memory using malloc
+ * or attribute((aligned, 4))
+ */
+union InvnCliffDetection {
+	uint8_t data[INVN_CLIFF_DETECTION_DATA_STRUCTURE_SIZE];
+	uint32_t data32;
+};
+
+/*! \struct range_link
+ * RangeFinder state of one (Tx, Rx) link. The algorithm tracks the echo
+ * across frames and predicts it for a few frames once it is lost, so the
+ * state must live as long as the link and see real frame times.
+ */
+struct range_link {
+	pthread_mutex_t lock;
+	int initialized;
+	uint32_t fop;			/* FOP the state was initialized with */
+	InvnAlgoRangeFinderConfig config;
+	union InvnRangeFinder algo;
+} __attribute__((aligned(ALGO_CACHE_LINE)));
+
+/*! \struct floor_instance
+ * Floor type state of one downward-facing sensor.
+ */
+struct floor_instance {
+	pthread_mutex_t lock;
+	int initialized;
+	uint32_t fop;			/* FOP the state was initialized with */
+	unsigned int floor_mm;		/* floor distance of the state */
+	InvnAlgoFloorTypeFxpConfig config;
+	union InvnFloorType algo;
+} __attribute__((aligned(ALGO_CACHE_LINE)));
+
+/*! \struct cliff_instance
+ * Cliff detection state of one pitch-catch (Tx, Rx) pair.
+ */
+struct cliff_instance {
+	pthread_mutex_t lock;
+	int initialized;
+	InvnAlgoCliffDetectionConfig config;
+	union InvnCliffDetection algo;
+} __attribute__((aligned(ALGO_CACHE_LINE)));
+
+/*! \struct algo_arena
+ * Algorithm states of every sensor and link, indexed by sensor_connection[].
+ * Each instance starts on its own cache line and has its own lock, so
+ * different sensors can be processed from different threads without sharing
+ * state or cache lines.
+ */
+struct algo_arena {
+	struct range_link range[MAX_NUM_SENSORS][MAX_NUM_SENSORS];
+	struct floor_instance floor[MAX_NUM_SENSORS];
+	struct cliff_instance cliff[MAX_NUM_SENSORS][MAX_NUM_SENSORS];
+};
+
+static void arena_init(struct algo_arena *a)
+{
+	int i, j;
+
+	memset(a, 0, sizeof(*a));
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		pthread_mutex_init(&a->floor[i].lock, NULL);
+		for (j = 0; j < MAX_NUM_SENSORS; j++) {
+			pthread_mutex_init(&a->range[i][j].lock, NULL);
+			pthread_mutex_init(&a->cliff[i][j].lock, NULL);
+		}
+	}
+}
+
+static void arena_fini(struct algo_arena *a)
+{
+	int i, j;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		pthread_mutex_destroy(&a->floor[i].lock);
+		for (j = 0; j < MAX_NUM_SENSORS; j++) {
+			pthread_mutex_destroy(&a->range[i][j].lock);
+			pthread_mutex_destroy(&a->cliff[i][j].lock);
+		}
+	}
+}
+
+int algo_arena_create(struct algo_arena **ap)
+{
+	struct algo_arena *a;
+
+	if (posix_memalign((void **)&a, ALGO_CACHE_LINE, sizeof(*a)))
+		return -ENOMEM;
+	arena_init(a);
+	*ap = a;
+
+	return 0;
+}
+
+void algo_arena_reset(struct algo_arena *a)
+{
+	arena_fini(a);
+	arena_init(a);
+}
+
+void algo_arena_destroy(struct algo_arena *a)
+{
+	if (a == NULL)
+		return;
+	arena_fini(a);
+	free(a);
+}
+
+/* sensor that transmitted the echo received by dev_num, -1 if unknown */
+static int link_tx_sensor(const char *sensor_connection, int dev_num,
+	int num_sensors, const char *mode)
+{
+	int j;
+
+	if (mode[dev_num] == CHX01_TX_RX_MODE)
+		return sensor_connection[dev_num];
+
+	//RX only mode, same transmitter as reported in the log
+	for (j = 0; j < num_sensors; j++) {
+		if ((mode[j] == CHX01_TX_RX_MODE) && (sensor_connection[j] < 2))
+			return sensor_connection[j];
+	}
+
+	return -1;
+}
+
+int algo_plan(const char *sensor_connection, int num_sensors, const char *mode,
+	unsigned int algos, unsigned int floor_sensors, struct algo_call *calls)
+{
+	int dev_num, tx, n = 0;
+
+	for (dev_num = 0; dev_num < num_sensors; dev_num++) {
+		if ((mode[dev_num] != CHX01_RX_ONLY_MODE &&
+		     mode[dev_num] != CHX01_TX_RX_MODE) ||
+		    sensor_connection[dev_num] >= CHX01_CH201_FIRST)
+			continue;
+
+		tx = link_tx_sensor(sensor_connection, dev_num, num_sensors,
+			mode);
+		if ((algos & ALGO_FLAG(ALGO_FLOOR_TYPE)) &&
+		    (floor_sensors & (1u << sensor_connection[dev_num])))
+			calls[n++] = (struct algo_call){ ALGO_FLOOR_TYPE,
+				dev_num, tx };
+		if (tx < 0)
+			continue;
+		if (algos & ALGO_FLAG(ALGO_RANGE))
+			calls[n++] = (struct algo_call){ ALGO_RANGE, dev_num,
+				tx };
+		if ((algos & ALGO_FLAG(ALGO_CLIFF)) &&
+		    mode[dev_num] == CHX01_RX_ONLY_MODE)
+			calls[n++] = (struct algo_call){ ALGO_CLIFF, dev_num,
+				tx };
+	}
+
+	return n;
+}
+
+static int init_range_link(struct range_link *link, int tx, int rx,
+	uint32_t fop)
+{
+	invn_algo_rangefinder_generate_default_config(&link->config);
+	// update config FOP to the receiving sensor FOP
+	link->config.sensor_FOP = fop;
+	if (tx != rx) {
+		// pitch_catch: no pre-trigger, distance between sensor centers
+		link->config.pre_trigger_time = 0;
+		link->config.inter_sensor_distance_mm = PITCH_CATCH_DISTANCE_MM;
+	}
+	if (invn_algo_rangefinder_init(&link->algo, &link->config)) {
+		link->initialized = 0;
+		return -EINVAL;
+	}
+	link->fop = fop;
+	link->initialized = 1;
+
+	return 0;
+}
+
+int algo_range(struct algo_arena *a, uint32_t fop, int tx, int rx,
+	uint64_t time_us, int16_t *iq_buffer, int samples,
+	unsigned short *distance, unsigned short *amplitude)
+{
+	struct range_link *link = &a->range[tx][rx];
+	InvnAlgoRangeFinderInput inputs;
+	InvnAlgoRangeFinderOutput outputs;
+	int res = 0;
+
+	pthread_mutex_lock(&link->lock);
+	if (!link->initialized || link->fop != fop)
+		res = init_range_link(link, tx, rx, fop);
+	if (res == 0) {
+		inputs.time = time_us;
+		inputs.Tx = tx;
+		inputs.Rx = rx;
+		inputs.nbr_samples_skip = 0;
+		inputs.nbr_samples = samples;
+		inputs.iq_buffer = iq_buffer;
+		if (invn_algo_rangefinder_process(&link->algo, &inputs,
+				&outputs))
+			res = -EINVAL;
+	}
+	pthread_mutex_unlock(&link->lock);
+	if (res)
+		return res;
+
+	*distance = outputs.distance_to_object;
+	*amplitude = outputs.magnitude_of_echo;
+
+	return outputs.range_status;
+}
+
+/* the default config is usable as is, the bits it returns are warnings */
+static int init_floortype(struct floor_instance *inst, uint32_t fop,
+	unsigned int floor_mm, unsigned int *warnings)
+{
+	*warnings = (uint16_t)invn_algo_floor_type_fxp_generate_default_config(
+		floor_mm, FLOOR_DATA_START_READ_IDX, FLOOR_DATA_DECIMATION,
+		fop, &inst->config);
+	if (invn_algo_floor_type_fxp_init(&inst->algo, &inst->config))
+		return -EINVAL;
+	inst->fop = fop;
+	inst->floor_mm = floor_mm;
+	inst->initialized = 1;
+
+	return 0;
+}
+
+int algo_floor_type(struct algo_arena *a, int sensor, uint32_t fop,
+	unsigned int floor_mm, uint64_t time_us, int16_t *iq_buffer,
+	int samples, unsigned int *warnings)
+{
+	struct floor_instance *inst = &a->floor[sensor];
+	InvnAlgoFloorTypeFxpInput inputs;
+	InvnAlgoFloorTypeFxpOutput outputs;
+	unsigned int config_warnings = 0;
+	int res = 0;
+
+	pthread_mutex_lock(&inst->lock);
+	if (!inst->initialized || inst->fop != fop ||
+	    inst->floor_mm != floor_mm)
+		res = init_floortype(inst, fop, floor_mm, &config_warnings);
+	if (res == 0) {
+		inputs.time = time_us;
+		inputs.nbr_samples = samples;
+		inputs.buffer.iq = iq_buffer;
+		inputs.mask = INVN_FLOORTYPE_FXP_INPUT_TYPE_IQ_DATA;
+		invn_algo_floor_type_fxp_process(&inst->algo, &inputs,
+			&outputs);
+	}
+	pthread_mutex_unlock(&inst->lock);
+	if (warnings)
+		*warnings = config_warnings;
+	if (res)
+		return res;
+
+	return outputs.floor_type;
+}
+
+int algo_cliff(struct algo_arena *a, int tx, int rx, uint64_t time_us,
+	int16_t *iq_buffer, int samples)
+{
+	struct cliff_instance *inst = &a->cliff[tx][rx];
+	InvnAlgoCliffDetectionInput inputs;
+	InvnAlgoCliffDetectionOutput outputs;
+	int res = 0;
+
+	pthread_mutex_lock(&inst->lock);
+	if (!inst->initialized) {
+		invn_algo_cliff_detection_generate_default_config(&inst->config);
+		if (invn_algo_cliff_detection_init(&inst->algo, &inst->config))
+			res = -EINVAL;
+		else
+			inst->initialized = 1;
+	}
+	if (res == 0) {
+		inputs.Tx = tx;
+		inputs.Rx = rx;
+		inputs.time = time_us;
+		inputs.nbr_samples = samples;
+		inputs.iq_buffer = iq_buffer;
+		invn_algo_cliff_detection_process(&inst->algo, &inputs,
+			&outputs);
+	}
+	pthread_mutex_unlock(&inst->lock);
+	if (res)
+		return res;
+
+	return outputs.cliff_detection;
+}
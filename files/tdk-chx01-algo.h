@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_ALGO_H_
+#define _TDK_CHX01_ALGO_H_
+
+#include <stdint.h>
+
+#include "tdk-chx01-frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \struct algo_call
+ * One algorithm call for one sensor of a frame.
+ */
+struct algo_call {
+	enum algo_kind kind;
+	int dev_num;		/* scan order of the receiving sensor */
+	int tx;			/* sensor_connection[] of the transmitter */
+};
+
+/* at most one call of each kind per sensor */
+#define ALGO_MAX_CALLS		(ALGO_KINDS * MAX_NUM_SENSORS)
+
+/* InvenSense algorithm states of every sensor and link of one device */
+struct algo_arena;
+
+/* Return: 0 on success, -ENOMEM */
+int algo_arena_create(struct algo_arena **ap);
+
+/* every state starts over on its next use, e.g. after a setup change */
+void algo_arena_reset(struct algo_arena *a);
+
+void algo_arena_destroy(struct algo_arena *a);
+
+/**
+ * algo_plan() - algorithm calls of a frame
+ * @sensor_connection: scan order to port
+ * @num_sensors: sensors in scan order
+ * @mode: frame->mode
+ * @algos: ALGO_FLAG() of the kinds to run
+ * @floor_sensors: sensor_connection[] bitmask of the downward-facing
+ *	sensors, the only ones running floor type detection
+ * @calls: destination, ALGO_MAX_CALLS long
+ *
+ * Only CH101 sensors are processed. Cliff detection runs on the RX only
+ * sensors of a pitch-catch pair.
+ *
+ * Return: number of calls.
+ **/
+int algo_plan(const char *sensor_connection, int num_sensors, const char *mode,
+	unsigned int algos, unsigned int floor_sensors, struct algo_call *calls);
+
+/**
+ * algo_range() - run RangeFinder for one (Tx, Rx) link
+ * @a: states
+ * @fop: FOP of the receiving sensor, the state is reinitialized on a change
+ * @tx: sensor_connection[] of the transmitting sensor
+ * @rx: sensor_connection[] of the receiving sensor
+ * @time_us: frame time, in us
+ * @iq_buffer: interleaved IQ samples of the receiving sensor
+ * @samples: number of IQ samples
+ * @distance: range of the echo, mm
+ * @amplitude: magnitude of the echo
+ *
+ * Return: range status, or -EINVAL if the algorithm failed.
+ **/
+int algo_range(struct algo_arena *a, uint32_t fop, int tx, int rx,
+	uint64_t time_us, int16_t *iq_buffer, int samples,
+	unsigned short *distance, unsigned short *amplitude);
+
+/**
+ * algo_floor_type() - run floor type detection for one sensor
+ * @a: states
+ * @sensor: sensor_connection[] of the sensor
+ * @fop: FOP of the sensor, the state is reinitialized on a change
+ * @floor_mm: distance of the sensor to the floor
+ * @time_us: frame time, in us
+ * @iq_buffer: interleaved IQ samples
+ * @samples: number of IQ samples
+ * @warnings: INVN_FLOORTYPE_FXP_RETURN_CONFIG_WARNING_* bits of the
+ *	default config when this call initialized the state, 0 otherwise,
+ *	may be NULL
+ *
+ * Return: floor type class id, 0 soft or 1 hard, or -EINVAL if the
+ * algorithm could not be initialized.
+ **/
+int algo_floor_type(struct algo_arena *a, int sensor, uint32_t fop,
+	unsigned int floor_mm, uint64_t time_us, int16_t *iq_buffer,
+	int samples, unsigned int *warnings);
+
+/**
+ * algo_cliff() - run cliff detection for one pitch-catch pair
+ * @a: states
+ * @tx: sensor_connection[] of the transmitting sensor
+ * @rx: sensor_connection[] of the receiving sensor
+ * @time_us: frame time, in us
+ * @iq_buffer: interleaved IQ samples of the receiving sensor
+ * @samples: number of IQ samples
+ *
+ * Return: floor (0), ambiguous (1) or cliff (2), or -EINVAL.
+ **/
+int algo_cliff(struct algo_arena *a, int tx, int rx, uint64_t time_us,
+	int16_t *iq_buffer, int samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks for the acquisition path. Runs without hardware on
+ * randomly generated scans.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-frame.h"
+
+#define BENCH_SCANS	4096
+#define CSV_CHECK_FRAMES	64
+
+struct legacy_frame {
+	int index;
+	int16_t I[MAX_NUM_SENSORS][MAX_NUM_SAMPLES];
+	int16_t Q[MAX_NUM_SENSORS][MAX_NUM_SAMPLES];
+	unsigned short distance[MAX_NUM_SENSORS];
+	unsigned short amplitude[MAX_NUM_SENSORS];
+	char mode[MAX_NUM_SENSORS];
+};
+
+static struct legacy_frame legacy;
+static struct chx01_frame frame;
+static int16_t iq_buffer[MAX_NUM_SAMPLES * 2];
+static int16_t I_a[MAX_NUM_SAMPLES], Q_a[MAX_NUM_SAMPLES];
+static int16_t I_b[MAX_NUM_SAMPLES], Q_b[MAX_NUM_SAMPLES];
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* the per-byte decode into separate I and Q used before the interleaved
+ * frame store, kept to measure against. It sign-extends the low byte
+ * wherever char is signed. */
+static void decode_scan_legacy(const struct chx01_scan_layout *layout,
+	const char *buffer, struct legacy_frame *frame, int count)
+{
+	int num_sensors = layout->num_sensors;
+	int index = frame->index;
+	const char *ptr;
+	short value;
+	int i, j;
+
+	for (j = 0; j < num_sensors; j++) {
+		for (i = 0; i < count; i++) {
+			value = buffer[i*4+1+j*28];
+			value <<= 8;
+			value += buffer[i*4+j*28];
+			frame->I[j][i+index] = value;
+
+			value = buffer[i*4+3+j*28];
+			value <<= 8;
+			value += buffer[i*4+2+j*28];
+			frame->Q[j][i+index] = value;
+		}
+	}
+
+	ptr = buffer + 28*num_sensors;
+	for (j = 0; j < num_sensors; j++) {
+		frame->distance[j] = ptr[1+j*2];
+		frame->distance[j] <<= 8;
+		frame->distance[j] += ptr[j*2];
+	}
+	ptr += 2*num_sensors;
+	for (j = 0; j < num_sensors; j++) {
+		frame->amplitude[j] = ptr[1+j*2];
+		frame->amplitude[j] <<= 8;
+		frame->amplitude[j] += ptr[j*2];
+	}
+	ptr += 2*num_sensors;
+	for (j = 0; j < num_sensors; j++)
+		frame->mode[j] = ptr[j];
+}
+
+static void fill_random(char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (char)(rand() & 0xff);
+}
+
+static int16_t scan_iq(const char *scan, int sensor, int sample, int q)
+{
+	const unsigned char *p = (const unsigned char *)scan +
+		sensor * IQ_BYTES_PER_SCAN + sample * 4 + q * 2;
+
+	return (int16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * check_decode() - check chx01_decode_scan() and chx01_iq_split()
+ * @scans: random scans
+ * @n: number of scans
+ *
+ * Full frames of every length up to MAX_NUM_SAMPLES are decoded for every
+ * number of sensors, compared against the scan bytes, then split and
+ * compared against chx01_iq_split_ref().
+ *
+ * Return: number of mismatching frames.
+ **/
+static int check_decode(const char *scans, int n)
+{
+	struct chx01_scan_layout layout;
+	int errors = 0;
+	int sensors, samples, s, i, j, count, bad;
+	const char *scan;
+
+	layout.scan_bytes = MAX_CH_IIO_BUFFER;
+	for (sensors = 1; sensors <= MAX_NUM_SENSORS; sensors++) {
+		layout.num_sensors = sensors;
+		for (samples = 1; samples <= MAX_NUM_SAMPLES; samples++) {
+			layout.num_samples = samples;
+			frame.index = 0;
+			for (s = 0; frame.index < samples; s++) {
+				count = samples - frame.index;
+				if (count > IQ_SAMPLES_PER_SCAN)
+					count = IQ_SAMPLES_PER_SCAN;
+				scan = scans + (s % n) * MAX_CH_IIO_BUFFER;
+				chx01_decode_scan(&layout, scan, &frame, count);
+				frame.index += count;
+			}
+
+			bad = 0;
+			for (j = 0; j < sensors; j++) {
+				for (i = 0; i < samples; i++) {
+					scan = scans + ((i / IQ_SAMPLES_PER_SCAN) % n) *
+						MAX_CH_IIO_BUFFER;
+					if (frame.iq[j][2*i] != scan_iq(scan, j,
+							i % IQ_SAMPLES_PER_SCAN, 0) ||
+					    frame.iq[j][2*i+1] != scan_iq(scan, j,
+							i % IQ_SAMPLES_PER_SCAN, 1))
+						bad = 1;
+				}
+
+				chx01_iq_split_ref(frame.iq[j], I_a, Q_a, samples);
+				chx01_iq_split(frame.iq[j], I_b, Q_b, samples);
+				if (memcmp(I_a, I_b, samples * sizeof(int16_t)) ||
+				    memcmp(Q_a, Q_b, samples * sizeof(int16_t)))
+					bad = 1;
+			}
+			errors += bad;
+		}
+	}
+
+	return errors;
+}
+
+/* old path: per-byte decode, then copy each sensor into iq_buffer for the
+ * algorithms */
+static double bench_legacy(const struct chx01_scan_layout *layout,
+	const char *scans, int rounds)
+{
+	int per_frame = chx01_scans_per_frame(layout);
+	double start;
+	int r, s, i, j;
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		legacy.index = 0;
+		for (s = 0; s < per_frame; s++) {
+			decode_scan_legacy(layout,
+				scans + (s % BENCH_SCANS) * MAX_CH_IIO_BUFFER,
+				&legacy, IQ_SAMPLES_PER_SCAN);
+			legacy.index += IQ_SAMPLES_PER_SCAN;
+		}
+		for (j = 0; j < layout->num_sensors; j++) {
+			for (i = 0; i < layout->num_samples; i++) {
+				iq_buffer[2*i] = legacy.I[j][i];
+				iq_buffer[2*i+1] = legacy.Q[j][i];
+			}
+			__asm__ volatile("" : : "r"(iq_buffer) : "memory");
+		}
+	}
+
+	return (now_ns() - start) / rounds;
+}
+
+/* current path: the decoded frame is handed to the algorithms as is */
+static double bench_decode(const struct chx01_scan_layout *layout,
+	const char *scans, int rounds)
+{
+	int per_frame = chx01_scans_per_frame(layout);
+	double start;
+	int r, s;
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		frame.index = 0;
+		for (s = 0; s < per_frame; s++) {
+			chx01_decode_scan(layout,
+				scans + (s % BENCH_SCANS) * MAX_CH_IIO_BUFFER,
+				&frame, IQ_SAMPLES_PER_SCAN);
+			frame.index += IQ_SAMPLES_PER_SCAN;
+		}
+		__asm__ volatile("" : : "r"(&frame) : "memory");
+	}
+
+	return (now_ns() - start) / rounds;
+}
+
+typedef void (*split_fn)(const int16_t *iq, int16_t *I, int16_t *Q,
+	int count);
+
+/* I/Q views of every sensor, as built for the CSV log */
+static double bench_split(split_fn fn, const struct chx01_scan_layout *layout,
+	int rounds)
+{
+	double start;
+	int r, j;
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		for (j = 0; j < layout->num_sensors; j++) {
+			fn(frame.iq[j], I_a, Q_a, layout->num_samples);
+			__asm__ volatile("" : : "r"(I_a), "r"(Q_a) : "memory");
+		}
+	}
+
+	return (now_ns() - start) / rounds;
+}
+
+/* random setup with num_sensors sensors, some of them CH201 */
+static void random_log_info(struct chx01_log_info *info, int num_sensors,
+	int samples)
+{
+	int i;
+
+	memset(info, 0, sizeof(*info));
+	info->num_sensors = num_sensors;
+	info->num_samples = samples;
+	info->frequency = 1 + rand() % 100;
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		info->port_map[i] = chx01_port_map[i];
+		info->op_freq[i] = 50000 + rand() % 150000;
+	}
+	for (i = 0; i < num_sensors; i++) {
+		info->sensor_connection[i] = (i + rand()) % MAX_NUM_SENSORS;
+		info->sensor_connected[(int)info->sensor_connection[i]] = 1;
+	}
+}
+
+static void random_csv_frame(struct chx01_frame *f, int num_sensors)
+{
+	static const char modes[] = {
+		CHX01_TX_RX_MODE, CHX01_TX_RX_MODE, CHX01_RX_ONLY_MODE, 0x30,
+	};
+	static const unsigned short distances[] = {0, 0xFFFF, 9, 10, 65534};
+	int j;
+
+	fill_random((char *)f->iq, sizeof(f->iq));
+	/* exercise the %f rounding, including exact half microseconds */
+	f->timestamp = (long long)rand() * 1000000LL + rand() % 1000000;
+	if (rand() & 1)
+		f->timestamp = f->timestamp / 1000 * 1000 + 500;
+	for (j = 0; j < num_sensors; j++) {
+		f->mode[j] = modes[rand() % 4];
+		f->distance[j] = rand() & 1 ? (unsigned short)rand() :
+			distances[rand() % 5];
+		f->amplitude[j] = rand() & 1 ? (unsigned short)rand() :
+			distances[rand() % 5];
+	}
+}
+
+/**
+ * check_csv() - compare the CSV emitter with the fprintf() reference
+ *
+ * Random setups of every sensor count and a range of sample counts, each
+ * with random frames including RX-only, unknown modes and the 0 and 0xFFFF
+ * range markers.
+ *
+ * Return: number of mismatching setups.
+ **/
+static int check_csv(void)
+{
+	static const int samples[] = {1, 7, 40, 99, 225, MAX_NUM_SAMPLES};
+	struct chx01_log_info info;
+	struct chx01_csv csv;
+	char *ref, *out;
+	size_t ref_len, out_len;
+	FILE *ref_fp, *out_fp;
+	int errors = 0;
+	int sensors, k, f;
+
+	for (sensors = 1; sensors <= MAX_NUM_SENSORS; sensors++) {
+		for (k = 0; k < (int)(sizeof(samples) / sizeof(samples[0])); k++) {
+			random_log_info(&info, sensors, samples[k]);
+			if (chx01_csv_init(&csv, &info))
+				return -1;
+			ref_fp = open_memstream(&ref, &ref_len);
+			out_fp = open_memstream(&out, &out_len);
+			chx01_csv_header_ref(ref_fp, &info);
+			chx01_csv_header(&csv, out_fp);
+			for (f = 0; f < CSV_CHECK_FRAMES; f++) {
+				random_csv_frame(&frame, sensors);
+				chx01_csv_frame_ref(ref_fp, &info, &frame);
+				chx01_csv_frame(&csv, out_fp, &frame);
+			}
+			fclose(ref_fp);
+			fclose(out_fp);
+			if (ref_len != out_len || memcmp(ref, out, ref_len))
+				errors++;
+			free(ref);
+			free(out);
+			chx01_csv_destroy(&csv);
+		}
+	}
+
+	return errors;
+}
+
+/* CSV lines of one frame written to /dev/null, reference or emitter */
+static double bench_csv(const struct chx01_scan_layout *layout, int use_ref,
+	int rounds)
+{
+	struct chx01_log_info info;
+	struct chx01_csv csv;
+	double start;
+	FILE *fp;
+	int r;
+
+	fp = fopen("/dev/null", "w");
+	if (fp == NULL)
+		return 0;
+	random_log_info(&info, layout->num_sensors, layout->num_samples);
+	memset(info.sensor_connection, 0, sizeof(info.sensor_connection));
+	if (chx01_csv_init(&csv, &info)) {
+		fclose(fp);
+		return 0;
+	}
+	random_csv_frame(&frame, layout->num_sensors);
+	memset(frame.mode, CHX01_TX_RX_MODE, sizeof(frame.mode));
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		if (use_ref)
+			chx01_csv_frame_ref(fp, &info, &frame);
+		else
+			chx01_csv_frame(&csv, fp, &frame);
+	}
+	start = (now_ns() - start) / rounds;
+
+	chx01_csv_destroy(&csv);
+	fclose(fp);
+
+	return start;
+}
+
+int main(int argc, char *argv[])
+{
+	struct chx01_scan_layout layout;
+	int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+	char *scans;
+	int errors, csv_errors;
+
+	scans = malloc((size_t)BENCH_SCANS * MAX_CH_IIO_BUFFER);
+	if (scans == NULL)
+		return 1;
+	srand(1);
+	fill_random(scans, (size_t)BENCH_SCANS * MAX_CH_IIO_BUFFER);
+
+	errors = check_decode(scans, BENCH_SCANS);
+	printf("decode and %s split vs reference: %s (%d mismatching frames)\n",
+		chx01_iq_split_impl(), errors ? "FAIL" : "bit-exact", errors);
+
+	csv_errors = check_csv();
+	printf("CSV emitter vs fprintf reference: %s (%d mismatching setups)\n",
+		csv_errors ? "FAIL" : "byte-identical", csv_errors);
+
+	layout.num_sensors = MAX_NUM_SENSORS;
+	layout.scan_bytes = MAX_CH_IIO_BUFFER;
+	layout.num_samples = MAX_SCANS_PER_FRAME * IQ_SAMPLES_PER_SCAN;
+	if (layout.num_samples > MAX_NUM_SAMPLES)
+		layout.num_samples -= IQ_SAMPLES_PER_SCAN;
+
+	printf("ns per frame, %d sensors x %d samples:\n",
+		layout.num_sensors, layout.num_samples);
+	printf("  legacy decode + iq_buffer copy %8.0f\n",
+		bench_legacy(&layout, scans, rounds));
+	printf("  decode (algorithm-ready)       %8.0f\n",
+		bench_decode(&layout, scans, rounds));
+	printf("  I/Q split, reference           %8.0f\n",
+		bench_split(chx01_iq_split_ref, &layout, rounds));
+	printf("  I/Q split, %-6s              %8.0f\n", chx01_iq_split_impl(),
+		bench_split(chx01_iq_split, &layout, rounds));
+
+
+	/* CSV of all sensors at the largest sample count the driver takes */
+	layout.num_samples = 225;
+	rounds = rounds / 20 + 1;
+	printf("ns per frame of CSV, %d sensors x %d samples:\n",
+		layout.num_sensors, layout.num_samples);
+	printf("  fprintf reference              %8.0f\n",
+		bench_csv(&layout, 1, rounds));
+	printf("  CSV emitter                    %8.0f\n",
+		bench_csv(&layout, 0, rounds));
+
+	free(scans);
+
+	return errors || csv_errors ? 1 : 0;
+}
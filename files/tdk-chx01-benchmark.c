@@ -0,0 +1,558 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Where the frame time goes, without hardware. For every sensor and sample
+ * count of the sweep, synthetic frames are encoded into IIO scans, then
+ * each stage of the pipeline is timed frame by frame: scan decode, I/Q
+ * split, CSV and binary logging and, when built with CHX01_BENCH_ALGOS,
+ * each InvenSense algorithm call. Results are printed as JSON:
+ *
+ *   tdk-chx01-benchmark -n 1-6 -s 40,100,200,450 -o bench.json
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include "tdk-chx01-capture.h"
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-frame.h"
+#include "tdk-chx01-synth.h"
+
+#ifdef CHX01_BENCH_ALGOS
+#include "invn_algo_rangefinder.h"
+#include "invn_algo_floor_type_fxp.h"
+#include "invn_algo_cliff_detection.h"
+#include "invn_algo_obstacleposition.h"
+#endif
+
+#define BENCH_DISTINCT_FRAMES	16	/* synthesized frames, cycled */
+#define BENCH_WARMUP_FRAMES	8
+#define BENCH_MAX_POINTS	32	/* values in a -n or -s list */
+#define BENCH_LOG_BUFFER	(1 << 20)
+#define BENCH_PATH_LEN		256
+
+#define FLOOR_DISTANCE_MM	33
+#define FLOOR_DATA_START_READ_IDX 8
+#define FLOOR_DATA_DECIMATION	1
+
+enum bench_stage {
+	BENCH_DECODE,
+	BENCH_IQ_SPLIT,
+	BENCH_CSV,
+	BENCH_CAPTURE,
+	BENCH_RANGE,
+	BENCH_FLOOR,
+	BENCH_CLIFF,
+	BENCH_OBSTACLE,
+	BENCH_STAGES,
+};
+
+static const char * const stage_names[BENCH_STAGES] = {
+	[BENCH_DECODE] = "decode",
+	[BENCH_IQ_SPLIT] = "iq_split",
+	[BENCH_CSV] = "csv",
+	[BENCH_CAPTURE] = "capture",
+	[BENCH_RANGE] = "rangefinder",
+	[BENCH_FLOOR] = "floor_type",
+	[BENCH_CLIFF] = "cliff_detection",
+	[BENCH_OBSTACLE] = "obstacle_position",
+};
+
+/*! \struct bench_stage_result
+ * Time of one stage for every timed frame.
+ */
+struct bench_stage_result {
+	int calls_per_frame;	/* 0: stage not run */
+	long long *ns;		/* one entry per frame */
+};
+
+#ifdef CHX01_BENCH_ALGOS
+/*! \struct bench_algos
+ * Algorithm states of one sweep point, aligned like the application does.
+ */
+struct bench_algos {
+	union {
+		uint8_t data[INVN_RANGEFINDER_DATA_STRUCTURE_SIZE];
+		uint32_t data32;
+	} range[MAX_NUM_SENSORS];
+	union {
+		uint8_t data[INVN_FLOOR_TYPE_DATA_STRUCTURE_SIZE];
+		uint32_t data32;
+	} floor;
+	union {
+		uint8_t data[INVN_CLIFF_DETECTION_DATA_STRUCTURE_SIZE];
+		uint32_t data32;
+	} cliff;
+	union {
+		uint8_t data[INVN_OBSTACLE_POSITION_DATA_STRUCTURE_SIZE];
+		uint32_t data32;
+	} obstacle;
+	int floor_sensor;
+	int cliff_tx, cliff_rx;
+};
+
+static struct bench_algos algos;
+#endif
+
+static struct chx01_frame frames[BENCH_DISTINCT_FRAMES];
+static char scans[BENCH_DISTINCT_FRAMES][MAX_SCANS_PER_FRAME * MAX_CH_IIO_BUFFER];
+static struct chx01_frame decoded;
+static int16_t split_i[MAX_NUM_SAMPLES], split_q[MAX_NUM_SAMPLES];
+
+static struct chx01_frame *decoded_get(void *ctx)
+{
+	return &decoded;
+}
+
+static void decoded_put(void *ctx, struct chx01_frame *frame, int complete)
+{
+}
+
+static const struct frame_assembler_ops decoded_ops = {
+	.get = decoded_get,
+	.put = decoded_put,
+};
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* comma-separated values and ranges, e.g. 1-6 or 40,100,450,
+ * Return: number of values, 0 if invalid */
+static int parse_list(const char *arg, int *values, int min, int max)
+{
+	long first, last, v;
+	char *end;
+	int n = 0;
+
+	do {
+		first = strtol(arg, &end, 10);
+		if (end == arg)
+			return 0;
+		last = first;
+		if (*end == '-') {
+			arg = end + 1;
+			last = strtol(arg, &end, 10);
+			if (end == arg)
+				return 0;
+		}
+		if (first < min || last > max || first > last)
+			return 0;
+		for (v = first; v <= last; v++) {
+			if (n == BENCH_MAX_POINTS)
+				return 0;
+			values[n++] = v;
+		}
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? 0 : n;
+}
+
+#ifdef CHX01_BENCH_ALGOS
+static int algos_init(const struct synth *syn)
+{
+	const struct chx01_log_info *info = &syn->info;
+	InvnAlgoRangeFinderConfig range_config;
+	InvnAlgoFloorTypeFxpConfig floor_config;
+	InvnAlgoCliffDetectionConfig cliff_config;
+	InvnAlgoObstaclePositionConfig obstacle_config;
+	int j;
+
+	for (j = 0; j < info->num_sensors; j++) {
+		invn_algo_rangefinder_generate_default_config(&range_config);
+		range_config.sensor_FOP = info->op_freq[j];
+		if (invn_algo_rangefinder_init(&algos.range[j], &range_config))
+			return -EINVAL;
+	}
+
+	if (invn_algo_floor_type_fxp_generate_default_config(
+			FLOOR_DISTANCE_MM, FLOOR_DATA_START_READ_IDX,
+			FLOOR_DATA_DECIMATION, info->op_freq[algos.floor_sensor],
+			&floor_config) ||
+	    invn_algo_floor_type_fxp_init(&algos.floor, &floor_config))
+		return -EINVAL;
+
+	invn_algo_cliff_detection_generate_default_config(&cliff_config);
+	if (invn_algo_cliff_detection_init(&algos.cliff, &cliff_config))
+		return -EINVAL;
+
+	invn_algo_obstacleposition_generate_default_config(&obstacle_config);
+	for (j = 0; j < NB_SENSOR && j < info->num_sensors; j++)
+		obstacle_config.sensor_FOP[j] = info->op_freq[j];
+	if (invn_algo_obstacleposition_init(&algos.obstacle, &obstacle_config))
+		return -EINVAL;
+
+	return 0;
+}
+
+/* each algorithm on the decoded frame, the way run_algos() calls them */
+static void algos_run(const struct synth *syn, uint64_t time_us,
+	struct bench_stage_result *res, int f)
+{
+	int n = syn->info.num_sensors, samples = syn->info.num_samples;
+	InvnAlgoRangeFinderInput range_in;
+	InvnAlgoRangeFinderOutput range_out;
+	InvnAlgoFloorTypeFxpInput floor_in;
+	InvnAlgoFloorTypeFxpOutput floor_out;
+	InvnAlgoCliffDetectionInput cliff_in;
+	InvnAlgoCliffDetectionOutput cliff_out;
+	InvnAlgoObstaclePositionInput obstacle_in;
+	InvnAlgoObstaclePositionOutput obstacle_out;
+	long long t0;
+	int j;
+
+	t0 = now_ns();
+	for (j = 0; j < n; j++) {
+		range_in.time = time_us;
+		range_in.Tx = j;
+		range_in.Rx = j;
+		range_in.nbr_samples_skip = 0;
+		range_in.nbr_samples = samples;
+		range_in.iq_buffer = decoded.iq[j];
+		invn_algo_rangefinder_process(&algos.range[j], &range_in,
+			&range_out);
+	}
+	res[BENCH_RANGE].ns[f] = now_ns() - t0;
+
+	t0 = now_ns();
+	floor_in.time = time_us;
+	floor_in.nbr_samples = samples;
+	floor_in.buffer.iq = decoded.iq[algos.floor_sensor];
+	floor_in.mask = INVN_FLOORTYPE_FXP_INPUT_TYPE_IQ_DATA;
+	invn_algo_floor_type_fxp_process(&algos.floor, &floor_in, &floor_out);
+	res[BENCH_FLOOR].ns[f] = now_ns() - t0;
+
+	t0 = now_ns();
+	cliff_in.Tx = algos.cliff_tx;
+	cliff_in.Rx = algos.cliff_rx;
+	cliff_in.time = time_us;
+	cliff_in.nbr_samples = samples;
+	cliff_in.iq_buffer = decoded.iq[algos.cliff_rx];
+	invn_algo_cliff_detection_process(&algos.cliff, &cliff_in, &cliff_out);
+	res[BENCH_CLIFF].ns[f] = now_ns() - t0;
+
+	t0 = now_ns();
+	for (j = 0; j < NB_SENSOR && j < n; j++) {
+		memset(&obstacle_in, 0, sizeof(obstacle_in));
+		obstacle_in.time = time_us;
+		obstacle_in.nbr_samples = samples;
+		obstacle_in.iq_buffer = decoded.iq[j];
+		obstacle_in.sensor_ID_Tx = j;
+		obstacle_in.sensor_ID_Rx = j;
+		obstacle_in.mask = 1;
+		invn_algo_obstacleposition_process(&algos.obstacle,
+			&obstacle_in, &obstacle_out);
+	}
+	res[BENCH_OBSTACLE].ns[f] = now_ns() - t0;
+}
+#endif
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* summary of one stage as a JSON object, Return: mean ns per frame */
+static double print_stage(FILE *out, const char *name,
+	const struct bench_stage_result *res, int count, int last)
+{
+	long long *ns = res->ns;
+	double sum = 0;
+	int i;
+
+	qsort(ns, count, sizeof(ns[0]), cmp_ll);
+	for (i = 0; i < count; i++)
+		sum += ns[i];
+
+	fprintf(out, "        \"%s\": {\"calls_per_frame\": %d, "
+		"\"mean_ns\": %.1f, \"min_ns\": %lld, \"median_ns\": %lld, "
+		"\"p99_ns\": %lld, \"max_ns\": %lld}%s\n",
+		name, res->calls_per_frame, sum / count, ns[0], ns[count / 2],
+		ns[(int)(count * 0.99)], ns[count - 1], last ? "" : ",");
+
+	return sum / count;
+}
+
+/**
+ * bench_point() - time every stage for one sensor and sample count
+ * @out: JSON output
+ * @num_sensors: sensors
+ * @samples: IQ samples per sensor
+ * @count: timed frames
+ * @log_dir: directory of the CSV and binary logs, NULL to discard them
+ * @first: first point of the sweep, no separator before it
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+static int bench_point(FILE *out, int num_sensors, int samples, int count,
+	const char *log_dir, int first)
+{
+	struct bench_stage_result res[BENCH_STAGES];
+	struct synth_scene scene;
+	struct synth syn;
+	struct frame_assembler fa;
+	struct chx01_csv csv;
+	struct capture_file cap;
+	char csv_path[BENCH_PATH_LEN] = "/dev/null";
+	char cap_path[BENCH_PATH_LEN] = "/dev/null";
+	const char *buf;
+	FILE *csv_fp;
+	char *csv_buf;
+	int scans_per_frame, stage, last, f, i, j, ret;
+	double total = 0;
+	long long t0;
+
+	synth_scene_default(&scene);
+	scene.floor_sensors = 1u << (num_sensors > 2 ? 2 : 0);
+	ret = synth_init(&syn, &scene, num_sensors, samples, 5);
+	if (ret)
+		return ret;
+	scans_per_frame = chx01_scans_per_frame(&syn.layout);
+	for (i = 0; i < BENCH_DISTINCT_FRAMES; i++) {
+		synth_frame(&syn, i, &frames[i]);
+		synth_encode(&syn, &frames[i], scans[i]);
+	}
+
+	memset(res, 0, sizeof(res));
+	res[BENCH_DECODE].calls_per_frame = scans_per_frame;
+	res[BENCH_IQ_SPLIT].calls_per_frame = num_sensors;
+	res[BENCH_CSV].calls_per_frame = 1;
+	res[BENCH_CAPTURE].calls_per_frame = 1;
+#ifdef CHX01_BENCH_ALGOS
+	algos.floor_sensor = num_sensors > 2 ? 2 : 0;
+	algos.cliff_tx = 0;
+	algos.cliff_rx = num_sensors > 1 ? 1 : 0;
+	ret = algos_init(&syn);
+	if (ret)
+		return ret;
+	res[BENCH_RANGE].calls_per_frame = num_sensors;
+	res[BENCH_FLOOR].calls_per_frame = 1;
+	res[BENCH_CLIFF].calls_per_frame = 1;
+	res[BENCH_OBSTACLE].calls_per_frame =
+		num_sensors < NB_SENSOR ? num_sensors : NB_SENSOR;
+#endif
+	for (stage = 0; stage < BENCH_STAGES; stage++) {
+		res[stage].ns = calloc(count, sizeof(long long));
+		if (res[stage].ns == NULL)
+			ret = -ENOMEM;
+	}
+
+	if (log_dir) {
+		snprintf(csv_path, sizeof(csv_path), "%s/bench-%d-%d.csv",
+			log_dir, num_sensors, samples);
+		snprintf(cap_path, sizeof(cap_path), "%s/bench-%d-%d.cap",
+			log_dir, num_sensors, samples);
+	}
+	csv_fp = fopen(csv_path, "w");
+	csv_buf = malloc(BENCH_LOG_BUFFER);
+	if (ret == 0 && (csv_fp == NULL || csv_buf == NULL))
+		ret = csv_fp ? -ENOMEM : -errno;
+	if (ret == 0) {
+		setvbuf(csv_fp, csv_buf, _IOFBF, BENCH_LOG_BUFFER);
+		ret = chx01_csv_init(&csv, &syn.info);
+	}
+	if (ret == 0) {
+		chx01_csv_header(&csv, csv_fp);
+		ret = capture_create(&cap, cap_path, &syn.info);
+		if (ret)
+			chx01_csv_destroy(&csv);
+	}
+	if (ret) {
+		if (csv_fp)
+			fclose(csv_fp);
+		free(csv_buf);
+		for (stage = 0; stage < BENCH_STAGES; stage++)
+			free(res[stage].ns);
+		return ret;
+	}
+
+	frame_assembler_init(&fa, &syn.layout, &decoded_ops, NULL);
+	for (f = -BENCH_WARMUP_FRAMES; f < count; f++) {
+		/* timing of the warmup frames lands in entry 0, overwritten */
+		i = f < 0 ? 0 : f;
+		buf = scans[(f + BENCH_WARMUP_FRAMES) % BENCH_DISTINCT_FRAMES];
+
+		t0 = now_ns();
+		for (j = 0; j < scans_per_frame; j++)
+			frame_assembler_push(&fa,
+				buf + (size_t)j * syn.layout.scan_bytes);
+		res[BENCH_DECODE].ns[i] = now_ns() - t0;
+
+		t0 = now_ns();
+		for (j = 0; j < num_sensors; j++)
+			chx01_iq_split(decoded.iq[j], split_i, split_q, samples);
+		res[BENCH_IQ_SPLIT].ns[i] = now_ns() - t0;
+
+		t0 = now_ns();
+		chx01_csv_frame(&csv, csv_fp, &decoded);
+		res[BENCH_CSV].ns[i] = now_ns() - t0;
+
+		t0 = now_ns();
+		capture_write_frame(&cap, &decoded);
+		res[BENCH_CAPTURE].ns[i] = now_ns() - t0;
+
+#ifdef CHX01_BENCH_ALGOS
+		algos_run(&syn, (SYNTH_EPOCH_NS + (f + BENCH_WARMUP_FRAMES) *
+			syn.period_ns) / 1000, res, i);
+#endif
+	}
+
+	chx01_csv_destroy(&csv);
+	if (fclose(csv_fp) && ret == 0)
+		ret = -errno;
+	free(csv_buf);
+	if (capture_close(&cap) && ret == 0)
+		ret = -EIO;
+
+	fprintf(out, "%s    {\n", first ? "" : ",\n");
+	fprintf(out, "      \"sensors\": %d, \"samples\": %d, "
+		"\"scans_per_frame\": %d, \"scan_bytes\": %d,\n",
+		num_sensors, samples, scans_per_frame, syn.layout.scan_bytes);
+	fprintf(out, "      \"stages\": {\n");
+	for (last = BENCH_STAGES - 1; last > 0; last--) {
+		if (res[last].calls_per_frame)
+			break;
+	}
+	for (stage = 0; stage <= last; stage++) {
+		if (res[stage].calls_per_frame)
+			total += print_stage(out, stage_names[stage],
+				&res[stage], count, stage == last);
+	}
+	fprintf(out, "      },\n");
+	fprintf(out, "      \"frame_mean_ns\": %.1f\n", total);
+	fprintf(out, "    }");
+
+	for (stage = 0; stage < BENCH_STAGES; stage++)
+		free(res[stage].ns);
+
+	return ret;
+}
+
+static void print_help(void)
+{
+	printf("Usage: tdk-chx01-benchmark [options]\n");
+	printf("-h: print this help\n");
+	printf("-n list: sensor counts, e.g. 1-6 or 1,3,6. Default: 1-6\n");
+	printf("-s list: sample counts, 1 to %d. Default: 40,80,160,320,450\n",
+		MAX_NUM_SAMPLES);
+	printf("-i x: timed frames per point. Default: 200\n");
+	printf("-o file: write the JSON results to this file. Default: stdout\n");
+	printf("-L dir: write the CSV and binary logs in this directory. Default: discarded\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int sensors[BENCH_MAX_POINTS] = {1, 2, 3, 4, 5, 6};
+	int samples[BENCH_MAX_POINTS] = {40, 80, 160, 320, 450};
+	int num_sensors = 6, num_samples = 5, count = 200;
+	const char *log_dir = NULL, *out_path = NULL;
+	struct utsname uts;
+	FILE *out = stdout;
+	int opt, i, j, ret = 0;
+
+	while ((opt = getopt(argc, argv, "hn:s:i:o:L:")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_sensors = parse_list(optarg, sensors, 1,
+				MAX_NUM_SENSORS);
+			if (num_sensors == 0) {
+				print_help();
+				return 1;
+			}
+			break;
+		case 's':
+			num_samples = parse_list(optarg, samples, 1,
+				MAX_NUM_SAMPLES);
+			if (num_samples == 0) {
+				print_help();
+				return 1;
+			}
+			break;
+		case 'i':
+			count = atoi(optarg);
+			if (count < 1) {
+				print_help();
+				return 1;
+			}
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'L':
+			log_dir = optarg;
+			break;
+		case 'h':
+		default:
+			print_help();
+			return 0;
+		}
+	}
+
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			printf("cannot create %s: %s\n", out_path,
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	if (uname(&uts))
+		strcpy(uts.machine, "unknown");
+	fprintf(out, "{\n");
+	fprintf(out, "  \"arch\": \"%s\",\n", uts.machine);
+	fprintf(out, "  \"iq_split\": \"%s\",\n", chx01_iq_split_impl());
+#ifdef CHX01_BENCH_ALGOS
+	fprintf(out, "  \"algorithms\": true,\n");
+#else
+	fprintf(out, "  \"algorithms\": false,\n");
+#endif
+	fprintf(out, "  \"frames\": %d,\n", count);
+	fprintf(out, "  \"log_dir\": \"%s\",\n", log_dir ? log_dir : "/dev/null");
+	fprintf(out, "  \"results\": [\n");
+	for (i = 0; ret == 0 && i < num_sensors; i++) {
+		for (j = 0; ret == 0 && j < num_samples; j++) {
+			ret = bench_point(out, sensors[i], samples[j], count,
+				log_dir, i == 0 && j == 0);
+			if (ret)
+				fprintf(stderr, "%d sensors, %d samples: %s\n",
+					sensors[i], samples[j], strerror(-ret));
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	if (out != stdout && fclose(out)) {
+		printf("error writing %s\n", out_path);
+		return 1;
+	}
+
+	return ret != 0;
+}
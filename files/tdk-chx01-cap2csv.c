@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Converts a binary capture (-c) or a raw IIO capture (-w) to the CSV log the
+ * application writes with -l, byte for byte.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-replay.h"
+
+static struct chx01_frame frame;
+
+int main(int argc, char *argv[])
+{
+	struct replay_source src;
+	struct chx01_log_info *info = &src.info;
+	struct chx01_csv csv;
+	FILE *out;
+	int ret, i;
+
+	if (argc != 3) {
+		printf("Usage: %s capture.bin log.csv\n", argv[0]);
+		return 1;
+	}
+
+	ret = replay_open(&src, argv[1], 0);
+	if (ret == 0 && src.kind == REPLAY_CSV) {
+		replay_close(&src);
+		ret = -EINVAL;
+	}
+	if (ret) {
+		printf("cannot read capture %s: %s\n", argv[1], strerror(-ret));
+		return 1;
+	}
+
+	out = fopen(argv[2], "wt");
+	if (out == NULL) {
+		printf("error opening log file %s\n", argv[2]);
+		replay_close(&src);
+		return 1;
+	}
+
+	printf("%s, %d sensors, %d samples, %d Hz\n", replay_kind_name(&src),
+		info->num_sensors, info->num_samples, info->frequency);
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		if (info->sensor_connected[i])
+			printf("  port %d: %u Hz, firmware %s\n",
+				info->port_map[i], info->op_freq[i],
+				info->firmware[i][0] ?
+					info->firmware[i] : "not loaded");
+	}
+
+	ret = chx01_csv_init(&csv, info);
+	if (ret) {
+		printf("%s\n", strerror(-ret));
+		replay_close(&src);
+		fclose(out);
+		return 1;
+	}
+	chx01_csv_header(&csv, out);
+	while ((ret = replay_next(&src, &frame)) > 0)
+		chx01_csv_frame(&csv, out, &frame);
+	chx01_csv_destroy(&csv);
+
+	if (ret < 0)
+		printf("capture %s: %s after %u frames\n", argv[1],
+			strerror(-ret), src.frames);
+	else
+		printf("%u frames\n", src.frames);
+
+	replay_close(&src);
+	if (fclose(out)) {
+		printf("error writing %s\n", argv[2]);
+		return 1;
+	}
+
+	return ret < 0;
+}
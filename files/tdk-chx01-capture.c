@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdk-chx01-capture.h"
+
+#define CAPTURE_PORT_OFFSET	24
+#define CAPTURE_PORT_SIZE	(8 + CHX01_FW_NAME_LEN)
+#define CAPTURE_SCAN_ORDER_OFFSET \
+	(CAPTURE_PORT_OFFSET + MAX_NUM_SENSORS * CAPTURE_PORT_SIZE)
+
+static void put_le16(unsigned char *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static void put_le64(unsigned char *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+static uint16_t get_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static uint64_t get_le64(const unsigned char *p)
+{
+	return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static size_t status_size(int num_sensors)
+{
+	return (8 + 5 * num_sensors + 7) & ~(size_t)7;
+}
+
+size_t capture_record_size(const struct chx01_log_info *info)
+{
+	return status_size(info->num_sensors) +
+		(size_t)info->num_sensors * info->num_samples * 4;
+}
+
+void capture_encode_header(unsigned char *h, const char *magic,
+	const struct chx01_log_info *info, size_t record_size)
+{
+	unsigned char *port;
+	int i;
+
+	memset(h, 0, CAPTURE_HEADER_SIZE);
+	memcpy(h, magic, 8);
+	put_le16(h + 8, CAPTURE_VERSION);
+	put_le16(h + 10, CAPTURE_HEADER_SIZE);
+	put_le32(h + 12, record_size);
+	put_le16(h + 16, info->num_sensors);
+	put_le16(h + 18, info->num_samples);
+	put_le32(h + 20, info->frequency);
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		port = h + CAPTURE_PORT_OFFSET + i * CAPTURE_PORT_SIZE;
+		port[0] = info->sensor_connected[i];
+		port[1] = info->port_map[i];
+		put_le32(port + 4, info->op_freq[i]);
+		strncpy((char *)port + 8, info->firmware[i],
+			CHX01_FW_NAME_LEN - 1);
+		h[CAPTURE_SCAN_ORDER_OFFSET + i] = info->sensor_connection[i];
+	}
+}
+
+int capture_decode_header(const unsigned char *h, const char *magic,
+	struct chx01_log_info *info, size_t *record_size)
+{
+	const unsigned char *port;
+	int i;
+
+	if (memcmp(h, magic, 8) || get_le16(h + 8) != CAPTURE_VERSION ||
+	    get_le16(h + 10) != CAPTURE_HEADER_SIZE)
+		return -EINVAL;
+
+	memset(info, 0, sizeof(*info));
+	*record_size = get_le32(h + 12);
+	info->num_sensors = get_le16(h + 16);
+	info->num_samples = get_le16(h + 18);
+	info->frequency = get_le32(h + 20);
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		port = h + CAPTURE_PORT_OFFSET + i * CAPTURE_PORT_SIZE;
+		info->sensor_connected[i] = port[0];
+		info->port_map[i] = port[1];
+		info->op_freq[i] = get_le32(port + 4);
+		memcpy(info->firmware[i], port + 8, CHX01_FW_NAME_LEN - 1);
+		info->sensor_connection[i] = h[CAPTURE_SCAN_ORDER_OFFSET + i];
+	}
+
+	if (info->num_sensors > MAX_NUM_SENSORS ||
+	    info->num_samples > MAX_NUM_SAMPLES)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int capture_alloc(struct capture_file *cap, const char *path,
+	const char *mode)
+{
+	cap->fp = fopen(path, mode);
+	if (cap->fp == NULL)
+		return -errno;
+
+	cap->stdio_buf = malloc(CAPTURE_BUFFER_SIZE);
+	if (cap->stdio_buf)
+		setvbuf(cap->fp, cap->stdio_buf, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+	return 0;
+}
+
+static int capture_start(struct capture_file *cap,
+	const struct chx01_log_info *info)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	int ret;
+
+	cap->writing = 1;
+	cap->info = *info;
+	cap->record_size = capture_record_size(info);
+	cap->record = calloc(1, cap->record_size);
+	if (cap->record == NULL) {
+		capture_close(cap);
+		return -ENOMEM;
+	}
+
+	capture_encode_header(header, CAPTURE_MAGIC, info, cap->record_size);
+	if (fwrite(header, sizeof(header), 1, cap->fp) != 1) {
+		ret = -errno;
+		capture_close(cap);
+		return ret;
+	}
+
+	return 0;
+}
+
+int capture_create(struct capture_file *cap, const char *path,
+	const struct chx01_log_info *info)
+{
+	int ret;
+
+	memset(cap, 0, sizeof(*cap));
+	ret = capture_alloc(cap, path, "wb");
+	if (ret) {
+		capture_close(cap);
+		return ret;
+	}
+
+	return capture_start(cap, info);
+}
+
+int capture_create_stream(struct capture_file *cap, FILE *fp,
+	const struct chx01_log_info *info)
+{
+	memset(cap, 0, sizeof(*cap));
+	cap->fp = fp;
+
+	return capture_start(cap, info);
+}
+
+int capture_write_frame(struct capture_file *cap,
+	const struct chx01_frame *frame)
+{
+	const struct chx01_log_info *info = &cap->info;
+	int n = info->num_sensors, samples = info->num_samples;
+	unsigned char *p = cap->record;
+	size_t iq_bytes = (size_t)samples * 4;
+	int i, j;
+
+	put_le64(p, frame->timestamp);
+	for (j = 0; j < n; j++) {
+		put_le16(p + 8 + 2*j, frame->distance[j]);
+		put_le16(p + 8 + 2*(n + j), frame->amplitude[j]);
+		p[8 + 4*n + j] = frame->mode[j];
+	}
+
+	p += status_size(n);
+	for (j = 0; j < n; j++, p += iq_bytes) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		(void)i;
+		memcpy(p, frame->iq[j], iq_bytes);
+#else
+		for (i = 0; i < 2 * samples; i++)
+			put_le16(p + 2*i, frame->iq[j][i]);
+#endif
+	}
+
+	if (fwrite(cap->record, cap->record_size, 1, cap->fp) != 1)
+		return -errno;
+	cap->frames++;
+
+	return 0;
+}
+
+int capture_open(struct capture_file *cap, const char *path)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	int ret;
+
+	memset(cap, 0, sizeof(*cap));
+	ret = capture_alloc(cap, path, "rb");
+	if (ret)
+		return ret;
+
+	if (fread(header, sizeof(header), 1, cap->fp) != 1 ||
+	    capture_decode_header(header, CAPTURE_MAGIC, &cap->info,
+			&cap->record_size) ||
+	    cap->record_size != capture_record_size(&cap->info)) {
+		capture_close(cap);
+		return -EINVAL;
+	}
+
+	cap->record = malloc(cap->record_size);
+	if (cap->record == NULL) {
+		capture_close(cap);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int capture_read_frame(struct capture_file *cap, struct chx01_frame *frame)
+{
+	const struct chx01_log_info *info = &cap->info;
+	int n = info->num_sensors, samples = info->num_samples;
+	const unsigned char *p = cap->record;
+	size_t iq_bytes = (size_t)samples * 4;
+	int i, j;
+
+	if (fread(cap->record, cap->record_size, 1, cap->fp) != 1)
+		return ferror(cap->fp) ? -EIO : 0;
+
+	frame->timestamp = (long long)get_le64(p);
+	frame->index = samples;
+	for (j = 0; j < n; j++) {
+		frame->distance[j] = get_le16(p + 8 + 2*j);
+		frame->amplitude[j] = get_le16(p + 8 + 2*(n + j));
+		frame->mode[j] = p[8 + 4*n + j];
+	}
+
+	p += status_size(n);
+	for (j = 0; j < n; j++, p += iq_bytes) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		(void)i;
+		memcpy(frame->iq[j], p, iq_bytes);
+#else
+		for (i = 0; i < 2 * samples; i++)
+			frame->iq[j][i] = (int16_t)get_le16(p + 2*i);
+#endif
+	}
+	cap->frames++;
+
+	return 1;
+}
+
+int capture_close(struct capture_file *cap)
+{
+	int ret = 0;
+
+	if (cap->fp) {
+		if (cap->writing && fflush(cap->fp))
+			ret = -errno;
+		if (fclose(cap->fp) && ret == 0)
+			ret = -errno;
+	}
+	free(cap->stdio_buf);
+	free(cap->record);
+	cap->fp = NULL;
+	cap->stdio_buf = NULL;
+	cap->record = NULL;
+
+	return ret;
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_CAPTURE_H_
+#define _TDK_CHX01_CAPTURE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "tdk-chx01-frame.h"
+#include "tdk-chx01-csv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary capture file, all fields little-endian:
+ *
+ * header, CAPTURE_HEADER_SIZE bytes, zero padded:
+ *   0  char[8]  magic "CHX01CAP"
+ *   8  u16      version
+ *  10  u16      header size
+ *  12  u32      record size
+ *  16  u16      num_sensors
+ *  18  u16      num_samples
+ *  20  u32      frequency
+ *  24  6 x port: u8 connected, i8 port_map, u16 reserved, u32 op_freq,
+ *                char firmware[32]
+ * 264  u8[6]    sensor_connection, port of each sensor in scan order
+ *
+ * then one fixed-size record per frame:
+ *   i64 timestamp in ns
+ *   u16 distance[num_sensors], u16 amplitude[num_sensors], u8 mode[num_sensors]
+ *   zero padding to a multiple of 8 bytes
+ *   i16 iq[num_sensors][2 * num_samples], I and Q interleaved
+ */
+#define CAPTURE_MAGIC		"CHX01CAP"
+#define CAPTURE_VERSION		1
+#define CAPTURE_HEADER_SIZE	512
+#define CAPTURE_BUFFER_SIZE	(1 << 20)
+
+/*! \struct capture_file
+ * An open capture, either being written or being read.
+ */
+struct capture_file {
+	FILE *fp;
+	int writing;
+	struct chx01_log_info info;
+	size_t record_size;
+	unsigned char *record;		/* one encoded record */
+	char *stdio_buf;		/* CAPTURE_BUFFER_SIZE stdio buffer */
+	unsigned int frames;
+};
+
+/* size of one frame record for @info */
+size_t capture_record_size(const struct chx01_log_info *info);
+
+/**
+ * capture_create() - create a capture file and write its header
+ * @cap: capture
+ * @path: file name
+ * @info: sensor setup stored in the header
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int capture_create(struct capture_file *cap, const char *path,
+	const struct chx01_log_info *info);
+
+/**
+ * capture_create_stream() - write a capture to an already open stream
+ * @cap: capture
+ * @fp: stream, closed by capture_close() including on failure
+ * @info: sensor setup stored in the header
+ *
+ * The stream is used as is, e.g. unbuffered in front of the async logger.
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int capture_create_stream(struct capture_file *cap, FILE *fp,
+	const struct chx01_log_info *info);
+
+/**
+ * capture_write_frame() - append one frame record
+ * @cap: capture opened with capture_create()
+ * @frame: complete frame
+ *
+ * Records go through a CAPTURE_BUFFER_SIZE buffer, so the file sees large
+ * writes only.
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int capture_write_frame(struct capture_file *cap,
+	const struct chx01_frame *frame);
+
+/**
+ * capture_open() - open a capture file and parse its header
+ * @cap: capture
+ * @path: file name
+ *
+ * Return: 0 on success, -EINVAL if the file is not a capture, -errno on
+ * other failures.
+ **/
+int capture_open(struct capture_file *cap, const char *path);
+
+/**
+ * capture_read_frame() - read the next frame record
+ * @cap: capture opened with capture_open()
+ * @frame: destination, filled with num_samples samples per sensor
+ *
+ * Return: 1 if a frame was read, 0 at the end of the file, -errno on error.
+ **/
+int capture_read_frame(struct capture_file *cap, struct chx01_frame *frame);
+
+/**
+ * capture_encode_header() - header shared by the capture formats
+ * @h: CAPTURE_HEADER_SIZE bytes
+ * @magic: 8-byte file type
+ * @info: sensor setup
+ * @record_size: size of a frame record, or of a scan for raw captures
+ **/
+void capture_encode_header(unsigned char *h, const char *magic,
+	const struct chx01_log_info *info, size_t record_size);
+
+/* parse a header written by capture_encode_header(), Return: 0 or -EINVAL */
+int capture_decode_header(const unsigned char *h, const char *magic,
+	struct chx01_log_info *info, size_t *record_size);
+
+/* flush and close, Return: 0 on success, -errno if a write failed */
+int capture_close(struct capture_file *cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tdk-chx01-control.h"
+
+/* queue one request for control_serve() and wait for its reply */
+static void submit(struct control_server *ctl, const char *request,
+	char *reply)
+{
+	size_t len = strlen(request);
+
+	if (len >= sizeof(ctl->request)) {
+		strcpy(reply, "error line too long");
+		return;
+	}
+
+	pthread_mutex_lock(&ctl->lock);
+	if (ctl->closing) {
+		pthread_mutex_unlock(&ctl->lock);
+		strcpy(reply, "error shutting down");
+		return;
+	}
+	memcpy(ctl->request, request, len + 1);
+	ctl->pending = 1;
+	pthread_mutex_unlock(&ctl->lock);
+
+	ctl->wake(ctl->ctx);
+
+	pthread_mutex_lock(&ctl->lock);
+	while (ctl->pending && !ctl->closing)
+		pthread_cond_wait(&ctl->served, &ctl->lock);
+	if (ctl->pending)
+		strcpy(reply, "error shutting down");
+	else
+		strcpy(reply, ctl->reply);
+	ctl->pending = 0;
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+static int send_line(int fd, const char *line)
+{
+	size_t len = strlen(line);
+	ssize_t n;
+
+	while (len > 0) {
+		/* a client gone away must not raise SIGPIPE */
+		n = send(fd, line, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		line += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void serve_client(struct control_server *ctl, int fd)
+{
+	/* a request line and its newline, like ctl->request */
+	char buf[CONTROL_LINE_MAX + 1], reply[CONTROL_LINE_MAX + 1];
+	size_t used = 0;
+	char *start, *nl;
+	int too_long = 0;	/* dropping the rest of a long line */
+	ssize_t n;
+
+	for (;;) {
+		n = read(fd, buf + used, sizeof(buf) - 1 - used);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		used += n;
+		buf[used] = '\0';
+
+		start = buf;
+		while ((nl = strchr(start, '\n')) != NULL) {
+			*nl = '\0';
+			if (nl > start && nl[-1] == '\r')
+				nl[-1] = '\0';
+			if (too_long)
+				strcpy(reply, "error line too long");
+			else
+				submit(ctl, start, reply);
+			too_long = 0;
+			strcat(reply, "\n");
+			if (send_line(fd, reply))
+				return;
+			start = nl + 1;
+		}
+		used -= start - buf;
+		memmove(buf, start, used);
+		if (used == sizeof(buf) - 1) {
+			too_long = 1;
+			used = 0;
+		}
+	}
+}
+
+static void *control_thread(void *arg)
+{
+	struct control_server *ctl = arg;
+	int fd;
+
+	for (;;) {
+		fd = accept(ctl->fd, NULL, NULL);
+		if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+			continue;
+		if (fd < 0)
+			break;
+
+		pthread_mutex_lock(&ctl->lock);
+		if (ctl->closing) {
+			pthread_mutex_unlock(&ctl->lock);
+			close(fd);
+			break;
+		}
+		ctl->client = fd;
+		pthread_mutex_unlock(&ctl->lock);
+
+		serve_client(ctl, fd);
+
+		pthread_mutex_lock(&ctl->lock);
+		ctl->client = -1;
+		pthread_mutex_unlock(&ctl->lock);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+int control_start(struct control_server *ctl, const char *path,
+	control_handler handler, void (*wake)(void *ctx), void *ctx)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	memset(ctl, 0, sizeof(*ctl));
+	snprintf(ctl->path, sizeof(ctl->path), "%s", path);
+	strcpy(addr.sun_path, path);
+	ctl->client = -1;
+	ctl->handler = handler;
+	ctl->wake = wake;
+	ctl->ctx = ctx;
+	pthread_mutex_init(&ctl->lock, NULL);
+	pthread_cond_init(&ctl->served, NULL);
+
+	ctl->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (ctl->fd < 0)
+		return -errno;
+	unlink(path);
+	if (bind(ctl->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(ctl->fd, 4)) {
+		ret = -errno;
+		close(ctl->fd);
+		return ret;
+	}
+	ret = -pthread_create(&ctl->thread, NULL, control_thread, ctl);
+	if (ret) {
+		close(ctl->fd);
+		unlink(path);
+	}
+
+	return ret;
+}
+
+void control_serve(struct control_server *ctl)
+{
+	char request[CONTROL_LINE_MAX], reply[CONTROL_LINE_MAX];
+
+	pthread_mutex_lock(&ctl->lock);
+	if (!ctl->pending) {
+		pthread_mutex_unlock(&ctl->lock);
+		return;
+	}
+	memcpy(request, ctl->request, sizeof(request));
+	pthread_mutex_unlock(&ctl->lock);
+
+	/* unlocked, a request may take long, e.g. a reconfigure */
+	reply[0] = '\0';
+	ctl->handler(ctl->ctx, request, reply, sizeof(reply));
+
+	pthread_mutex_lock(&ctl->lock);
+	memcpy(ctl->reply, reply, sizeof(ctl->reply));
+	ctl->pending = 0;
+	pthread_cond_broadcast(&ctl->served);
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+void control_stop(struct control_server *ctl)
+{
+	pthread_mutex_lock(&ctl->lock);
+	ctl->closing = 1;
+	pthread_cond_broadcast(&ctl->served);
+	if (ctl->client >= 0)
+		shutdown(ctl->client, SHUT_RDWR);
+	pthread_mutex_unlock(&ctl->lock);
+
+	/* wakes accept() */
+	shutdown(ctl->fd, SHUT_RDWR);
+	pthread_join(ctl->thread, NULL);
+	close(ctl->fd);
+	unlink(ctl->path);
+	pthread_cond_destroy(&ctl->served);
+	pthread_mutex_destroy(&ctl->lock);
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_CONTROL_H_
+#define _TDK_CHX01_CONTROL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTROL_LINE_MAX	256
+#define CONTROL_PATH_MAX	108	/* sun_path */
+
+/* run one request line, write a one-line reply without the newline */
+typedef void (*control_handler)(void *ctx, char *request, char *reply,
+	size_t len);
+
+/*! \struct control_server
+ * Line-based control socket. A thread accepts the clients, one at a time,
+ * and hands each request line to the thread calling control_serve(), so
+ * requests run between frames, never concurrently with frame processing.
+ */
+struct control_server {
+	char path[CONTROL_PATH_MAX];
+	int fd;			/* listening socket */
+	int client;		/* connection being served, -1 if none */
+	pthread_t thread;
+	control_handler handler;
+	void (*wake)(void *ctx);	/* makes the serving thread call control_serve() */
+	void *ctx;
+	pthread_mutex_t lock;
+	pthread_cond_t served;
+	char request[CONTROL_LINE_MAX];
+	char reply[CONTROL_LINE_MAX];
+	int pending;		/* request waiting for control_serve() */
+	int closing;
+};
+
+/**
+ * control_start() - listen on a Unix domain socket
+ * @ctl: server
+ * @path: socket path, a stale socket there is replaced
+ * @handler: runs the requests, from control_serve()
+ * @wake: called after a request is queued
+ * @ctx: passed to @handler and @wake
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int control_start(struct control_server *ctl, const char *path,
+	control_handler handler, void (*wake)(void *ctx), void *ctx);
+
+/* run the queued request, if any, in the calling thread */
+void control_serve(struct control_server *ctl);
+
+/* close the socket, pending and later requests are refused */
+void control_stop(struct control_server *ctl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
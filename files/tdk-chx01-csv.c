@@ -0,0 +1,537 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdk-chx01-csv.h"
+
+#define CSV_MAX_IDS		(MAX_NUM_SENSORS + 1)	/* Tx IDs and the Rx ID */
+/* mode of a line without Tx or Rx ID, the writer only knows 0x10 and 0x20 */
+#define CSV_OTHER_MODE		0x30
+
+static void csv_column_titles(FILE *fp, int sample, float sample_to_mm)
+{
+	float pos;
+	int i;
+
+	fprintf(fp,
+"# time [s],tx_id,rx_id, range [cm],intensity [a.u.], target_detected, ");
+	pos = 0;
+	for (i = 0; i < sample; i++) {
+		pos += sample_to_mm;
+		fprintf(fp, "i_data_%3.1f, ", pos/1000.0);
+	}
+	pos = 0;
+	for (i = 0; i < sample; i++) {
+		pos += sample_to_mm;
+		fprintf(fp, "q_data_%3.1f, ", pos/1000.0);
+	}
+	fprintf(fp, "\n");
+}
+
+void chx01_csv_header_ref(FILE *fp, const struct chx01_log_info *info)
+{
+	const int *sensor_connected = info->sensor_connected;
+	const uint32_t *op_freq = info->op_freq;
+	int sample = info->num_samples;
+	float sample_to_mm[MAX_NUM_SENSORS] = {0};
+	int i, j;
+
+	for (i = 0; i < 6; i++) {
+		if (op_freq[i]) {
+			sample_to_mm[i] =
+				(sample*CH_SPEEDOFSOUND_MPS * 8 * 1000)
+				/ (op_freq[i] * 2);
+		}
+	}
+
+	fprintf(fp, "# Chirp Microsystems redswallow Data Log\n");
+
+	fprintf(fp, "# sample rate:, %d S/s\n", info->frequency*sample);
+	fprintf(fp, "# Decimation factor:, 1\n");
+	fprintf(fp, "# Content: iq\n");
+	fprintf(fp, "# Sensors ID:, ");
+	for (i = 3; i < 6; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", i-2);
+	}
+	for (i = 0; i < 3; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", i+4);
+	}
+
+	fprintf(fp, "\n# Sensors FOP:, ");
+	for (i = 3; i < 6; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", op_freq[i]);
+	}
+	for (i = 0; i < 3; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", op_freq[i]);
+	}
+
+	fprintf(fp, "Hz\n");
+
+	fprintf(fp, "# Sensors NB Samples:,");
+	for (i = 3; i < 6; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", sample*2);
+	}
+	for (i = 0; i < 3; i++) {
+		if (sensor_connected[i])
+			fprintf(fp, "%d, ", sample);
+	}
+
+	fprintf(fp, "\n# Sensors NB First samples skipped:, ");
+
+	for (j = 0; j < 6; j++) {
+		if (sensor_connected[j])
+			fprintf(fp, "0, ");
+	}
+	fprintf(fp, "\n");
+
+	for (j = 3; j < 6; j++) {
+		if (sensor_connected[j])
+			csv_column_titles(fp, sample, sample_to_mm[j]);
+	}
+	for (j = 0; j < 3; j++) {
+		if (sensor_connected[j])
+			csv_column_titles(fp, sample, sample_to_mm[j]);
+	}
+}
+
+void chx01_csv_frame_ref(FILE *fp, const struct chx01_log_info *info,
+	const struct chx01_frame *frame)
+{
+	const char *sensor_connection = info->sensor_connection;
+	const int8_t *port_map = info->port_map;
+	const char *mode = frame->mode;
+	const unsigned short *distance = frame->distance;
+	const unsigned short *amplitude = frame->amplitude;
+	int num_sensors = info->num_sensors;
+	int sample = info->num_samples;
+	int16_t I[MAX_NUM_SAMPLES], Q[MAX_NUM_SAMPLES];
+	int dev_num, i, j;
+
+	for (dev_num = 0; dev_num < num_sensors; dev_num++) {
+		if (mode[dev_num] == 0) {
+			printf("mode 0 here\n");
+			break;
+		}
+		fprintf(fp, "%f, ", frame->timestamp/1000000000.0);
+
+		//TX_RX mode
+		if (mode[dev_num] == CHX01_TX_RX_MODE) {
+			fprintf(fp, "%d, ",
+				port_map[(int)sensor_connection[dev_num]]);
+			fprintf(fp, "%d, ",
+				port_map[(int)sensor_connection[dev_num]]);
+		}
+
+		//RX only mode.
+		if (mode[dev_num] == CHX01_RX_ONLY_MODE) {
+			for (j = 0; j < num_sensors; j++) {
+				if ((mode[j] == CHX01_TX_RX_MODE) &&
+				(sensor_connection[j] < 2)) {
+					fprintf(fp, "%d, ",
+					port_map[(int)sensor_connection[j]]);
+				}
+			}
+			fprintf(fp, "%d, ",
+				port_map[(int)sensor_connection[dev_num]]);
+		}
+
+		fprintf(fp, "%d, ", distance[dev_num]/10);
+		fprintf(fp, "%d, ", amplitude[dev_num]);
+		if ((distance[dev_num] == 0xFFFF) ||
+			(distance[dev_num] == 0)) {
+			fprintf(fp, "%d, ", 0);
+		} else {
+			fprintf(fp, "%d, ", 1);
+		}
+
+		if (sensor_connection[dev_num] < 3) {
+			chx01_iq_split(frame->iq[dev_num], I, Q, sample);
+			for (i = 0; i < sample; i++)
+				fprintf(fp, "%d, ", I[i]);
+			for (i = 0; i < sample; i++)
+				fprintf(fp, "%d, ", Q[i]);
+		}
+		fprintf(fp, "\n");
+	}
+}
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* "%d, " for values within int16_t or uint16_t range */
+static inline char *csv_put_int(char *p, int v)
+{
+	unsigned int u = v;
+	char *end, *q;
+
+	if (v < 0) {
+		*p++ = '-';
+		u = -(unsigned int)v;
+	}
+	end = p + 1 + (u >= 10) + (u >= 100) + (u >= 1000) + (u >= 10000);
+
+	q = end;
+	while (u >= 100) {
+		q -= 2;
+		memcpy(q, digit_pairs + 2 * (u % 100), 2);
+		u /= 100;
+	}
+	if (u >= 10)
+		memcpy(q - 2, digit_pairs + 2 * u, 2);
+	else
+		q[-1] = '0' + u;
+
+	end[0] = ',';
+	end[1] = ' ';
+
+	return end + 2;
+}
+
+int chx01_csv_init(struct chx01_csv *csv, const struct chx01_log_info *info)
+{
+	FILE *mem;
+
+	memset(csv, 0, sizeof(*csv));
+	csv->info = *info;
+
+	/* formatted once per setup, the float column titles are the costly
+	 * part and only change with the FOPs and the sample count */
+	mem = open_memstream(&csv->header, &csv->header_len);
+	if (mem == NULL)
+		return -ENOMEM;
+	chx01_csv_header_ref(mem, info);
+	if (fclose(mem)) {
+		chx01_csv_destroy(csv);
+		return -ENOMEM;
+	}
+
+	csv->line = malloc(CHX01_CSV_FRAME_MAX);
+	if (csv->line == NULL) {
+		chx01_csv_destroy(csv);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void chx01_csv_destroy(struct chx01_csv *csv)
+{
+	free(csv->header);
+	free(csv->line);
+	csv->header = NULL;
+	csv->line = NULL;
+}
+
+int chx01_csv_header(struct chx01_csv *csv, FILE *fp)
+{
+	if (fwrite(csv->header, 1, csv->header_len, fp) != csv->header_len)
+		return -EIO;
+
+	return 0;
+}
+
+size_t chx01_csv_format(struct chx01_csv *csv, const struct chx01_frame *frame)
+{
+	const struct chx01_log_info *info = &csv->info;
+	const char *sensor_connection = info->sensor_connection;
+	const int8_t *port_map = info->port_map;
+	const char *mode = frame->mode;
+	int num_sensors = info->num_sensors;
+	int sample = info->num_samples;
+	char time[32], *p = csv->line;
+	const int16_t *iq;
+	int time_len, dev_num, i, j;
+
+	/* same %f rounding as before, once per frame instead of per line */
+	time_len = snprintf(time, sizeof(time), "%f, ",
+		frame->timestamp/1000000000.0);
+
+	for (dev_num = 0; dev_num < num_sensors; dev_num++) {
+		if (mode[dev_num] == 0) {
+			printf("mode 0 here\n");
+			break;
+		}
+		memcpy(p, time, time_len);
+		p += time_len;
+
+		if (mode[dev_num] == CHX01_TX_RX_MODE) {
+			p = csv_put_int(p, port_map[(int)sensor_connection[dev_num]]);
+			p = csv_put_int(p, port_map[(int)sensor_connection[dev_num]]);
+		}
+
+		if (mode[dev_num] == CHX01_RX_ONLY_MODE) {
+			for (j = 0; j < num_sensors; j++) {
+				if (mode[j] == CHX01_TX_RX_MODE &&
+				    sensor_connection[j] < 2)
+					p = csv_put_int(p,
+						port_map[(int)sensor_connection[j]]);
+			}
+			p = csv_put_int(p, port_map[(int)sensor_connection[dev_num]]);
+		}
+
+		p = csv_put_int(p, frame->distance[dev_num] / 10);
+		p = csv_put_int(p, frame->amplitude[dev_num]);
+		p = csv_put_int(p, frame->distance[dev_num] != 0xFFFF &&
+			frame->distance[dev_num] != 0);
+
+		if (sensor_connection[dev_num] < 3) {
+			iq = frame->iq[dev_num];
+			for (i = 0; i < sample; i++)
+				p = csv_put_int(p, iq[2*i]);
+			for (i = 0; i < sample; i++)
+				p = csv_put_int(p, iq[2*i+1]);
+		}
+		*p++ = '\n';
+	}
+
+	return p - csv->line;
+}
+
+int chx01_csv_frame(struct chx01_csv *csv, FILE *fp,
+	const struct chx01_frame *frame)
+{
+	size_t len = chx01_csv_format(csv, frame);
+
+	if (len && fwrite(csv->line, 1, len, fp) != len)
+		return -EIO;
+
+	return 0;
+}
+
+/* values of a "# label:, a, b, ..." header line, Return: number parsed */
+static int csv_header_values(const char *line, const char *label, long *v,
+	int max)
+{
+	const char *p;
+	char *end;
+	int n = 0;
+
+	if (strncmp(line, label, strlen(label)))
+		return -1;
+	p = line + strlen(label);
+	while (n < max) {
+		while (*p == ',' || *p == ' ')
+			p++;
+		v[n] = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		n++;
+		p = end;
+	}
+
+	return n;
+}
+
+static int csv_port_of_id(long id)
+{
+	int i;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		if (chx01_port_map[i] == id)
+			return i;
+	}
+
+	return -1;
+}
+
+static int csv_parse_header(struct chx01_csv_reader *csv)
+{
+	struct chx01_log_info *info = &csv->info;
+	long ids[MAX_NUM_SENSORS], fops[MAX_NUM_SENSORS];
+	long samples[MAX_NUM_SENSORS], rate = 0;
+	int nids = -1, nfops = -1, nsamples = -1;
+	int i, port;
+
+	memset(info, 0, sizeof(*info));
+	memcpy(info->port_map, chx01_port_map, sizeof(info->port_map));
+
+	while (getline(&csv->line, &csv->line_size, csv->fp) > 0) {
+		if (csv->line[0] != '#') {
+			csv->pending = 1;
+			break;
+		}
+		if (nids < 0)
+			nids = csv_header_values(csv->line, "# Sensors ID:",
+				ids, MAX_NUM_SENSORS);
+		if (nfops < 0)
+			nfops = csv_header_values(csv->line, "# Sensors FOP:",
+				fops, MAX_NUM_SENSORS);
+		if (nsamples < 0)
+			nsamples = csv_header_values(csv->line,
+				"# Sensors NB Samples:", samples,
+				MAX_NUM_SENSORS);
+		if (rate == 0)
+			csv_header_values(csv->line, "# sample rate:", &rate, 1);
+	}
+
+	if (nids <= 0 || nfops != nids || nsamples != nids)
+		return -EINVAL;
+
+	/* header order is ports 3-5 then 0-2, CH201 ports log twice the
+	 * sample count */
+	for (i = 0; i < nids; i++) {
+		port = csv_port_of_id(ids[i]);
+		if (port < 0)
+			return -EINVAL;
+		info->sensor_connected[port] = 1;
+		info->op_freq[port] = fops[i];
+		if (port < 3 || info->num_samples == 0)
+			info->num_samples = port < 3 ? samples[i] : samples[i] / 2;
+	}
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		if (info->sensor_connected[i])
+			info->sensor_connection[info->num_sensors++] = i;
+	}
+	if (info->num_samples <= 0 || info->num_samples > MAX_NUM_SAMPLES)
+		return -EINVAL;
+	info->frequency = rate / info->num_samples;
+
+	return 0;
+}
+
+int chx01_csv_open(struct chx01_csv_reader *csv, const char *path)
+{
+	int ret;
+
+	memset(csv, 0, sizeof(*csv));
+	csv->fp = fopen(path, "r");
+	if (csv->fp == NULL)
+		return -errno;
+
+	ret = csv_parse_header(csv);
+	if (ret)
+		chx01_csv_close(csv);
+
+	return ret;
+}
+
+/* one sensor line, the time field already parsed up to @p */
+static int csv_parse_line(struct chx01_csv_reader *csv, const char *p,
+	struct chx01_frame *frame, int dev_num)
+{
+	const struct chx01_log_info *info = &csv->info;
+	int sample = info->num_samples;
+	int iq_count = info->sensor_connection[dev_num] < 3 ? 2 * sample : 0;
+	long v[CSV_MAX_IDS + 3 + 2 * MAX_NUM_SAMPLES];
+	int n = 0, nids, i;
+	long cm, detected;
+	char *end;
+
+	for (;;) {
+		while (*p == ',' || *p == ' ')
+			p++;
+		if (n == (int)(sizeof(v) / sizeof(v[0])))
+			break;
+		v[n] = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		n++;
+		p = end;
+	}
+
+	nids = n - 3 - iq_count;
+	if (nids < 0 || nids > CSV_MAX_IDS)
+		return -EINVAL;
+
+	if (nids == 0)
+		frame->mode[dev_num] = CSV_OTHER_MODE;
+	else if (nids == 2 && v[0] == v[1])
+		frame->mode[dev_num] = CHX01_TX_RX_MODE;
+	else
+		frame->mode[dev_num] = CHX01_RX_ONLY_MODE;
+
+	cm = v[nids];
+	detected = v[nids + 2];
+	if (!detected)
+		frame->distance[dev_num] = cm == 0xFFFF / 10 ? 0xFFFF : 0;
+	else
+		frame->distance[dev_num] = cm * 10;
+	frame->amplitude[dev_num] = v[nids + 1];
+
+	for (i = 0; i < iq_count / 2; i++) {
+		frame->iq[dev_num][2*i] = v[nids + 3 + i];
+		frame->iq[dev_num][2*i+1] = v[nids + 3 + sample + i];
+	}
+
+	return 0;
+}
+
+int chx01_csv_read_frame(struct chx01_csv_reader *csv,
+	struct chx01_frame *frame)
+{
+	int num_sensors = csv->info.num_sensors;
+	long long timestamp;
+	int dev_num = 0, ret;
+	char *end;
+
+	memset(frame->mode, 0, sizeof(frame->mode));
+	memset(frame->iq, 0, sizeof(frame->iq));
+	frame->index = csv->info.num_samples;
+
+	while (dev_num < num_sensors) {
+		if (!csv->pending &&
+		    getline(&csv->line, &csv->line_size, csv->fp) <= 0)
+			break;
+		csv->pending = 0;
+
+		/* %f keeps microseconds, rounding gets the ns count back */
+		timestamp = strtod(csv->line, &end) * 1000000000.0 + 0.5;
+		if (end == csv->line)
+			continue;
+		/* a torn frame, the line belongs to the next one */
+		if (dev_num && timestamp != frame->timestamp) {
+			csv->pending = 1;
+			break;
+		}
+		frame->timestamp = timestamp;
+		ret = csv_parse_line(csv, end, frame, dev_num);
+		if (ret)
+			return ret;
+		dev_num++;
+	}
+	if (dev_num == 0)
+		return 0;
+	csv->frames++;
+
+	return 1;
+}
+
+void chx01_csv_close(struct chx01_csv_reader *csv)
+{
+	if (csv->fp)
+		fclose(csv->fp);
+	free(csv->line);
+	csv->fp = NULL;
+	csv->line = NULL;
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_CSV_H_
+#define _TDK_CHX01_CSV_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tdk-chx01-frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHX01_TX_RX_MODE	0x10
+#define CHX01_RX_ONLY_MODE	0x20
+
+#define CH_SPEEDOFSOUND_MPS	343
+
+/* range covered by one IQ sample: 8 periods of the FOP, there and back */
+static inline float chx01_sample_to_mm(uint32_t fop)
+{
+	return fop ? CH_SPEEDOFSOUND_MPS * 8 * 1000.0f / (fop * 2.0f) : 0;
+}
+
+/* longest CSV line of one sensor: time, up to 6 Tx IDs and the Rx ID,
+ * range, intensity, detection flag, then "-32768, " per I and Q value */
+#define CHX01_CSV_LINE_MAX	(128 + 2 * MAX_NUM_SAMPLES * 8)
+#define CHX01_CSV_FRAME_MAX	(MAX_NUM_SENSORS * CHX01_CSV_LINE_MAX)
+
+/*! \struct chx01_csv
+ * CSV emitter for one sensor setup. The header is formatted once, frames
+ * are formatted into a line buffer without stdio and written in one go.
+ */
+struct chx01_csv {
+	struct chx01_log_info info;
+	char *header;			/* complete header text */
+	size_t header_len;
+	char *line;			/* CHX01_CSV_FRAME_MAX bytes */
+};
+
+/**
+ * chx01_csv_init() - prepare the emitter for a sensor setup
+ * @csv: emitter
+ * @info: sensor setup, copied
+ *
+ * Call again whenever the setup changes, the column titles depend on the
+ * FOPs and the sample count.
+ *
+ * Return: 0 on success, -ENOMEM.
+ **/
+int chx01_csv_init(struct chx01_csv *csv, const struct chx01_log_info *info);
+
+void chx01_csv_destroy(struct chx01_csv *csv);
+
+/* CSV log header, Return: 0 on success, -EIO */
+int chx01_csv_header(struct chx01_csv *csv, FILE *fp);
+
+/**
+ * chx01_csv_format() - format the CSV lines of a frame
+ * @csv: emitter
+ * @frame: complete frame, after the algorithms updated distance and amplitude
+ *
+ * Return: length of the text left in csv->line.
+ **/
+size_t chx01_csv_format(struct chx01_csv *csv, const struct chx01_frame *frame);
+
+/**
+ * chx01_csv_frame() - one CSV line per sensor of a frame
+ * @csv: emitter
+ * @fp: CSV log
+ * @frame: complete frame, after the algorithms updated distance and amplitude
+ *
+ * Byte-identical to chx01_csv_frame_ref(), with a single fwrite() per frame.
+ *
+ * Return: 0 on success, -EIO.
+ **/
+int chx01_csv_frame(struct chx01_csv *csv, FILE *fp,
+	const struct chx01_frame *frame);
+
+/*! \struct chx01_csv_reader
+ * CSV log opened for reading frames back. CH201 lines carry no IQ, their
+ * frames get zero samples; ranges come back with the centimeter resolution
+ * of the log.
+ */
+struct chx01_csv_reader {
+	FILE *fp;
+	struct chx01_log_info info;
+	char *line;			/* current line, from getline() */
+	size_t line_size;
+	int pending;			/* line read ahead, not consumed yet */
+	unsigned int frames;
+};
+
+/**
+ * chx01_csv_open() - open a CSV log and parse its header
+ * @csv: reader
+ * @path: CSV log written by chx01_csv_header() and chx01_csv_frame()
+ *
+ * The port map is not part of the log, the default one is assumed.
+ *
+ * Return: 0 on success, -EINVAL if the header cannot be parsed, -errno on
+ * other failures.
+ **/
+int chx01_csv_open(struct chx01_csv_reader *csv, const char *path);
+
+/**
+ * chx01_csv_read_frame() - read the lines of the next frame
+ * @csv: reader
+ * @frame: destination, sensors missing from the log get mode 0
+ *
+ * Return: 1 if a frame was read, 0 at the end of the file, -EINVAL on a
+ * malformed line.
+ **/
+int chx01_csv_read_frame(struct chx01_csv_reader *csv,
+	struct chx01_frame *frame);
+
+void chx01_csv_close(struct chx01_csv_reader *csv);
+
+/* fprintf() versions, the reference for the emitter */
+void chx01_csv_header_ref(FILE *fp, const struct chx01_log_info *info);
+void chx01_csv_frame_ref(FILE *fp, const struct chx01_log_info *info,
+	const struct chx01_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
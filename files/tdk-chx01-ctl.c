@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sends one request to the application running as a daemon (-U) and prints
+ * the reply. Exits with 0 when the reply is "ok ...".
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tdk-chx01-control.h"
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	char line[CONTROL_LINE_MAX];
+	size_t len = 0;
+	ssize_t n;
+	int fd, i;
+
+	if (argc < 3) {
+		printf("Usage: %s socket request...\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 2; i < argc; i++) {
+		n = snprintf(line + len, sizeof(line) - len, "%s%s",
+			argv[i], i == argc - 1 ? "\n" : " ");
+		if (n < 0 || (size_t)n >= sizeof(line) - len) {
+			printf("request too long\n");
+			return 1;
+		}
+		len += n;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+		printf("socket path too long\n");
+		return 1;
+	}
+	strcpy(addr.sun_path, argv[1]);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("cannot connect to %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	if (write(fd, line, len) != (ssize_t)len) {
+		printf("cannot send request: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	/* one reply line */
+	len = 0;
+	while (len < sizeof(line) - 1) {
+		n = read(fd, line + len, sizeof(line) - 1 - len);
+		if (n <= 0)
+			break;
+		len += n;
+		if (memchr(line, '\n', len))
+			break;
+	}
+	close(fd);
+	line[len] = '\0';
+	if (len == 0) {
+		printf("no reply\n");
+		return 1;
+	}
+	printf("%s", line);
+	if (line[len - 1] != '\n')
+		printf("\n");
+
+	return strncmp(line, "ok", 2) ? 1 : 0;
+}
@@ -0,0 +1,516 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hardware-free stand-in for the ch101 IIO device. Builds a sysfs tree of
+ * regular files under a root directory and serves scans through a FIFO in
+ * place of /dev/iio:device0:
+ *
+ *   tdk-chx01-emu -r /tmp/chx01 &
+ *   tdk-chx01-get-data-app -r /tmp/chx01 -n
+ *
+ * The setup written by the application (scan elements, sample count,
+ * sampling frequency) is picked up when it enables the buffer, again after
+ * each disable and enable, like the driver. Each run ends when the reader
+ * goes away, then the tree is reset for the next one. With -R the driver is
+ * unbound after each run and bound again a second later, as the next
+ * iio:deviceN.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdk-chx01-frame.h"
+#include "tdk-chx01-sysfs.h"
+
+#define EMU_DEVICE		"iio:device"
+#define EMU_IIO_DIR		"/sys/bus/iio/devices/"
+#define EMU_PIPE_SIZE		(1 << 20)
+#define EMU_POLL_MS		1
+#define EMU_DIR_LEN		128	/* leaves room for attribute names */
+#define EMU_TX_RX_MODE		0x10
+
+static char *root = "/tmp/chx01-emu";
+static int emu_sensors = MAX_NUM_SENSORS;
+static int emu_samples;		/* 0: sample count written by the app */
+static int emu_rate = -1;	/* frames/s, 0: unthrottled, -1: from the app */
+static unsigned int emu_frames;	/* frames per run, 0: until the app stops */
+static int emu_once;
+static int emu_rebind;		/* unbind and bind the driver after each run */
+static int emu_index;		/* N of iio:deviceN */
+
+static char sysfs_dir[EMU_DIR_LEN];
+static char dev_dir[EMU_DIR_LEN];
+static char fifo_path[SYSFS_ATTR_PATH_LEN];
+
+static struct {
+	struct sysfs_attr proximity_en[MAX_NUM_SENSORS];
+	struct sysfs_attr position_raw[MAX_NUM_SENSORS];
+	struct sysfs_attr buffer_enable;
+	struct sysfs_attr sampling_frequency;
+} attrs;
+
+static int mkdir_p(const char *path)
+{
+	char buf[SYSFS_ATTR_PATH_LEN];
+	char *p;
+
+	snprintf(buf, sizeof(buf), "%s", path);
+	for (p = buf + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(buf, 0755) && errno != EEXIST)
+			return -errno;
+		*p = '/';
+	}
+	if (mkdir(buf, 0755) && errno != EEXIST)
+		return -errno;
+
+	return 0;
+}
+
+static int put_file(const char *dir, const char *name, const char *value)
+{
+	char path[SYSFS_ATTR_PATH_LEN];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	unlink(path);
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return -errno;
+	fprintf(fp, "%s\n", value);
+
+	return fclose(fp) ? -errno : 0;
+}
+
+/* absent sensors read as FOP 0 and swallow the sample count */
+static int put_absent(const char *dir, const char *name)
+{
+	char path[SYSFS_ATTR_PATH_LEN];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	unlink(path);
+
+	return symlink("/dev/null", path) ? -errno : 0;
+}
+
+/**
+ * build_tree() - create the emulated sysfs directory of the device
+ * @dir: device directory, <root>/sys/bus/iio/devices/iio:device0
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+static int build_tree(const char *dir)
+{
+	static const char * const files[] = {
+		"buffer/length", "buffer/watermark", "buffer/enable",
+		"calibbias", "sampling_frequency",
+		"misc_bin_dmp_firmware_vers", "misc_bin_dmp_firmware",
+		"scan_elements/in_timestamp_en",
+	};
+	char sub[SYSFS_ATTR_PATH_LEN], name[64];
+	int i, ret;
+
+	snprintf(sub, sizeof(sub), "%s/scan_elements", dir);
+	ret = mkdir_p(sub);
+	if (ret == 0) {
+		snprintf(sub, sizeof(sub), "%s/buffer", dir);
+		ret = mkdir_p(sub);
+	}
+	if (ret == 0)
+		ret = put_file(dir, "name", "ch101");
+	/* scans are stamped with the time they are due on this clock */
+	if (ret == 0)
+		ret = put_file(dir, "current_timestamp_clock", "monotonic");
+
+	for (i = 0; ret == 0 && i < (int)(sizeof(files) / sizeof(files[0])); i++)
+		ret = put_file(dir, files[i], "0");
+
+	for (i = 0; ret == 0 && i < MAX_NUM_SENSORS; i++) {
+		snprintf(name, sizeof(name),
+			"scan_elements/in_proximity%d_en", i);
+		ret = put_file(dir, name, "0");
+		snprintf(name, sizeof(name),
+			"scan_elements/in_distance%d_en", i + 6);
+		ret = ret ? ret : put_file(dir, name, "0");
+		snprintf(name, sizeof(name),
+			"scan_elements/in_intensity%d_en", i + 12);
+		ret = ret ? ret : put_file(dir, name, "0");
+		snprintf(name, sizeof(name),
+			"scan_elements/in_positionrelative%d_en", i + 18);
+		ret = ret ? ret : put_file(dir, name, "0");
+	}
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		sysfs_attr_init(&attrs.proximity_en[i], O_RDONLY,
+			"%s/scan_elements/in_proximity%d_en", dir, i);
+		sysfs_attr_init(&attrs.position_raw[i], O_RDWR,
+			"%s/in_positionrelative%d_raw", dir, i + 18);
+	}
+	sysfs_attr_init(&attrs.buffer_enable, O_RDWR, "%s/buffer/enable", dir);
+	sysfs_attr_init(&attrs.sampling_frequency, O_RDONLY,
+		"%s/sampling_frequency", dir);
+
+	return ret;
+}
+
+/* back to the state after firmware load: FOPs in place, buffer off */
+static int reset_tree(const char *dir)
+{
+	char name[64], fop[16];
+	int i, ret = 0;
+
+	for (i = 0; ret == 0 && i < MAX_NUM_SENSORS; i++) {
+		sysfs_attr_close(&attrs.position_raw[i]);
+		snprintf(name, sizeof(name), "in_positionrelative%d_raw", i + 18);
+		if (i >= emu_sensors) {
+			ret = put_absent(dir, name);
+			continue;
+		}
+		snprintf(fop, sizeof(fop), "%d",
+			i < CHX01_CH201_FIRST ? CH101_FOP : CH201_FOP);
+		ret = put_file(dir, name, fop);
+	}
+	if (ret == 0)
+		ret = sysfs_attr_write_int(&attrs.buffer_enable, 0);
+
+	return ret;
+}
+
+static int read_attr(struct sysfs_attr *attr)
+{
+	int value = 0;
+
+	sysfs_attr_read_int(attr, &value);
+
+	return value;
+}
+
+/* wait for the app to enable the buffer, 0 if the reader left first */
+static int wait_enable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = 0 };
+
+	for (;;) {
+		if (read_attr(&attrs.buffer_enable))
+			return 1;
+		if (poll(&pfd, 1, EMU_POLL_MS) > 0 &&
+		    (pfd.revents & (POLLERR | POLLHUP)))
+			return 0;
+	}
+}
+
+/* scan layout from the enabled scan elements, like the driver */
+static void read_layout(struct chx01_scan_layout *layout, int *rate)
+{
+	int i, samples = 0;
+
+	layout->num_sensors = 0;
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		if (!read_attr(&attrs.proximity_en[i]))
+			continue;
+		layout->num_sensors++;
+		if (samples == 0)
+			samples = read_attr(&attrs.position_raw[i]);
+	}
+	layout->scan_bytes = chx01_scan_bytes(layout->num_sensors);
+
+	if (emu_samples)
+		samples = emu_samples;
+	if (samples < 1)
+		samples = 1;
+	if (samples > MAX_NUM_SAMPLES)
+		samples = MAX_NUM_SAMPLES;
+	layout->num_samples = samples;
+
+	*rate = emu_rate >= 0 ? emu_rate : read_attr(&attrs.sampling_frequency);
+}
+
+static struct chx01_frame frame;
+
+/**
+ * fill_frame() - encode the scans of one measurement
+ * @layout: scan layout
+ * @buf: destination, chx01_scans_per_frame() scans
+ * @n: frame number, varies the IQ pattern
+ * @timestamp: IIO timestamp shared by the scans, in ns
+ **/
+static void fill_frame(const struct chx01_scan_layout *layout,
+	unsigned char *buf, unsigned int n, long long timestamp)
+{
+	int scans = chx01_scans_per_frame(layout);
+	int s, k, j;
+
+	for (j = 0; j < layout->num_sensors; j++) {
+		for (k = 0; k < layout->num_samples; k++) {
+			frame.iq[j][2*k] = (k * 37 + j * 11 + n) % 600 - 300;
+			frame.iq[j][2*k + 1] = (k * 13 - j * 7 + 1000) % 500 - 250;
+		}
+		frame.distance[j] = 1000 + 100 * j;
+		frame.amplitude[j] = 500 + j;
+		frame.mode[j] = EMU_TX_RX_MODE;
+	}
+	frame.timestamp = timestamp;
+
+	for (s = 0; s < scans; s++)
+		chx01_encode_scan(layout, &frame,
+			s, (char *)buf + (size_t)s * layout->scan_bytes);
+}
+
+static long long timespec_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/**
+ * serve_run() - stream frames until the reader stops or disables the buffer
+ * @fd: FIFO, opened for writing
+ *
+ * Return: frames written.
+ **/
+static unsigned int serve_run(int fd)
+{
+	struct chx01_scan_layout layout;
+	struct timespec next;
+	unsigned char *buf;
+	unsigned int n = 0;
+	long long period = 0;
+	size_t len;
+	int rate;
+
+	read_layout(&layout, &rate);
+	len = (size_t)chx01_scans_per_frame(&layout) * layout.scan_bytes;
+	buf = malloc(len);
+	if (buf == NULL)
+		return 0;
+	if (rate > 0)
+		period = 1000000000LL / rate;
+
+	printf("emu: %d sensors, %d samples, %d scans of %d bytes per frame, %d Hz\n",
+		layout.num_sensors, layout.num_samples,
+		chx01_scans_per_frame(&layout), layout.scan_bytes, rate);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (emu_frames == 0 || n < emu_frames) {
+		if (period)
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				NULL);
+		if (!read_attr(&attrs.buffer_enable))
+			break;
+
+		fill_frame(&layout, buf, n, timespec_ns(&next));
+		/* one write per frame, the pipe holds many frames so the
+		 * reader never sees a partial scan */
+		if (write(fd, buf, len) != (ssize_t)len)
+			break;
+		n++;
+
+		if (period) {
+			next.tv_nsec += period;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				next.tv_sec++;
+			}
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &next);
+		}
+	}
+
+	free(buf);
+
+	return n;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type,
+	struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/**
+ * add_device() - create iio:device<emu_index>
+ *
+ * The sysfs tree is complete before the device node appears, as with the
+ * driver, so a reader finding the node finds every attribute.
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+static int add_device(void)
+{
+	int ret;
+
+	if (snprintf(sysfs_dir, sizeof(sysfs_dir), "%s" EMU_IIO_DIR
+			EMU_DEVICE "%d", root, emu_index) >=
+			(int)sizeof(sysfs_dir))
+		return -ENAMETOOLONG;
+	snprintf(fifo_path, sizeof(fifo_path), "%s/" EMU_DEVICE "%d", dev_dir,
+		emu_index);
+
+	ret = build_tree(sysfs_dir);
+	if (ret == 0)
+		ret = reset_tree(sysfs_dir);
+	if (ret == 0) {
+		unlink(fifo_path);
+		if (mkfifo(fifo_path, 0644))
+			ret = -errno;
+	}
+
+	return ret;
+}
+
+/* driver unbind: the node goes, then the sysfs tree */
+static void remove_device(void)
+{
+	int i;
+
+	unlink(fifo_path);
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		sysfs_attr_close(&attrs.proximity_en[i]);
+		sysfs_attr_close(&attrs.position_raw[i]);
+	}
+	sysfs_attr_close(&attrs.buffer_enable);
+	sysfs_attr_close(&attrs.sampling_frequency);
+	nftw(sysfs_dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+}
+
+static void print_help(void)
+{
+	printf("Usage: tdk-chx01-emu [options]\n");
+	printf("-h: print this help\n");
+	printf("-r dir: root of the emulated sysfs and /dev tree. Default: %s\n",
+		root);
+	printf("-n x: connected sensors, 1 to 6. Default: 6\n");
+	printf("-s x: samples per frame. Default: the count set by the app\n");
+	printf("-f x: frames per second, 0 for as fast as read. Default: the app sampling frequency\n");
+	printf("-c x: frames per run. Default: until the app stops\n");
+	printf("-1: exit after one run\n");
+	printf("-R: unbind the driver after each run, it comes back a second later as the next iio:deviceN\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int frames;
+	int opt, fd, ret;
+
+	while ((opt = getopt(argc, argv, "hr:n:s:f:c:1R")) != -1) {
+		switch (opt) {
+		case 'r':
+			root = optarg;
+			break;
+		case 'n':
+			emu_sensors = atoi(optarg);
+			break;
+		case 's':
+			emu_samples = atoi(optarg);
+			break;
+		case 'f':
+			emu_rate = atoi(optarg);
+			break;
+		case 'c':
+			emu_frames = strtoul(optarg, NULL, 0);
+			break;
+		case '1':
+			emu_once = 1;
+			break;
+		case 'R':
+			emu_rebind = 1;
+			break;
+		case 'h':
+		default:
+			print_help();
+			return 0;
+		}
+	}
+	if (emu_sensors < 1 || emu_sensors > MAX_NUM_SENSORS) {
+		print_help();
+		return 1;
+	}
+
+	snprintf(dev_dir, sizeof(dev_dir), "%s/dev", root);
+	ret = mkdir_p(dev_dir);
+	if (ret == 0)
+		ret = add_device();
+	if (ret) {
+		printf("emu: cannot create the tree under %s: %s\n", root,
+			strerror(-ret));
+		return 1;
+	}
+
+	/* a reader going away must end the run, not the emulator */
+	signal(SIGPIPE, SIG_IGN);
+	printf("emu: %s, %d sensors, device %s\n", sysfs_dir, emu_sensors,
+		fifo_path);
+
+	for (;;) {
+		fd = open(fifo_path, O_WRONLY);
+		if (fd < 0) {
+			printf("emu: cannot open %s: %s\n", fifo_path,
+				strerror(errno));
+			return 1;
+		}
+		fcntl(fd, F_SETPIPE_SZ, EMU_PIPE_SIZE);
+
+		/* the buffer may be enabled again with another setup while
+		 * the reader keeps the device open */
+		frames = 0;
+		while (wait_enable(fd)) {
+			frames += serve_run(fd);
+			if (read_attr(&attrs.buffer_enable))
+				break;
+		}
+		close(fd);
+		printf("emu: run done, %u frames\n", frames);
+		if (emu_once)
+			break;
+
+		/* a new device comes reset already, the reader may be
+		 * setting it up by the time it is announced */
+		if (emu_rebind) {
+			remove_device();
+			printf("emu: driver unbound\n");
+			sleep(1);
+			emu_index++;
+			ret = add_device();
+			if (ret == 0)
+				printf("emu: driver bound, device %s\n",
+					fifo_path);
+		} else {
+			ret = reset_tree(sysfs_dir);
+		}
+		if (ret) {
+			printf("emu: cannot reset the tree: %s\n", strerror(-ret));
+			return 1;
+		}
+	}
+
+	unlink(fifo_path);
+
+	return 0;
+}
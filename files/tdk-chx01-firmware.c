@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tdk-chx01-firmware.h"
+
+#define FIRMWARE_HASH_PRIME	0x100000001b3ULL
+
+uint64_t firmware_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= FIRMWARE_HASH_PRIME;
+	}
+
+	return hash;
+}
+
+int firmware_hash_file(const char *path, uint64_t *hash)
+{
+	unsigned char buf[4096];
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	*hash = FIRMWARE_HASH_INIT;
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			n = -errno;
+			close(fd);
+			return n;
+		}
+		*hash = firmware_hash(*hash, buf, n);
+	}
+	close(fd);
+
+	return 0;
+}
+
+int firmware_image_open(struct firmware_image *img, const char *path)
+{
+	struct stat st;
+	void *data;
+	int ret, fd = open(path, O_RDONLY);
+
+	memset(img, 0, sizeof(*img));
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st)) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return -ENODATA;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	ret = data == MAP_FAILED ? -errno : 0;
+	/* the mapping keeps the file */
+	close(fd);
+	if (ret)
+		return ret;
+
+	img->data = data;
+	img->size = st.st_size;
+	img->hash = firmware_hash(FIRMWARE_HASH_INIT, data, img->size);
+
+	return 0;
+}
+
+void firmware_image_close(struct firmware_image *img)
+{
+	if (img->data)
+		munmap((void *)img->data, img->size);
+	img->data = NULL;
+	img->size = 0;
+}
+
+int firmware_manifest_lookup(const char *manifest, const char *name,
+	struct firmware_manifest_entry *entry)
+{
+	char line[256], file[128], *end;
+	unsigned long long size, hash;
+	int ret = -ESRCH;
+	FILE *fp = fopen(manifest, "r");
+
+	if (fp == NULL)
+		return -errno;
+	while (ret == -ESRCH && fgets(line, sizeof(line), fp)) {
+		end = strchr(line, '#');
+		if (end)
+			*end = '\0';
+		if (sscanf(line, "%127s", file) != 1 || strcmp(file, name))
+			continue;
+		if (sscanf(line, "%*s %llu %llx", &size, &hash) != 2) {
+			ret = -EINVAL;
+			break;
+		}
+		entry->size = size;
+		entry->hash = hash;
+		ret = 0;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+int firmware_image_check(const struct firmware_image *img,
+	const struct firmware_manifest_entry *entry)
+{
+	if (img->size != entry->size)
+		return -EMSGSIZE;
+	if (img->hash != entry->hash)
+		return -EBADMSG;
+
+	return 0;
+}
+
+/* all of @len, restarting after partial writes */
+static int write_all(int fd, const char *data, size_t len, int *writes)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		if (n == 0)
+			return -EIO;
+		(*writes)++;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_file(const char *dev_dir, const char *attr,
+	const void *data, size_t len, int *writes)
+{
+	char path[256];
+	int ret, fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dev_dir, attr);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -errno;
+	ret = write_all(fd, data, len, writes);
+	if (close(fd) && ret == 0)
+		ret = -errno;
+
+	return ret;
+}
+
+int firmware_upload(const char *dev_dir, const char *name,
+	const struct firmware_image *img, int *writes)
+{
+	size_t len = strlen(name);
+	int name_writes = 0;
+	int ret;
+
+	if (len > FIRMWARE_NAME_MAX)
+		len = FIRMWARE_NAME_MAX;
+	ret = write_file(dev_dir, "misc_bin_dmp_firmware_vers", name, len,
+		&name_writes);
+	if (ret)
+		return ret;
+
+	*writes = 0;
+
+	return write_file(dev_dir, "misc_bin_dmp_firmware", img->data,
+		img->size, writes);
+}
+
+/* whole small file into @buf, NUL terminated */
+static int read_small_file(const char *path, char *buf, size_t len)
+{
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, len - 1);
+	if (n < 0)
+		n = -errno;
+	close(fd);
+	if (n < 0)
+		return n;
+	buf[n] = '\0';
+
+	return n;
+}
+
+int firmware_read_version(const char *dev_dir, char *buf, size_t len)
+{
+	char path[256];
+	int n;
+
+	snprintf(path, sizeof(path), "%s/misc_bin_dmp_firmware_vers", dev_dir);
+	n = read_small_file(path, buf, len);
+	while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+		buf[--n] = '\0';
+
+	return n;
+}
+
+int firmware_stamp_read(const char *path, char *buf, size_t len)
+{
+	int n = read_small_file(path, buf, len);
+
+	return n < 0 ? n : 0;
+}
+
+int firmware_stamp_write(const char *path, const char *stamp)
+{
+	size_t len = strlen(stamp);
+	int ret = 0;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return -errno;
+	if (write(fd, stamp, len) != (ssize_t)len)
+		ret = -EIO;
+	if (close(fd) && ret == 0)
+		ret = -errno;
+	/* a half-written record must not match */
+	if (ret)
+		unlink(path);
+
+	return ret;
+}
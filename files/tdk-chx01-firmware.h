@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_FIRMWARE_H_
+#define _TDK_CHX01_FIRMWARE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Record of the last firmware load, on tmpfs so a reboot, which also power
+ * cycles the sensors, forgets it.
+ */
+#define FIRMWARE_STAMP_PATH	"/run/tdk-chx01-firmware"
+#define FIRMWARE_STAMP_LEN	512
+#define FIRMWARE_VERSION_LEN	64
+
+/* image sizes and hashes, next to the images */
+#define FIRMWARE_MANIFEST	"manifest"
+/* the driver keeps the first characters of the firmware name */
+#define FIRMWARE_NAME_MAX	30
+
+/*! \struct firmware_image
+ * Firmware image mapped read-only, uploaded straight from the page cache.
+ */
+struct firmware_image {
+	const void *data;
+	size_t size;
+	uint64_t hash;		/* FNV-1a of the image */
+};
+
+/*! \struct firmware_manifest_entry
+ * What a manifest line says an image must be.
+ */
+struct firmware_manifest_entry {
+	size_t size;
+	uint64_t hash;
+};
+
+/* 64-bit FNV-1a of @len bytes, chained from @hash, FIRMWARE_HASH_INIT first */
+#define FIRMWARE_HASH_INIT	0xcbf29ce484222325ULL
+uint64_t firmware_hash(uint64_t hash, const void *data, size_t len);
+
+/**
+ * firmware_hash_file() - content hash of a firmware image
+ * @path: image file
+ * @hash: FNV-1a of the whole file
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int firmware_hash_file(const char *path, uint64_t *hash);
+
+/**
+ * firmware_image_open() - map and hash a firmware image
+ * @img: image
+ * @path: image file
+ *
+ * Return: 0 on success, -ENODATA for an empty file, -errno on failure.
+ **/
+int firmware_image_open(struct firmware_image *img, const char *path);
+
+void firmware_image_close(struct firmware_image *img);
+
+/**
+ * firmware_manifest_lookup() - find an image in a manifest
+ * @manifest: manifest file, one "name size hash" line per image, size in
+ *	bytes, hash in hex, '#' starts a comment
+ * @name: image file name
+ * @entry: size and hash of the image
+ *
+ * Return: 0 on success, -ESRCH if @name is not listed, -EINVAL on a
+ * malformed line for @name, -errno if the manifest cannot be read.
+ **/
+int firmware_manifest_lookup(const char *manifest, const char *name,
+	struct firmware_manifest_entry *entry);
+
+/**
+ * firmware_image_check() - compare an image with its manifest entry
+ * @img: image
+ * @entry: manifest entry
+ *
+ * Return: 0 if they match, -EMSGSIZE on a size mismatch, -EBADMSG on a hash
+ * mismatch.
+ **/
+int firmware_image_check(const struct firmware_image *img,
+	const struct firmware_manifest_entry *entry);
+
+/**
+ * firmware_upload() - load an image into the sensors
+ * @dev_dir: IIO device directory
+ * @name: firmware name, written to misc_bin_dmp_firmware_vers first
+ * @img: image, written to misc_bin_dmp_firmware with as few write()s as the
+ *	driver accepts, normally one
+ * @writes: write() calls needed for the image
+ *
+ * Return: 0 on success, -EIO if the driver stops accepting data, -errno on
+ * failure.
+ **/
+int firmware_upload(const char *dev_dir, const char *name,
+	const struct firmware_image *img, int *writes);
+
+/**
+ * firmware_read_version() - firmware the driver reports as loaded
+ * @dev_dir: IIO device directory
+ * @buf: destination, the name and version read from
+ *	misc_bin_dmp_firmware_vers without the trailing newline
+ * @len: size of @buf
+ *
+ * Return: length of the string, -errno if the attribute cannot be read.
+ **/
+int firmware_read_version(const char *dev_dir, char *buf, size_t len);
+
+/**
+ * firmware_stamp_read() - read the record of the last load
+ * @path: stamp file
+ * @buf: destination, NUL terminated
+ * @len: size of @buf
+ *
+ * Return: 0 on success, -errno on failure, -ENOENT before the first load.
+ **/
+int firmware_stamp_read(const char *path, char *buf, size_t len);
+
+/* replace the record of the last load, -errno on failure */
+int firmware_stamp_write(const char *path, const char *stamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tdk-chx01-frame.h"
+
+const int8_t chx01_port_map[MAX_NUM_SENSORS] = {4, 5, 6, 1, 2, 3};
+
+unsigned int chx01_parse_ports(const char *arg)
+{
+	unsigned int mask = 0;
+	char *end;
+	long port;
+	int i;
+
+	do {
+		port = strtol(arg, &end, 10);
+		if (end == arg)
+			return 0;
+		for (i = 0; i < MAX_NUM_SENSORS; i++) {
+			if (chx01_port_map[i] == port)
+				break;
+		}
+		if (i == MAX_NUM_SENSORS)
+			return 0;
+		mask |= 1u << i;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? 0 : mask;
+}
+
+long long chx01_scan_timestamp(const struct chx01_scan_layout *layout,
+	const char *scan)
+{
+	long long timestamp;
+
+	memcpy(&timestamp, &scan[layout->scan_bytes - 8], 8);
+
+	return timestamp;
+}
+
+static inline uint16_t get_le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* distance, amplitude and mode of every sensor follow the IQ block */
+static void decode_status(const struct chx01_scan_layout *layout,
+	const uint8_t *scan, struct chx01_frame *frame)
+{
+	int num_sensors = layout->num_sensors;
+	const uint8_t *ptr = scan + IQ_BYTES_PER_SCAN * num_sensors;
+	int j;
+
+	for (j = 0; j < num_sensors; j++) {
+		frame->distance[j] = get_le16(ptr + 2*j);
+		frame->amplitude[j] = get_le16(ptr + 2*(num_sensors + j));
+		frame->mode[j] = ptr[4*num_sensors + j];
+	}
+}
+
+void chx01_decode_scan(const struct chx01_scan_layout *layout,
+	const char *scan, struct chx01_frame *frame, int count)
+{
+	const uint8_t *p = (const uint8_t *)scan;
+	int index = frame->index;
+	int j;
+
+	for (j = 0; j < layout->num_sensors; j++) {
+		const uint8_t *src = p + j * IQ_BYTES_PER_SCAN;
+		int16_t *dst = &frame->iq[j][2 * index];
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		memcpy(dst, src, count * 4);
+#else
+		int i;
+
+		for (i = 0; i < 2 * count; i++)
+			dst[i] = (int16_t)get_le16(src + 2*i);
+#endif
+	}
+	decode_status(layout, p, frame);
+}
+
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+void chx01_encode_scan(const struct chx01_scan_layout *layout,
+	const struct chx01_frame *frame, int s, char *scan)
+{
+	int num_sensors = layout->num_sensors;
+	int first = s * IQ_SAMPLES_PER_SCAN;
+	int count = layout->num_samples - first;
+	uint8_t *p = (uint8_t *)scan;
+	uint8_t *status = p + IQ_BYTES_PER_SCAN * num_sensors;
+	int i, j;
+
+	if (count > IQ_SAMPLES_PER_SCAN)
+		count = IQ_SAMPLES_PER_SCAN;
+	if (count < 0)
+		count = 0;
+
+	memset(p, 0, layout->scan_bytes);
+	for (j = 0; j < num_sensors; j++) {
+		for (i = 0; i < 2 * count; i++)
+			put_le16(p + j * IQ_BYTES_PER_SCAN + 2*i,
+				frame->iq[j][2 * first + i]);
+		put_le16(status + 2*j, frame->distance[j]);
+		put_le16(status + 2*(num_sensors + j), frame->amplitude[j]);
+		status[4*num_sensors + j] = frame->mode[j];
+	}
+	for (i = 0; i < 8; i++)
+		p[layout->scan_bytes - 8 + i] =
+			(unsigned long long)frame->timestamp >> (8 * i);
+}
+
+void chx01_iq_split_ref(const int16_t *iq, int16_t *I, int16_t *Q, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		I[i] = iq[2*i];
+		Q[i] = iq[2*i + 1];
+	}
+}
+
+#if defined(__ARM_NEON)
+#define CHX01_IQ_SPLIT "neon"
+
+/* 8 IQ pairs into 8 lanes of I and 8 lanes of Q */
+static inline void split_iq8(const int16_t *iq, int16_t *I, int16_t *Q)
+{
+	int16x8x2_t v = vld2q_s16(iq);
+
+	vst1q_s16(I, v.val[0]);
+	vst1q_s16(Q, v.val[1]);
+}
+
+#elif defined(__SSE2__)
+#define CHX01_IQ_SPLIT "sse2"
+
+static inline void split_iq8(const int16_t *iq, int16_t *I, int16_t *Q)
+{
+	__m128i lo = _mm_loadu_si128((const __m128i *)iq);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(iq + 8));
+	/* each 32-bit lane is one (I, Q) pair: sign-extend the low half for
+	 * I, arithmetic shift the high half down for Q */
+	__m128i i_lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	__m128i i_hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	__m128i q_lo = _mm_srai_epi32(lo, 16);
+	__m128i q_hi = _mm_srai_epi32(hi, 16);
+
+	_mm_storeu_si128((__m128i *)I, _mm_packs_epi32(i_lo, i_hi));
+	_mm_storeu_si128((__m128i *)Q, _mm_packs_epi32(q_lo, q_hi));
+}
+#endif
+
+#ifdef CHX01_IQ_SPLIT
+void chx01_iq_split(const int16_t *iq, int16_t *I, int16_t *Q, int count)
+{
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8)
+		split_iq8(&iq[2*i], &I[i], &Q[i]);
+	chx01_iq_split_ref(&iq[2*i], &I[i], &Q[i], count - i);
+}
+#else
+#define CHX01_IQ_SPLIT "scalar"
+
+void chx01_iq_split(const int16_t *iq, int16_t *I, int16_t *Q, int count)
+{
+	chx01_iq_split_ref(iq, I, Q, count);
+}
+#endif
+
+const char *chx01_iq_split_impl(void)
+{
+	return CHX01_IQ_SPLIT;
+}
+
+void frame_assembler_init(struct frame_assembler *fa,
+	const struct chx01_scan_layout *layout,
+	const struct frame_assembler_ops *ops, void *ctx)
+{
+	memset(fa, 0, sizeof(*fa));
+	fa->layout = *layout;
+	if (fa->layout.num_samples > MAX_NUM_SAMPLES)
+		fa->layout.num_samples = MAX_NUM_SAMPLES;
+	fa->ops = ops;
+	fa->ctx = ctx;
+	fa->state = FRAME_ASM_IDLE;
+}
+
+static void frame_assembler_discard(struct frame_assembler *fa)
+{
+	fa->ops->put(fa->ctx, fa->frame, 0);
+	fa->frame = NULL;
+	fa->stats.incomplete++;
+	fa->state = FRAME_ASM_IDLE;
+}
+
+int frame_assembler_push(struct frame_assembler *fa, const char *scan)
+{
+	long long timestamp = chx01_scan_timestamp(&fa->layout, scan);
+	int count;
+
+	fa->stats.scans++;
+
+	switch (fa->state) {
+	case FRAME_ASM_DONE:
+		if (timestamp == fa->timestamp) {
+			fa->stats.late++;
+			return 0;
+		}
+		break;
+	case FRAME_ASM_COLLECTING:
+		if (timestamp == fa->timestamp)
+			break;
+		/* a chunk went missing, do not mix it with the next frame */
+		frame_assembler_discard(fa);
+		break;
+	case FRAME_ASM_IDLE:
+		break;
+	}
+
+	if (fa->state != FRAME_ASM_COLLECTING) {
+		fa->frame = fa->ops->get(fa->ctx);
+		fa->frame->timestamp = timestamp;
+		fa->frame->index = 0;
+		fa->timestamp = timestamp;
+		fa->state = FRAME_ASM_COLLECTING;
+	}
+
+	count = fa->layout.num_samples - fa->frame->index;
+	if (count > IQ_SAMPLES_PER_SCAN)
+		count = IQ_SAMPLES_PER_SCAN;
+	chx01_decode_scan(&fa->layout, scan, fa->frame, count);
+	fa->frame->index += count;
+
+	if (fa->frame->index < fa->layout.num_samples)
+		return 0;
+
+	fa->ops->put(fa->ctx, fa->frame, 1);
+	fa->frame = NULL;
+	fa->stats.complete++;
+	fa->state = FRAME_ASM_DONE;
+
+	return 1;
+}
+
+void frame_assembler_flush(struct frame_assembler *fa)
+{
+	if (fa->state == FRAME_ASM_COLLECTING)
+		frame_assembler_discard(fa);
+	fa->state = FRAME_ASM_IDLE;
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_FRAME_H_
+#define _TDK_CHX01_FRAME_H_
+
+#include <stdint.h>
+
+/* MAX_NUM_SENSORS, MAX_NUM_SAMPLES, struct chx01_frame and the assembler
+ * counters are part of the session API */
+#include "tdk-chx01-get-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_CH_IIO_BUFFER	256
+
+/* ports 0-2 carry CH101 sensors, ports 3-5 CH201 */
+#define CHX01_CH201_FIRST	3
+
+/* nominal operating frequencies, Hz */
+#define CH101_FOP		175000
+#define CH201_FOP		85000
+
+/* each scan carries 7 IQ samples per sensor, so a full frame is at most
+ * MAX_NUM_SAMPLES / 7 scans */
+#define IQ_SAMPLES_PER_SCAN	7
+#define IQ_BYTES_PER_SCAN	(IQ_SAMPLES_PER_SCAN * 4)
+#define MAX_SCANS_PER_FRAME	((MAX_NUM_SAMPLES + IQ_SAMPLES_PER_SCAN - 1) / IQ_SAMPLES_PER_SCAN)
+
+/* ID of the sensor on each port, as printed and logged */
+extern const int8_t chx01_port_map[MAX_NUM_SENSORS];
+
+/* comma-separated sensor IDs to a port bitmask, 0 if invalid */
+unsigned int chx01_parse_ports(const char *arg);
+
+/*! \struct chx01_scan_layout
+ * Shape of the scans produced by the driver for the enabled sensors.
+ */
+struct chx01_scan_layout {
+	int scan_bytes;		/* size of one scan, timestamp in the last 8 bytes */
+	int num_sensors;	/* enabled sensors, in scan order */
+	int num_samples;	/* IQ samples per sensor in a complete frame */
+};
+
+/* number of scans making up one frame */
+static inline int chx01_scans_per_frame(const struct chx01_scan_layout *layout)
+{
+	return (layout->num_samples + IQ_SAMPLES_PER_SCAN - 1) /
+		IQ_SAMPLES_PER_SCAN;
+}
+
+/* size of the scans the driver produces for @num_sensors enabled sensors */
+static inline int chx01_scan_bytes(int num_sensors)
+{
+	/* IIO buffer for 6 sensors is 256 */
+	return num_sensors == MAX_NUM_SENSORS ? MAX_CH_IIO_BUFFER :
+		num_sensors * 32 + 32;
+}
+
+/* IIO timestamp of a scan, in ns */
+long long chx01_scan_timestamp(const struct chx01_scan_layout *layout,
+	const char *scan);
+
+/**
+ * chx01_decode_scan() - unpack one IIO scan into a frame
+ * @layout: scan layout
+ * @scan: start of the scan
+ * @frame: destination, the chunk is written at frame->index
+ * @count: IQ samples of the chunk to keep, at most IQ_SAMPLES_PER_SCAN
+ *
+ * The scan already holds little-endian (I, Q) pairs, so on little-endian
+ * hosts the IQ chunk of each sensor is a plain copy into frame->iq.
+ * Distance, amplitude and mode of every sensor are decoded in the same pass.
+ **/
+void chx01_decode_scan(const struct chx01_scan_layout *layout,
+	const char *scan, struct chx01_frame *frame, int count);
+
+/**
+ * chx01_encode_scan() - pack one chunk of a frame the way the driver does
+ * @layout: scan layout
+ * @frame: complete frame, layout->num_samples samples per sensor
+ * @s: scan number within the frame
+ * @scan: destination, layout->scan_bytes long
+ *
+ * The inverse of chx01_decode_scan(). Samples past num_samples and the
+ * padding are zero, every scan carries the status of all sensors and
+ * frame->timestamp.
+ **/
+void chx01_encode_scan(const struct chx01_scan_layout *layout,
+	const struct chx01_frame *frame, int s, char *scan);
+
+/**
+ * chx01_iq_split() - deinterleave IQ samples into separate I and Q arrays
+ * @iq: interleaved samples, iq[2*i] = I[i], iq[2*i+1] = Q[i]
+ * @I: destination for the I samples
+ * @Q: destination for the Q samples
+ * @count: number of IQ samples
+ *
+ * Only needed where separate views are wanted, e.g. for the CSV log. Runs
+ * with SSE2 or NEON when available and is bit-exact with chx01_iq_split_ref().
+ **/
+void chx01_iq_split(const int16_t *iq, int16_t *I, int16_t *Q, int count);
+
+/* portable scalar version, the reference for chx01_iq_split() */
+void chx01_iq_split_ref(const int16_t *iq, int16_t *I, int16_t *Q, int count);
+
+/* name of the kernel behind chx01_iq_split(): "sse2", "neon" or "scalar" */
+const char *chx01_iq_split_impl(void);
+
+/*! \struct frame_assembler_ops
+ * Frame storage used by the assembler. get() hands out the frame to fill for
+ * a new timestamp, put() returns it either complete or to be discarded.
+ */
+struct frame_assembler_ops {
+	struct chx01_frame *(*get)(void *ctx);
+	void (*put)(void *ctx, struct chx01_frame *frame, int complete);
+};
+
+enum frame_assembler_state {
+	FRAME_ASM_IDLE,		/* waiting for the first chunk of a frame */
+	FRAME_ASM_COLLECTING,	/* chunks received, frame not full yet */
+	FRAME_ASM_DONE,		/* frame emitted, ignoring its late chunks */
+};
+
+/*! \struct frame_assembler
+ * Collects scans by IIO timestamp and emits a frame only once every sensor
+ * has exactly num_samples samples. A frame whose timestamp changes before
+ * it is full is discarded and counted, never emitted.
+ */
+struct frame_assembler {
+	struct chx01_scan_layout layout;
+	const struct frame_assembler_ops *ops;
+	void *ctx;
+	enum frame_assembler_state state;
+	long long timestamp;
+	struct chx01_frame *frame;
+	struct frame_assembler_stats stats;
+};
+
+void frame_assembler_init(struct frame_assembler *fa,
+	const struct chx01_scan_layout *layout,
+	const struct frame_assembler_ops *ops, void *ctx);
+
+/**
+ * frame_assembler_push() - feed one scan
+ * @fa: assembler
+ * @scan: start of the scan, layout.scan_bytes long
+ *
+ * Return: 1 if the scan completed a frame, 0 otherwise.
+ **/
+int frame_assembler_push(struct frame_assembler *fa, const char *scan);
+
+/* end of stream: discard and count a partially filled frame */
+void frame_assembler_flush(struct frame_assembler *fa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,82 +24,92 @@
 #include <string.h>
 #include <math.h>
 #include<errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
 
 #include "invn_algo_rangefinder.h"
 #include "invn_algo_floor_type_fxp.h"
 #include "invn_algo_cliff_detection.h"
 #include "invn_algo_obstacleposition.h"
+#include "tdk-chx01-ring.h"
+#include "tdk-chx01-sysfs.h"
+#include "tdk-chx01-frame.h"
+#include "tdk-chx01-pool.h"
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-capture.h"
+#include "tdk-chx01-logger.h"
+#include "tdk-chx01-rawcap.h"
+#include "tdk-chx01-replay.h"
+#include "tdk-chx01-latency.h"
+#include "tdk-chx01-soak.h"
+#include "tdk-chx01-firmware.h"
+#include "tdk-chx01-startup.h"
+#include "tdk-chx01-control.h"
+#include "tdk-chx01-hotplug.h"
+#include "tdk-chx01-algo.h"
 
 #define DEV_NUM_BOUNDARY 3
 #define TX_RX_MODE   0x10
 #define RX_ONLY_MODE   0x20
 
-long long orig_buffer[260];
-
 int sensor_connected[] = {0, 0, 0, 0, 0, 0};
 uint32_t op_freq[] = {0, 0, 0, 0, 0, 0};
 static unsigned do_cliff=0, do_floor_type=0, do_obstacle_detect=0, do_range_finder=0;
 
 
-/*! \struct InvnRangeFinder
- * InvnRangeFinder data structure that store internal algorithm state.
- * The struct below shows one method to align the data buffer pointer to
- * 32 bit for 32bit MCU. Other methods can be used to align memory using
- * malloc or attribute((aligned, 4))
- */
-union InvnRangeFinder {
-	uint8_t data[INVN_RANGEFINDER_DATA_STRUCTURE_SIZE];
-	uint32_t data32;
-} InvnRangeFinder;
-
-/*! \struct InvnFloorType
- * InvnFloorType data structure that store internal algorithm state.
- * The struct below shows one method to align the data buffer pointer to 32 bit
- * for 32bit MCU. Other methods can be used to align memory using malloc or
- * attribute((aligned, 4))
- */
-union InvnFloorType {
-	uint8_t data[INVN_FLOOR_TYPE_DATA_STRUCTURE_SIZE];
-	uint32_t data32;
-} InvnFloorType;
-
-/*! \struct InvnCliffDetection
- * InvnCliffDetection data structure that store internal algorithm state.
- * The struct below shows one method to align the data buffer pointer to 32
- * bit for 32bit MCU. Other methods can be used to align memory using malloc
- * or attribute((aligned, 4))
- */
-union InvnCliffDetection {
-	uint8_t data[INVN_CLIFF_DETECTION_DATA_STRUCTURE_SIZE];
-	uint32_t data32;
-} InvnCliffDetection;
-
 #define CHIRP_NAME		"ch101"
 #define IIO_DIR		"/sys/bus/iio/devices/"
 #define FIRMWARE_PATH		"/usr/share/tdk/"
 #define MAX_SYSFS_NAME_LEN	(100)
-#define MAX_NUM_SAMPLES     450
 #define CH101_DEFAULT_FW       2
 #define CH201_DEFAULT_FW       5
 
 
-#define FILE_PATH_0 "/sys/bus/iio/devices/iio:device0/in_positionrelative18_raw"
-#define FILE_PATH_1 "/sys/bus/iio/devices/iio:device0/in_positionrelative19_raw"
-#define FILE_PATH_2 "/sys/bus/iio/devices/iio:device0/in_positionrelative20_raw"
-#define FILE_PATH_3 "/sys/bus/iio/devices/iio:device0/in_positionrelative21_raw"
-#define FILE_PATH_4 "/sys/bus/iio/devices/iio:device0/in_positionrelative22_raw"
-#define FILE_PATH_5 "/sys/bus/iio/devices/iio:device0/in_positionrelative23_raw"
-
-
 
 #define VER_MAJOR (0)
 #define VER_MINOR (7)
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
-#define MAX_CH_IIO_BUFFER 256
 
-// Global array of file paths
-char* filePaths[] = {FILE_PATH_0, FILE_PATH_1, FILE_PATH_2, FILE_PATH_3, FILE_PATH_4, FILE_PATH_5};
+/* reads are batched up to one full frame of scans */
+#define MAX_SCAN_BATCH	MAX_SCANS_PER_FRAME
+#define IIO_BUFFER_LENGTH	2000
+
+static char scan_buffer[MAX_CH_IIO_BUFFER * MAX_SCAN_BATCH]
+	__attribute__((aligned(64)));
+
+#define FRAME_RING_DEPTH	16
+
+static struct frame_ring frames;
+static struct chx01_scan_layout layout;
+
+/*! \struct chx01_attrs
+ * sysfs attributes of the ch101 IIO device, opened once and reused. Index
+ * i of each array is sensor i.
+ */
+struct chx01_attrs {
+	struct sysfs_attr proximity_en[6];
+	struct sysfs_attr distance_en[6];
+	struct sysfs_attr intensity_en[6];
+	struct sysfs_attr position_en[6];
+	struct sysfs_attr position_raw[6];	/* write: samples, read: FOP */
+	struct sysfs_attr timestamp_en;
+	struct sysfs_attr buffer_length;
+	struct sysfs_attr buffer_watermark;
+	struct sysfs_attr buffer_enable;
+	struct sysfs_attr calibbias;
+	struct sysfs_attr sampling_frequency;
+};
+
+static struct chx01_attrs attrs;
+static int sysfs_trace_on;	/* dump the sysfs write log on exit */
+static int verbose;		/* print the distances of every frame */
+
+void setCnt(int cnt);
+void setFreq(int freq);
 
 
 static const char  *const fw_names[] = {
@@ -114,126 +124,78 @@ static const char  *const fw_names[] = {
 
 static char *firmware_path;
 
+/* prefix of the sysfs and /dev paths, e.g. the tree of tdk-chx01-emu */
+static char *sysfs_root = "";
+static char iio_dir[MAX_SYSFS_NAME_LEN] = IIO_DIR;
 static char sysfs_path[MAX_SYSFS_NAME_LEN] = {0};
+static int iio_dev_num = -1;	/* last resolution, checked before a rescan */
 static char dev_path[MAX_SYSFS_NAME_LEN] = {0};
 static char sensor_connection[6];
-char mode[6];
 static uint16_t floor_distance_mm = 33;
+/* sensors used for floor type, bit n is sensor_connection n (port 6) */
+static unsigned floor_sensors = 1 << 2;
+//chx01_port_map, unless replaying a log
+int8_t port_map[MAX_NUM_SENSORS];
 char *log_file = "/usr/chirp.csv";
+static char *capture_file;	/* binary capture instead of the CSV log */
+static struct capture_file capture;
+static struct chx01_log_info log_info;
+static struct chx01_csv csv;
+static int log_requested;	/* -l or -c given, replay logs only then */
+static char *replay_file;	/* replay a CSV log or capture, no device */
+static double replay_speed;	/* 0: as fast as possible */
+/* log written by its own thread, log_buffer_kib 0 writes from the caller */
+static struct async_logger logger = { .fd = -1 };
+static int log_buffer_kib = 1024;
+static int log_prealloc_mib;
+static int log_sync_every;
+/* raw IIO reads, recorded by the acquisition thread through its own logger */
+static char *raw_file;
+static struct rawcap_file rawcap;
+static struct async_logger raw_logger = { .fd = -1 };
 int scan_bytes = 0;
 int num_sensors = 0;
+int num_samples = 0;
+int scan_batch = 0;	/* scans per read(), 0: one frame worth of scans */
+static int load_fw = 1;
+static int force_firmware;	/* --force-firmware: load even if up to date */
+static const char *firmware_status = "not loaded";
+
+/* -L: soak test, one log segment and algorithm restart every soak_period s */
+static int soak_period;
+static int soak_seconds;	/* -d, 0: until SIGINT or SIGTERM */
+static unsigned int soak_segment;
+static char *soak_log_base;
+static char *soak_capture_base;
+static char soak_path[MAX_SYSFS_NAME_LEN * 2];
+
+/* -U: daemon, logging sessions are started and stopped over this socket */
+static char *daemon_socket;
+static struct control_server control;
+static char daemon_log_path[MAX_SYSFS_NAME_LEN * 2];
+static int daemon_session;	/* a log is open */
+static unsigned int daemon_frames, daemon_session_frames;
+
+/* -U and -L outlive a driver rebind, see device_recover() */
+static struct iio_watch iio_watch;
+static int device_lost;
 FILE *log_fp;
 FILE *fp;
 char file_name[100];
 
-static int get_lib_floortype(int index, int16_t *iq_buffer, int samples)
-{
-	int res;
-	static int initialized;
-
-#define FLOOR_DATA_START_READ_IDX 8
-#define FLOOR_DATA_DECIMATION 1
-
-	static InvnAlgoFloorTypeFxpConfig config;
-
-	static InvnAlgoFloorTypeFxpInput inputs;
-
-	static InvnAlgoFloorTypeFxpOutput outputs;
-
-	static union InvnFloorType algo;
-
-	if (initialized == 0) {
-            printf("Init floor type at distance %u mm and op_freq %d\n", floor_distance_mm, op_freq[2]);
-		invn_algo_floor_type_fxp_generate_default_config(
-			floor_distance_mm,
-                        FLOOR_DATA_START_READ_IDX,
-                        FLOOR_DATA_DECIMATION,
-                        op_freq[2], /*INVN_ALGO_FLOORTYPE_TYPICAL_OPERATION_FREQUENCY,*/
-                        &config);
-		invn_algo_floor_type_fxp_init(&algo, &config);
-		initialized = 1;
-	}
-
-	printf("index=%d\n", index);
-	inputs.time = index;
-	inputs.nbr_samples = samples;
-	inputs.buffer.iq = iq_buffer;
-	inputs.mask = INVN_FLOORTYPE_FXP_INPUT_TYPE_IQ_DATA;
-
-	invn_algo_floor_type_fxp_process(&algo, &inputs, &outputs);
-
-	if (outputs.floor_type == 1)
-		printf("Floor type: HARD\n");
-	else
-		printf("Floor type: SOFT\n");
-
-	return res;
-}
+static struct algo_arena *arena;
 
-static int get_cliff_detection(int index, int16_t *iq_buffer, int sensor_mode,
-	int samples)
+/* (re)create every instance uninitialized, each starts over on first use */
+static void reset_algos(void)
 {
-	int res;
-	int dev_num;
-	static int initialized;
-
-	static InvnAlgoCliffDetectionConfig config;
-
-	static InvnAlgoCliffDetectionInput inputs;
-
-	static InvnAlgoCliffDetectionOutput outputs;
-
-	int nb_skip_sample_pitch_catch;
-	int actual_range = 0;
-
-	static union InvnCliffDetection algo;
-	int error_code;
-
-	if (sensor_mode != RX_ONLY_MODE)
-		return -EINVAL;
-
-	// Define algofrithm config
-	if (initialized == 0) {
-		printf("Init cliff\n");
-		invn_algo_cliff_detection_generate_default_config(&config);
-		error_code = invn_algo_cliff_detection_init(&algo, &config);
-                if (error_code != 0)
-                {
-                    fprintf(stderr, "Cliff detection initialization failed with code %d", error_code);
-                    return error_code;
-                }
-		initialized = 1;
-	}
-
-	for (dev_num = 0; dev_num < 2; dev_num++) {
-		if (mode[dev_num] == RX_ONLY_MODE)
-			inputs.Rx = sensor_connection[dev_num];
-		else
-			inputs.Tx = sensor_connection[dev_num];
+	if (arena) {
+		algo_arena_reset(arena);
+		return;
 	}
-	printf("cliff: Tx=%d, RX=%d, index=%d\n", inputs.Rx, inputs.Tx, index);
-	inputs.time = index;
-	inputs.nbr_samples = samples;
-	inputs.iq_buffer = iq_buffer;
-
-	invn_algo_cliff_detection_process(&algo, &inputs, &outputs);
-	switch (outputs.cliff_detection) {
-	case INVN_CLIFF_DETECTION_CLIFF_RESULT_FLOOR:
-		printf("cliff: floor\n");
-		break;
-	case INVN_CLIFF_DETECTION_CLIFF_RESULT_UNKNOWN:
-		printf("cliff: unknow\n");
-		break;
-	case INVN_CLIFF_DETECTION_CLIFF_RESULT_CLIFF:
-		printf("cliff: cliff\n");
-		break;
-	default:
-		printf("ERROR\n");
-		break;
+	if (algo_arena_create(&arena)) {
+		printf("Cannot allocate algorithm states\n");
+		exit(0);
 	}
-
-
-	return res;
 }
 
 /*! \struct InvnObstaclePosition
@@ -274,181 +236,125 @@ static int get_obstacle_detection(uint32_t fop, int16_t *iq_buffer,
 	return res;
 }
 
-static int get_lib_range(uint32_t fop, int16_t *iq_buffer, int sensor_mode,
-	int samples, unsigned short *distance, unsigned short *amplitude)
+/**
+ * prepare_image() - map a firmware image and check it against its manifest
+ * @dmp_firmware_path: directory of the images and their manifest
+ * @name: image file name
+ * @img: mapped image, to be closed by the caller on success
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+static int prepare_image(const char *dmp_firmware_path, const char *name,
+	struct firmware_image *img)
 {
-	int res;
+	struct firmware_manifest_entry entry;
+	char bin_file[MAX_SYSFS_NAME_LEN * 2], manifest[MAX_SYSFS_NAME_LEN * 2];
+	int ret;
+
+	snprintf(bin_file, sizeof(bin_file), "%s%s", dmp_firmware_path, name);
+	snprintf(manifest, sizeof(manifest), "%s" FIRMWARE_MANIFEST,
+		dmp_firmware_path);
+
+	ret = firmware_manifest_lookup(manifest, name, &entry);
+	if (ret == -ESRCH) {
+		printf("firmware %s is not listed in %s\n", name, manifest);
+		return ret;
+	} else if (ret) {
+		printf("firmware manifest %s: %s\n", manifest, strerror(-ret));
+		return ret;
+	}
 
-	InvnAlgoRangeFinderConfig config;
-	InvnAlgoRangeFinderInput inputs;
-	InvnAlgoRangeFinderOutput outputs;
-	int nb_skip_sample_pitch_catch;
-
-	union InvnRangeFinder algo;
-
-	invn_algo_rangefinder_generate_default_config(&config);
-	if (sensor_mode == TX_RX_MODE) {
-		config.sensor_FOP = fop; // update config FOP to the sensor FOP
-		invn_algo_rangefinder_init(&algo, &config);
-		inputs.time = 0;
-		inputs.Tx = 0;
-		inputs.Rx = 0;
-		inputs.nbr_samples_skip = 0;
-	} else {
-		// pitch_catch example
-		// update config FOP to the receiving sensor FOP
-		config.sensor_FOP = fop;
-		config.pre_trigger_time = 0; // update value of pre-trigger time
-		// update distance between center of sensors
-		config.inter_sensor_distance_mm = 28;
-		invn_algo_rangefinder_init(&algo, &config);
-	// ask for corresponding samples to skip due to pre-trigger_time,
-	//help for integrator no requirement. Skip value is not mandatory
-		nb_skip_sample_pitch_catch =
-			invn_algo_rangefinder_convert_time_to_nbr_samples(
-			config.pre_trigger_time, config.sensor_FOP);
-		inputs.time = 0;
-		inputs.Tx = 0;
-		inputs.Rx = 1;
-		inputs.nbr_samples_skip = 0;
+	ret = firmware_image_open(img, bin_file);
+	if (ret) {
+		printf("firmware %s: %s\n", bin_file, strerror(-ret));
+		return ret;
+	}
+	ret = firmware_image_check(img, &entry);
+	if (ret == -EMSGSIZE)
+		printf("firmware %s is %zu bytes, the manifest expects %zu\n",
+			bin_file, img->size, entry.size);
+	else if (ret == -EBADMSG)
+		printf("firmware %s hash %016llx, the manifest expects %016llx\n",
+			bin_file, (unsigned long long)img->hash,
+			(unsigned long long)entry.hash);
+	if (ret)
+		firmware_image_close(img);
+
+	return ret;
+}
+
+/* write a prepared image to the driver and report what it runs then */
+static int upload_image(const char *dmp_path, const char *name,
+	const struct firmware_image *img)
+{
+	char version[FIRMWARE_VERSION_LEN];
+	long long start = latency_now(CLOCK_MONOTONIC);
+	int ret, writes = 0;
+
+	ret = firmware_upload(dmp_path, name, img, &writes);
+	if (ret) {
+		printf("firmware %s upload to %s: %s\n", name, dmp_path,
+			strerror(-ret));
+		return ret;
 	}
-	inputs.nbr_samples = samples;
-	inputs.iq_buffer = iq_buffer;
-	invn_algo_rangefinder_process(&algo, &inputs, &outputs);
 
-	*distance = outputs.distance_to_object;
-	*amplitude = outputs.magnitude_of_echo;
+	if (firmware_read_version(dmp_path, version, sizeof(version)) < 0)
+		strcpy(version, "unknown");
+	printf("firmware %s: %zu bytes in %d writes, %.1f ms, driver reports %s\n",
+		name, img->size, writes,
+		(latency_now(CLOCK_MONOTONIC) - start) / 1e6, version);
 
-	return res;
+	return 0;
 }
 
+/**
+ * inv_load_dmp() - load one firmware image into the sensors
+ * @dmp_path: IIO device directory
+ * @dmp_version: index in fw_names[], 0xff for firmware_path
+ * @dmp_firmware_path: directory of the images and their manifest
+ *
+ * The image is mapped, checked against its manifest entry and written to
+ * the driver in one go, then the driver is asked which firmware it runs.
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
 int inv_load_dmp(char *dmp_path, int dmp_version,
 	const char *dmp_firmware_path)
 {
-	int result = 0;
-	int bytesWritten = 0;
-	FILE *fp, *fp_read;
-	int write_size, len;
-	char firmware_file[100];
-	char bin_file[100];
-	char bank[256];
-	const char *p;
-	int fw_names_size = ARRAY_SIZE(fw_names);
-
-	snprintf(firmware_file, 100, "%s/misc_bin_dmp_firmware_vers",
-		dmp_path);
-	fp = fopen(firmware_file, "wb");
-	if (fp == NULL) {
-		printf("dmp sysfs file %s open fail\n", firmware_file);
-		fclose(fp_read);
-		return -EINVAL;
-	}
-
-	// printf("file=%s\n", firmware_file);
-
-	if (dmp_version != 0xff)
-		p = (const void *)fw_names[dmp_version];
+	struct firmware_image img;
+	const char *name;
+	int ret;
+
+	if (dmp_version == 0xff)
+		name = firmware_path;
+	else if (dmp_version >= 0 && dmp_version < (int)ARRAY_SIZE(fw_names))
+		name = fw_names[dmp_version];
 	else
-		p = (const void *)firmware_path;
-
-	write_size = strlen(p);
-	if (write_size > 30)
-		write_size = 30;
-
-	// printf("input name=%s\n", p);
-
-	bytesWritten = fwrite(p, 1, write_size, fp);
-	
-	if (bytesWritten != write_size) {
-		printf(
-			"bytes written (%d) not match requested length (%d)\n",
-			bytesWritten, write_size);
-		result = -1;
-	}
-
-    
-	fclose(fp);
-
-	if (dmp_version != 0xff) {
-		if (result == 0)
-			// printf("dmp firmware %s written to %s\n",fw_names[dmp_version], firmware_file);
-
-		if (dmp_version >= fw_names_size) {
-			// printf("dmp_version %d out of range [0-%d]\n",dmp_version, fw_names_size);
-			return -EINVAL;
-		}
-
-		snprintf(bin_file, 100, "%s%s", dmp_firmware_path,
-			fw_names[dmp_version]);
-	} else {
-		if (result == 0)
-			printf("dmp firmware %s written to %s\n",
-				firmware_path, firmware_file);
-		snprintf(bin_file, 100, "%s%s", dmp_firmware_path,
-			firmware_path);
-	}
-
-	fp_read = fopen(bin_file, "rb");
-	if (fp_read == NULL) {
-		printf("dmp firmware file %s open fail\n", bin_file);
-		return -EINVAL;
-	}
-	
-
-	fseek(fp_read, 0L, SEEK_END);
-	len = ftell(fp_read);
-	fseek(fp_read, 0L, SEEK_SET);
-	snprintf(firmware_file, 100, "%s/misc_bin_dmp_firmware", dmp_path);
-
-	fp = fopen(firmware_file, "wb");
-	if (fp == NULL) {
-		printf("dmp sysfs file %s open fail\n", firmware_file);
-		fclose(fp_read);
+		name = NULL;
+	if (name == NULL) {
+		printf("no firmware %d\n", dmp_version);
 		return -EINVAL;
 	}
-	while (len > 0) {
-		if (len > 256)
-			write_size = 256;
-		else
-			write_size = len;
-		bytesWritten = fread(bank, 1, write_size, fp_read);
-		bytesWritten = fwrite(bank, 1, write_size, fp);
-		if (bytesWritten != write_size) {
-			printf(
-			"bytes written (%d) no match requested length (%d)\n",
-				bytesWritten, write_size);
-			result = -1;
-		}
-		len -= write_size;
-	}
-
-	fclose(fp);
-	fclose(fp_read);
 
+	ret = prepare_image(dmp_firmware_path, name, &img);
+	if (ret)
+		return ret;
+	ret = upload_image(dmp_path, name, &img);
+	firmware_image_close(&img);
 
-	return result;
+	return ret;
 }
 
 int check_sensor_connection(void)
 {
 	int i;
-	FILE *fp;
-	char file_name[100];
 
 	for (i = 0; i < 6; i++) {
-		snprintf(file_name, 100, "%s/in_positionrelative%d_raw",
-			sysfs_path, i+18);
-		fp = fopen(file_name, "rt");
-		// printf("Check Sensor Connection :: filename:: %s :\n", file_name);
-		// printf("Check Sensor Connection :: sysfs_path:: %s :\n", sysfs_path);
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
+		if (sysfs_attr_read_int(&attrs.position_raw[i],
+				(int *)&op_freq[i]) < 0) {
+			printf("error opening %s\n", attrs.position_raw[i].path);
 			exit(0);
-		} else {
-			//printf("open %s OK\n", file_name);
 		}
-		fscanf(fp, "%d", &op_freq[i]);
-		fclose(fp);
 		if (op_freq[i])
 			sensor_connected[i] = 1;
 		else
@@ -484,7 +390,7 @@ int find_type_by_name(const char *name, const char *type)
 	int ret = 0;
 	int status = -1;
 
-	dp = opendir(IIO_DIR);
+	dp = opendir(iio_dir);
 	if (dp == NULL) {
 		printf("No industrialio devices available\n");
 		return -EINVAL;
@@ -500,7 +406,7 @@ int find_type_by_name(const char *name, const char *type)
 
 			numstrlen = sscanf(ent->d_name + strlen(type),
 					   "%d", &number);
-			filename_sz = strlen(IIO_DIR)
+			filename_sz = strlen(iio_dir)
 					+ strlen(type)
 					+ numstrlen
 					+ 6;
@@ -510,7 +416,7 @@ int find_type_by_name(const char *name, const char *type)
 					":", 1) != 0) {
 
 				snprintf(filename, filename_sz, "%s%s%d/name",
-					IIO_DIR, type, number);
+					iio_dir, type, number);
 
 				nameFile = fopen(filename, "r");
 				if (!nameFile)
@@ -531,234 +437,309 @@ exit_closedir:
 	return status;
 }
 
+/**
+ * init_sysfs_attrs() - bind the attribute cache to a device directory
+ * @dir: sysfs directory of the IIO device
+ *
+ * Files are opened lazily on first access and stay open afterwards.
+ **/
+static void init_sysfs_attrs(const char *dir)
+{
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		sysfs_attr_init(&attrs.proximity_en[i], O_WRONLY,
+			"%s/scan_elements/in_proximity%d_en", dir, i);
+		//add 6 for distance
+		sysfs_attr_init(&attrs.distance_en[i], O_WRONLY,
+			"%s/scan_elements/in_distance%d_en", dir, i+6);
+		//add 12 for intensity
+		sysfs_attr_init(&attrs.intensity_en[i], O_WRONLY,
+			"%s/scan_elements/in_intensity%d_en", dir, i+12);
+		//add 18 for intensity(rx/tx id)
+		sysfs_attr_init(&attrs.position_en[i], O_WRONLY,
+			"%s/scan_elements/in_positionrelative%d_en", dir, i+18);
+		sysfs_attr_init(&attrs.position_raw[i], O_RDWR,
+			"%s/in_positionrelative%d_raw", dir, i+18);
+	}
+	sysfs_attr_init(&attrs.timestamp_en, O_WRONLY,
+		"%s/scan_elements/in_timestamp_en", dir);
+	sysfs_attr_init(&attrs.buffer_length, O_WRONLY,
+		"%s/buffer/length", dir);
+	sysfs_attr_init(&attrs.buffer_watermark, O_WRONLY,
+		"%s/buffer/watermark", dir);
+	sysfs_attr_init(&attrs.buffer_enable, O_WRONLY,
+		"%s/buffer/enable", dir);
+	sysfs_attr_init(&attrs.calibbias, O_WRONLY, "%s/calibbias", dir);
+	sysfs_attr_init(&attrs.sampling_frequency, O_WRONLY,
+		"%s/sampling_frequency", dir);
+}
+
+/* drop every cached fd, they belong to a device that went away */
+static void close_sysfs_attrs(void)
+{
+	struct sysfs_attr *attr = (struct sysfs_attr *)&attrs;
+	size_t i;
+
+	for (i = 0; i < sizeof(attrs) / sizeof(*attr); i++)
+		sysfs_attr_close(&attr[i]);
+}
+
+/* write an attribute, bailing out like the rest of the setup code on error */
+static void write_attr(struct sysfs_attr *attr, int value)
+{
+	int ret = sysfs_attr_write_int(attr, value);
+
+	if (ret < 0) {
+		printf("error writing %s: %s\n", attr->path, strerror(-ret));
+		exit(0);
+	}
+}
+
+static void update_attr(struct sysfs_attr *attr, int value)
+{
+	int ret = sysfs_attr_update_int(attr, value);
+
+	if (ret < 0) {
+		printf("error writing %s: %s\n", attr->path, strerror(-ret));
+		exit(0);
+	}
+}
+
 int process_sysfs_request(char *data)
 {
-	int dev_num = find_type_by_name(CHIRP_NAME, "iio:device");
+	int dev_num;
 
+	snprintf(iio_dir, sizeof(iio_dir), "%s" IIO_DIR, sysfs_root);
+	if (!iio_device_is(iio_dir, iio_dev_num, CHIRP_NAME))
+		iio_dev_num = find_type_by_name(CHIRP_NAME, "iio:device");
+	dev_num = iio_dev_num;
 	if (dev_num < 0)
 		return -EINVAL;
 
-	snprintf(data, 100, IIO_DIR "iio:device%d", dev_num);
-	snprintf(dev_path,  100, "/dev/iio:device%d", dev_num);
+	if (snprintf(data, 100, "%siio:device%d", iio_dir, dev_num) >= 100 ||
+	    snprintf(dev_path, 100, "%s/dev/iio:device%d", sysfs_root,
+			dev_num) >= 100)
+		return -EINVAL;
+	init_sysfs_attrs(data);
 
 	return 0;
 }
 
 
+/**
+ * scans_per_read() - number of scans fetched by a single read()
+ *
+ * By default this is the number of scans making up one frame, so the
+ * driver wakes us once per measurement instead of once per 7-sample chunk.
+ * The same value is used as the IIO buffer watermark.
+ **/
+static int scans_per_read(void)
+{
+	int batch = scan_batch;
+
+	if (batch <= 0)
+		batch = chx01_scans_per_frame(&layout);
+	if (batch < 1)
+		batch = 1;
+	if (batch > MAX_SCAN_BATCH)
+		batch = MAX_SCAN_BATCH;
+
+	return batch;
+}
+
 int switch_streaming(int on)
 {
 	int i;
 
-	FILE *fp;
-	char file_name[100];
+	/* scan elements cannot change while the buffer runs, so the buffer
+	 * is stopped first and only started once everything is set up */
+	if (!on)
+		write_attr(&attrs.buffer_enable, 0);
 
 	for (i = 0; i < 6; i++) {
-		snprintf(file_name, 100, "%s/scan_elements/in_proximity%d_en",
-			sysfs_path, i);
-		fp = fopen(file_name, "wt");
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
-			exit(0);
-		} else {
-			//printf("open %s OK\n", file_name);
-		}
-		fprintf(fp, "%d", sensor_connected[i] & on);
-		fclose(fp);
-	}
-	//add 6 for distance
-	for (i = 0; i < 6; i++) {
-		snprintf(file_name, 100, "%s/scan_elements/in_distance%d_en",
-			sysfs_path, i+6);
-		fp = fopen(file_name, "wt");
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
-			exit(0);
-		} else {
-			//printf("open %s OK\n", file_name);
-		}
-		fprintf(fp, "%d", sensor_connected[i] & on);
-		fclose(fp);
+		update_attr(&attrs.proximity_en[i], sensor_connected[i] & on);
+		update_attr(&attrs.distance_en[i], sensor_connected[i] & on);
+		update_attr(&attrs.intensity_en[i], sensor_connected[i] & on);
+		update_attr(&attrs.position_en[i], sensor_connected[i] & on);
 	}
+	update_attr(&attrs.timestamp_en, on);
 
-	//add 12 for intensity
-	for (i = 0; i < 6; i++) {
-		snprintf(file_name, 100, "%s/scan_elements/in_intensity%d_en",
-			sysfs_path, i+12);
-		fp = fopen(file_name, "wt");
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
-			exit(0);
-		} else {
-			//printf("open %s OK\n", file_name);
-		}
-		fprintf(fp, "%d", sensor_connected[i] & on);
-		fclose(fp);
-	}
+	if (!on)
+		return 0;
 
-	//add 18 for intensity(rx/tx id)
-	for (i = 0; i < 6; i++) {
-		snprintf(file_name, 100,
-			"%s/scan_elements/in_positionrelative%d_en",
-				sysfs_path, i+18);
-		fp = fopen(file_name, "wt");
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
-			exit(0);
-		} else {
-			//printf("open %s OK\n", file_name);
-		}
-		fprintf(fp, "%d", sensor_connected[i] & on);
-		fclose(fp);
-	}
+	update_attr(&attrs.buffer_length, IIO_BUFFER_LENGTH);
+	update_attr(&attrs.buffer_watermark, scans_per_read());
+	write_attr(&attrs.buffer_enable, 1);
 
-	snprintf(file_name, 100, "%s/scan_elements/in_timestamp_en",
-		sysfs_path);
-	fp = fopen(file_name, "wt");
-	if (fp == NULL) {
-		printf("error opening proximity\n");
-		exit(0);
-	} else {
-		//printf("open proximity OK\n");
-	}
-	fprintf(fp, "%d", on);
-	fclose(fp);
+	return 0;
+}
 
-	snprintf(file_name, 100, "%s/buffer/length", sysfs_path);
-	fp = fopen(file_name, "wt");
-	if (fp == NULL) {
-		printf("error opening length\n");
-		exit(0);
-	} else {
-		//printf("open length OK\n");
-	}
-	fprintf(fp, "%d", 2000);
-	fclose(fp);
+/* fill log_info, the sensor setup stored in the CSV header or capture */
+static void init_log_info(int sample, int frequency)
+{
+	int i;
 
-	snprintf(file_name, 100, "%s/buffer/watermark", sysfs_path);
-	fp = fopen(file_name, "wt");
-	if (fp == NULL) {
-		printf("error opening watermark\n");
-		exit(0);
-	} else {
-	   //printf("open watermark OK\n");
+	memset(&log_info, 0, sizeof(log_info));
+	log_info.num_sensors = num_sensors;
+	log_info.num_samples = sample;
+	log_info.frequency = frequency;
+	for (i = 0; i < 6; i++) {
+		log_info.sensor_connected[i] = sensor_connected[i];
+		log_info.op_freq[i] = op_freq[i];
+		log_info.port_map[i] = port_map[i];
+		log_info.sensor_connection[i] = sensor_connection[i];
+		if (load_fw && sensor_connected[i])
+			snprintf(log_info.firmware[i], CHX01_FW_NAME_LEN, "%s",
+				fw_names[i < DEV_NUM_BOUNDARY ?
+					CH101_DEFAULT_FW : CH201_DEFAULT_FW]);
 	}
-	fprintf(fp, "%d", 1);
-	fclose(fp);
+}
 
-	snprintf(file_name, 100, "%s/buffer/enable", sysfs_path);
-	fp = fopen(file_name, "wt");
-	if (fp == NULL) {
-		printf("error opening master enable\n");
-		exit(0);
-	} else {
-		// printf("open master enable OK\n");
+/* log stream, through the async logger unless -W 0 */
+static FILE *open_log_stream(struct async_logger *logger, const char *path,
+	const char *mode)
+{
+	FILE *stream;
+	int ret;
+
+	if (log_buffer_kib <= 0)
+		return fopen(path, mode);
+
+	ret = async_logger_open(logger, path, (size_t)log_buffer_kib * 1024,
+		(off_t)log_prealloc_mib << 20, log_sync_every);
+	if (ret) {
+		errno = -ret;
+		return NULL;
 	}
-	fprintf(fp, "%d", 1 & on);
-	fclose(fp);
+	stream = async_logger_stream(logger);
+	if (stream == NULL)
+		async_logger_close(logger);
 
+	return stream;
 }
 
-int16_t I[6][MAX_NUM_SAMPLES], Q[6][MAX_NUM_SAMPLES];
-int16_t iq_buffer[MAX_NUM_SAMPLES * 2];
-float sample_to_mm[6];
-#define CH_SPEEDOFSOUND_MPS	343
-int8_t port_map[6] = {4, 5, 6, 1, 2, 3};
-
-unsigned short distance[6], amplitude[6];
-void print_header(int sample, int frequency, FILE *fp)
+/* open the CSV log or, with -c, the binary capture, for log_info */
+static int start_log(void)
 {
-	int i, j;
-	float pos;
-
-	for (i = 0; i < 6; i++) {
-		if (op_freq[i]) {
-			sample_to_mm[i] =
-				(sample*CH_SPEEDOFSOUND_MPS * 8 * 1000)
-				/ (op_freq[i] * 2);
-			//printf("to_mm=%f\n", sample_to_mm[i]);
+	FILE *stream;
+	int ret;
+
+	if (capture_file) {
+		stream = open_log_stream(&logger, capture_file, "wb");
+		if (stream == NULL) {
+			ret = -errno;
+			printf("error creating capture %s: %s\n", capture_file,
+				strerror(-ret));
+			return ret;
+		}
+		/* records are handed to the logger whole, no stdio copy */
+		if (log_buffer_kib > 0)
+			setvbuf(stream, NULL, _IONBF, 0);
+		else
+			setvbuf(stream, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+		ret = capture_create_stream(&capture, stream, &log_info);
+		if (ret) {
+			printf("error creating capture %s: %s\n", capture_file,
+				strerror(-ret));
+			capture_close(&capture);
+			async_logger_close(&logger);
 		}
+		return ret;
 	}
 
-	fprintf(fp, "# Chirp Microsystems redswallow Data Log\n");
-
-	fprintf(fp, "# sample rate:, %d S/s\n", frequency*sample);
-	fprintf(fp, "# Decimation factor:, 1\n");
-	fprintf(fp, "# Content: iq\n");
-	fprintf(fp, "# Sensors ID:, ");
-	for (i = 3; i < 6; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", i-2);
+	if (chx01_csv_init(&csv, &log_info)) {
+		printf("error preparing the CSV log\n");
+		return -ENOMEM;
 	}
-	for (i = 0; i < 3; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", i+4);
+	log_fp = open_log_stream(&logger, log_file, "wt");
+	if (log_fp == NULL) {
+		ret = -errno;
+		printf("error opening log file %s\n", log_file);
+		chx01_csv_destroy(&csv);
+		return ret;
 	}
+	chx01_csv_header(&csv, log_fp);
 
-	fprintf(fp, "\n# Sensors FOP:, ");
-	for (i = 3; i < 6; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", op_freq[i]);
-	}
-	for (i = 0; i < 3; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", op_freq[i]);
-	}
+	return 0;
+}
 
-	fprintf(fp, "Hz\n");
+static void open_log(int sample, int frequency)
+{
+	init_log_info(sample, frequency);
+	if (start_log())
+		exit(0);
+}
 
-	fprintf(fp, "# Sensors NB Samples:,");
-	for (i = 3; i < 6; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", sample*2);
-	}
-	for (i = 0; i < 3; i++) {
-		if (sensor_connected[i])
-			fprintf(fp, "%d, ", sample);
-	}
+static void close_logger(struct async_logger *logger, const char *name)
+{
+	struct async_logger_stats *st = &logger->stats;
+
+	if (logger->fd < 0)
+		return;
+	if (async_logger_close(logger))
+		printf("error writing %s\n", name);
+	printf("%s writer: %llu bytes in %u writes, %u syncs, %u stalls, max write %u us\n",
+		name, st->bytes, st->writes, st->syncs, st->stalls,
+		st->max_write_us);
+}
 
-	fprintf(fp, "\n# Sensors NB First samples skipped:, ");
+/**
+ * open_rawcap() - start recording raw reads, with -w
+ *
+ * Called once the scan layout is known. Records are copied into the
+ * buffers of a dedicated async logger, the acquisition thread never
+ * writes to the file itself.
+ **/
+static void open_rawcap(void)
+{
+	FILE *stream;
+	int ret;
 
-	for (j = 0; j < 6; j++) {
-		if (sensor_connected[j])
-			fprintf(fp, "0, ");
-	}
-	fprintf(fp, "\n");
+	if (raw_file == NULL)
+		return;
 
-	for (j = 3; j < 6; j++) {
-		if (sensor_connected[j]) {
-			fprintf(fp,
-"# time [s],tx_id,rx_id, range [cm],intensity [a.u.], target_detected, ");
-			pos = 0;
-			for (i = 0; i < sample; i++) {
-				pos += sample_to_mm[j];
-				fprintf(fp, "i_data_%3.1f, ", pos/1000.0);
-			}
-			pos = 0;
-			for (i = 0; i < sample; i++) {
-				pos += sample_to_mm[j];
-				fprintf(fp, "q_data_%3.1f, ", pos/1000.0);
-			}
-			fprintf(fp, "\n");
-		}
+	stream = open_log_stream(&raw_logger, raw_file, "wb");
+	if (stream == NULL) {
+		printf("error creating raw capture %s: %s\n", raw_file,
+			strerror(errno));
+		exit(0);
 	}
-	for (j = 0; j < 3; j++) {
-		if (sensor_connected[j]) {
-			fprintf(fp,
-"# time [s],tx_id,rx_id, range [cm],intensity [a.u.], target_detected, ");
-			pos = 0;
-			for (i = 0; i < sample; i++) {
-				pos += sample_to_mm[j];
-				fprintf(fp, "i_data_%3.1f, ", pos/1000.0);
-			}
-			pos = 0;
-			for (i = 0; i < sample; i++) {
-				pos += sample_to_mm[j];
-				fprintf(fp, "q_data_%3.1f, ", pos/1000.0);
-			}
-			fprintf(fp, "\n");
-		}
+	if (log_buffer_kib > 0)
+		setvbuf(stream, NULL, _IONBF, 0);
+	else
+		setvbuf(stream, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+	ret = rawcap_create_stream(&rawcap, stream, &log_info, scan_bytes);
+	if (ret) {
+		printf("error creating raw capture %s: %s\n", raw_file,
+			strerror(-ret));
+		exit(0);
 	}
+}
 
+static void close_log(void)
+{
+	if (capture.fp) {
+		if (capture_close(&capture))
+			printf("error writing capture %s\n", capture_file);
+		else
+			printf("capture: %u frames of %zu bytes\n",
+				capture.frames, capture.record_size);
+	}
+	if (log_fp)
+		fclose(log_fp);
+	log_fp = NULL;
+	chx01_csv_destroy(&csv);
+	close_logger(&logger, "log");
+
+	if (rawcap.fp) {
+		if (rawcap_close(&rawcap))
+			printf("error writing raw capture %s\n", raw_file);
+		else
+			printf("raw capture: %u reads, %llu bytes\n",
+				rawcap.reads, rawcap.bytes);
+	}
+	close_logger(&raw_logger, "raw capture");
 }
 
 void print_help(void)
@@ -779,97 +760,274 @@ void print_help(void)
 	printf("-s x: number of samples. default: 40 samples\n");
 	printf("-f x: sampling frequency. Default: 5 Hz\n");
 	printf("-n: not loading firmware. Default will load firmware\n");
+	printf("--force-firmware: load the firmware even if the sensors already run it\n");
+	printf("-b x: scans fetched per read(), also the IIO watermark. Default: one frame\n");
+	printf("-t: print the sysfs write log on exit\n");
+	printf("-v: print the driver distances of every frame\n");
+	printf("-p file: replay a CSV log, capture or raw capture through the algorithms instead of reading the device\n");
+	printf("-x x: replay clock scale, 1 for real time. Default: 0, as fast as possible\n");
+	printf("-r dir: prefix of the sysfs and /dev paths, e.g. the tdk-chx01-emu root. Default: none\n");
+	printf("-j x: algorithm worker threads, including the reading one. Default: one per CPU\n");
+	printf("-A list: CPUs the algorithm workers are pinned to, e.g. 4-7. Default: not pinned\n");
 	printf(
 	"-l string: output logging file name. Default: \"/usr/chirp.csv\"\n");
+	printf(
+	"-c string: write a binary capture instead of the CSV log, see tdk-chx01-cap2csv\n");
+	printf("-w string: also record every raw read() of the device to this file, replayable with -p\n");
+	printf("-W x: log writer thread buffers, in KiB, 0 writes from the reading thread. Default: 1024\n");
+	printf("-P x: preallocate the log file x MiB at a time. Default: 0, off\n");
+	printf("-S x: fdatasync() the log every x buffers. Default: 0, never\n");
         printf("-C Do cliff detection\n");
         printf("-F[d] Do floor type detection [with optionnal distance in mm (default is %dmm)]\n", floor_distance_mm);
+        printf("-D x[,y...] ports of the downward-facing sensors used for floor type. Default: 6\n");
         printf("-O Do obstacle detection\n");
         printf("-R Do range finder\n");
+	printf("-U path: daemon, stream until told to quit, logging sessions are started and stopped over this Unix socket\n");
+	printf("-L x: soak test, stream for -d seconds (0: until SIGINT or SIGTERM), every x seconds start log <name>_<n>, restart the algorithms and print frame rate, drops, RSS and fds\n");
 }
 
-void log_data(int index, int num_sensors, int sample, FILE *log_fp,
-	long long last_timestamp)
-{
-	int dev_num, i, j, tx_sensor;
-
-	for (dev_num = 0; dev_num < num_sensors; dev_num++) {
-	//only CH101 and only in RX_TX mode, we call algo to calculate
-		if (((mode[dev_num] == RX_ONLY_MODE) || (mode[dev_num] == TX_RX_MODE)) &&
-			(sensor_connection[dev_num] < 3)) {
-			for (i = 0; i < sample; i++) {
-				iq_buffer[2*i] = I[dev_num][i];
-				iq_buffer[2*i+1] = Q[dev_num][i];
-			}
-			//for (i = 0; i < inputs.nbr_samples*2; i++) {
-				//printf("%d, ", inputs.iq_buffer[i]);
-			//}
-			//printf("\n");
-
-			get_lib_range(op_freq[sensor_connection[dev_num]],
-				iq_buffer, mode[dev_num], sample,
-				 &distance[dev_num], &amplitude[dev_num]);
-
-			if (do_floor_type && (sensor_connection[dev_num] == 2))
-				get_lib_floortype(index, iq_buffer, sample);
-                        if (do_cliff)
-                            get_cliff_detection(index, iq_buffer,
-                                                mode[dev_num], sample);
-		}
-	}
+/*! \struct algo_job
+ * One algorithm call for one sensor of a frame, run on the worker pool.
+ */
+struct algo_job {
+	struct algo_call call;
+	struct chx01_frame *frame;
+	int sample;
+};
 
-	for (dev_num = 0; dev_num < num_sensors; dev_num++) {
-		if (mode[dev_num] == 0) {
-			printf("mode 0 here\n");
-			break;
-		}
-		fprintf(log_fp, "%f, ", last_timestamp/1000000000.0);
-		//printf("%f, ", last_timestamp/1000000000.0);
-
-		//TX_RX mode
-		if (mode[dev_num] == TX_RX_MODE) {
-			fprintf(log_fp, "%d, ",
-				port_map[sensor_connection[dev_num]]);
-			fprintf(log_fp, "%d, ",
-				port_map[sensor_connection[dev_num]]);
-		}
+static struct worker_pool algo_pool;
+static int algo_workers;	/* 0: one per online CPU */
+static int algo_cpus[POOL_MAX_WORKERS];
+static int algo_ncpus;
+static unsigned int algo_frames;
+static long long algo_ns_total, algo_ns_max;
+/* time spent in each algorithm, summed over the workers */
+static atomic_llong algo_kind_ns[ALGO_KINDS];
+static atomic_uint algo_kind_calls[ALGO_KINDS];
+static const char * const algo_kind_names[ALGO_KINDS] = {
+	"range", "floor type", "cliff",
+};
 
-		//RX only mode.
-		if (mode[dev_num] == RX_ONLY_MODE) {
-			for (j = 0; j < num_sensors; j++) {
-				if ((mode[j] == TX_RX_MODE) &&
-				(sensor_connection[j] < 2)) {
-					fprintf(log_fp, "%d, ",
-					port_map[sensor_connection[j]]);
-				}
-			}
-			fprintf(log_fp, "%d, ",
-				port_map[sensor_connection[dev_num]]);
-		}
+/* latency of each frame stage, measured from the IIO timestamp of the frame */
+enum lat_stage {
+	LAT_POLL,		/* poll() returned */
+	LAT_READ,		/* read() returned */
+	LAT_DECODE,		/* frame decoded and published */
+	LAT_DEQUEUE,		/* consumer took the frame */
+	LAT_ALGO,		/* one per algo_kind, algorithm done */
+	LAT_LOG = LAT_ALGO + ALGO_KINDS,	/* frame handed to the log */
+	LAT_STAGES,
+};
 
-		fprintf(log_fp, "%d, ", distance[dev_num]/10);
-		fprintf(log_fp, "%d, ", amplitude[dev_num]);
-		if ((distance[dev_num] == 0xFFFF) ||
-			(distance[dev_num] == 0)) {
-			fprintf(log_fp, "%d, ", 0);
-		} else {
-			fprintf(log_fp, "%d, ", 1);
-		}
+static struct latency_hist lat_hist[LAT_STAGES];
+static const char * const lat_stage_names[LAT_STAGES] = {
+	"poll wakeup", "read done", "decode done", "dequeue",
+	"range done", "floor type done", "cliff done", "log enqueue",
+};
+static clockid_t lat_clock = CLOCK_REALTIME;	/* clock of the IIO timestamps */
+static char lat_clock_name[32] = "realtime";
+static int lat_on;		/* live acquisition, timestamps are comparable */
 
-		if (sensor_connection[dev_num] < 3) {
-			for (i = 0; i < sample; i++) {
-				fprintf(log_fp, "%d, ", I[dev_num][i]);
-				//printf("%d, ", I[dev_num][i]);
-			}
-			for (i = 0; i < sample; i++) {
-				fprintf(log_fp, "%d, ", Q[dev_num][i]);
-				//printf("%d, ", Q[dev_num][i]);
-			}
-		}
-		fprintf(log_fp, "\n");
-	}
+static void lat_record(enum lat_stage stage, long long timestamp,
+	long long now)
+{
+	if (lat_on)
+		latency_hist_record(&lat_hist[stage], now - timestamp);
 }
 
-int confSensors(int dur, int sample, int freq){
+static void lat_mark(enum lat_stage stage, long long timestamp)
+{
+	if (lat_on)
+		lat_record(stage, timestamp, latency_now(lat_clock));
+}
+
+static void latency_dump(void)
+{
+	int i;
+
+	printf("latency from the IIO timestamp, %s clock:\n", lat_clock_name);
+	latency_print_header(stdout);
+	for (i = 0; i < LAT_STAGES; i++)
+		if (atomic_load(&lat_hist[i].total) ||
+		    atomic_load(&lat_hist[i].negative))
+			latency_hist_print(stdout, lat_stage_names[i],
+				&lat_hist[i]);
+	fflush(stdout);
+}
+
+/* the driver stamps scans with the clock named in current_timestamp_clock,
+ * realtime when the attribute is missing */
+static void latency_read_clock(void)
+{
+	char path[MAX_SYSFS_NAME_LEN + 32], name[sizeof(lat_clock_name)] = "";
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/current_timestamp_clock", sysfs_path);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return;
+	if (fscanf(fp, "%31s", name) == 1 &&
+	    latency_clock_parse(name, &lat_clock) == 0)
+		strcpy(lat_clock_name, name);
+	else
+		printf("unknown timestamp clock \"%s\", using realtime\n", name);
+	fclose(fp);
+}
+
+
+static long long elapsed_ns(const struct timespec *start,
+	const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000LL +
+		end->tv_nsec - start->tv_nsec;
+}
+
+static void print_floor_type(int sensor, int res)
+{
+	if (res < 0)
+		printf("Floor type error, sensor %d\n", port_map[sensor]);
+	else if (res == 1)
+		printf("Floor type %d: HARD\n", port_map[sensor]);
+	else
+		printf("Floor type %d: SOFT\n", port_map[sensor]);
+}
+
+static void print_cliff(int tx, int rx, int res)
+{
+	switch (res) {
+	case INVN_CLIFF_DETECTION_CLIFF_RESULT_FLOOR:
+		printf("cliff %d->%d: floor\n", port_map[tx], port_map[rx]);
+		break;
+	case INVN_CLIFF_DETECTION_CLIFF_RESULT_UNKNOWN:
+		printf("cliff %d->%d: unknow\n", port_map[tx], port_map[rx]);
+		break;
+	case INVN_CLIFF_DETECTION_CLIFF_RESULT_CLIFF:
+		printf("cliff %d->%d: cliff\n", port_map[tx], port_map[rx]);
+		break;
+	default:
+		printf("ERROR\n");
+		break;
+	}
+}
+
+static void run_algo_job(void *arg)
+{
+	struct algo_job *job = arg;
+	struct chx01_frame *frame = job->frame;
+	int dev_num = job->call.dev_num;
+	int tx = job->call.tx;
+	int rx = sensor_connection[dev_num];
+	uint64_t time_us = frame->timestamp / 1000;
+	//the frame already holds the interleaved IQ the algos take
+	int16_t *iq_buffer = frame->iq[dev_num];
+	struct timespec start, end;
+	unsigned int warnings;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	switch (job->call.kind) {
+	case ALGO_RANGE:
+		res = algo_range(arena, op_freq[rx], tx, rx, time_us,
+			iq_buffer, job->sample, &frame->distance[dev_num],
+			&frame->amplitude[dev_num]);
+		if (res < 0)
+			printf("RangeFinder failed, Tx=%d Rx=%d\n", tx, rx);
+		break;
+	case ALGO_FLOOR_TYPE:
+		res = algo_floor_type(arena, rx, op_freq[rx],
+			floor_distance_mm, time_us, iq_buffer, job->sample,
+			&warnings);
+		if (warnings)
+			printf("Floor type config warnings 0x%x, sensor %d\n",
+				warnings, port_map[rx]);
+		print_floor_type(rx, res);
+		break;
+	case ALGO_CLIFF:
+		res = algo_cliff(arena, tx, rx, time_us, iq_buffer,
+			job->sample);
+		print_cliff(tx, rx, res);
+		break;
+	case ALGO_KINDS:
+		break;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	atomic_fetch_add(&algo_kind_ns[job->call.kind],
+		elapsed_ns(&start, &end));
+	atomic_fetch_add(&algo_kind_calls[job->call.kind], 1);
+	lat_mark(LAT_ALGO + job->call.kind, frame->timestamp);
+}
+
+/* fan the per-sensor algorithms of a frame out to the pool and join them */
+static void run_algos(int num_sensors, int sample, struct chx01_frame *frame)
+{
+	struct algo_call calls[ALGO_MAX_CALLS];
+	struct algo_job jobs[ALGO_MAX_CALLS];
+	struct pool_task tasks[ALGO_MAX_CALLS];
+	unsigned int algos = ALGO_FLAG(ALGO_RANGE);
+	struct timespec start, end;
+	int i, n;
+	long long ns;
+
+	if (do_floor_type)
+		algos |= ALGO_FLAG(ALGO_FLOOR_TYPE);
+	if (do_cliff)
+		algos |= ALGO_FLAG(ALGO_CLIFF);
+	n = algo_plan(sensor_connection, num_sensors, frame->mode, algos,
+		floor_sensors, calls);
+
+	for (i = 0; i < n; i++) {
+		jobs[i] = (struct algo_job){ calls[i], frame, sample };
+		tasks[i].fn = run_algo_job;
+		tasks[i].arg = &jobs[i];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	worker_pool_run(&algo_pool, tasks, n);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = elapsed_ns(&start, &end);
+	algo_frames++;
+	algo_ns_total += ns;
+	if (ns > algo_ns_max)
+		algo_ns_max = ns;
+}
+
+/* frame and per-algorithm timing, for the end of run summary */
+static void algo_stats_dump(void)
+{
+	unsigned int calls;
+	int k;
+
+	if (algo_frames)
+		printf("algorithms: %u frames, avg %lld us, max %lld us\n",
+			algo_frames, algo_ns_total / algo_frames / 1000,
+			algo_ns_max / 1000);
+	for (k = 0; k < ALGO_KINDS; k++) {
+		calls = atomic_load(&algo_kind_calls[k]);
+		if (calls)
+			printf("  %s: %u calls, avg %lld us, total %lld ms\n",
+				algo_kind_names[k], calls,
+				atomic_load(&algo_kind_ns[k]) / calls / 1000,
+				atomic_load(&algo_kind_ns[k]) / 1000000);
+	}
+}
+
+void log_data(int index, int num_sensors, int sample, FILE *log_fp,
+	struct chx01_frame *frame)
+{
+	run_algos(num_sensors, sample, frame);
+
+	if (capture.fp) {
+		if (capture_write_frame(&capture, frame))
+			printf("capture write error, frame %d\n", index);
+	} else if (log_fp && chx01_csv_frame(&csv, log_fp, frame)) {
+		printf("log write error, frame %d\n", index);
+	}
+	lat_mark(LAT_LOG, frame->timestamp);
+}
+
+int confSensors(int dur, int sample, int freq){
 		
 	if (freq > 100){
 		freq = 100;
@@ -877,30 +1035,23 @@ int confSensors(int dur, int sample, int freq){
 	if (sample > 225){
 		sample = 225;
 	}
+	num_samples = sample;
+	/* new sensor setup, every algorithm instance starts over */
+	reset_algos();
 
 	printf("options, log file=%s, frequency=%d, samples=%d, duration=%d seconds\n",
 	log_file, freq, sample, dur);
 
-	//set sample
-	for (int i = 0; i < 6; i++) {
-		snprintf(file_name, 100, "%s/in_positionrelative%d_raw",
-			sysfs_path, i+18);
-		// printf("Conf Sensors :: filename:: %s :\n", file_name);
-		fp = fopen(file_name, "wt");
-		if (fp == NULL) {
-			printf("error opening %s\n", file_name);
-			exit(0);
-		} else {
-			//printf("open %s OK, with %d\n", file_name, sample);
-		}
-		fprintf(fp, "%d", sample);
-		fclose(fp);
-	}
-
 	//check number of sensors that are conneceted
 	//sets sensor_conneceted = 1 if connected
+	//the FOP does not depend on the sample count, reading it first also
+	//works on an emulated tree where the attribute reads back the write
 	check_sensor_connection();
 
+	//set sample
+	for (int i = 0; i < 6; i++)
+		write_attr(&attrs.position_raw[i], sample);
+
 	int index = 0;
 	int counter = freq*dur;
 
@@ -919,13 +1070,11 @@ int confSensors(int dur, int sample, int freq){
 		}
 	}
 
-	log_fp = fopen(log_file, "wt");
-	if (log_fp == NULL) {
-		printf("error opening log file %s\n", log_file);
-		exit(0);
-	}
-	//todo what does this do?
-	print_header(sample, freq, log_fp);
+	/* the daemon opens a log per session, on request */
+	if (daemon_socket)
+		init_log_info(sample, freq);
+	else
+		open_log(sample, freq);
 
 	scan_bytes += 32;
 
@@ -935,6 +1084,11 @@ int confSensors(int dur, int sample, int freq){
 		scan_bytes = MAX_CH_IIO_BUFFER;
 	}
 
+	layout.scan_bytes = scan_bytes;
+	layout.num_sensors = num_sensors;
+	layout.num_samples = sample;
+	open_rawcap();
+
 	// counter = 1;
 	// printf("counter=%d\n", counter);
 
@@ -964,227 +1118,860 @@ int confSensors(int dur, int sample, int freq){
 	// fprintf(fp, "%d", freq);
 	// fclose(fp);
 
-	int total_bytes = 0;
 	switch_streaming(1);
 	
 	return counter;
 		
 }
 
+/* the default images, mapped by their own startup steps */
+static const int fw_defaults[] = { CH101_DEFAULT_FW, CH201_DEFAULT_FW };
+static struct firmware_image fw_images[ARRAY_SIZE(fw_defaults)];
+
+/**
+ * firmware_stamp() - describe the firmware the sensors should be running
+ * @stamp: destination, FIRMWARE_STAMP_LEN bytes
+ * @version: what misc_bin_dmp_firmware_vers reports
+ *
+ * The report followed by the name and content hash of each default image.
+ **/
+static void firmware_stamp(char *stamp, const char *version)
+{
+	int i, n;
+
+	n = snprintf(stamp, FIRMWARE_STAMP_LEN, "%s\n", version);
+	for (i = 0; i < (int)ARRAY_SIZE(fw_defaults); i++)
+		n += snprintf(stamp + n, FIRMWARE_STAMP_LEN - n, "%s %016llx\n",
+			fw_names[fw_defaults[i]],
+			(unsigned long long)fw_images[i].hash);
+}
+
+/* startup step: map and check one default image, @arg is its index */
+static int prepare_default_image(void *arg)
+{
+	long i = (long)arg;
+
+	return prepare_image(FIRMWARE_PATH, fw_names[fw_defaults[i]],
+		&fw_images[i]);
+}
+
+/*
+ * Startup step, once the device is found and the images prepared. The
+ * images are only streamed to the sensors when the driver reports another
+ * firmware than after our last load, or an image changed since. Both loads
+ * go through the same pair of attributes, so they stay one after the other.
+ */
+static int load_default_firmware(void *arg)
+{
+	char version[FIRMWARE_VERSION_LEN], stamp_path[MAX_SYSFS_NAME_LEN];
+	char stamp[FIRMWARE_STAMP_LEN], last[FIRMWARE_STAMP_LEN];
+	int i, ret = 0;
+
+	snprintf(stamp_path, sizeof(stamp_path), "%s" FIRMWARE_STAMP_PATH,
+		sysfs_root);
+	if (!force_firmware &&
+	    firmware_read_version(sysfs_path, version, sizeof(version)) > 0 &&
+	    firmware_stamp_read(stamp_path, last, sizeof(last)) == 0) {
+		firmware_stamp(stamp, version);
+		if (strcmp(stamp, last) == 0) {
+			printf("firmware %s already loaded\n", version);
+			firmware_status = "already running";
+			return 0;
+		}
+	}
+	/* until the new record is written, nothing may match */
+	unlink(stamp_path);
+
+	for (i = 0; i < (int)ARRAY_SIZE(fw_defaults) && ret == 0; i++) {
+		ret = upload_image(sysfs_path, fw_names[fw_defaults[i]],
+			&fw_images[i]);
+		if (ret)
+			printf("%s firmware fail\n", i ? "CH201" : "CH101");
+	}
+	if (ret)
+		return ret;
+	firmware_status = "loaded";
+
+	if (firmware_read_version(sysfs_path, version, sizeof(version)) > 0)
+		firmware_stamp(stamp, version);
+	else
+		stamp[0] = '\0';
+	if (stamp[0] == '\0' || firmware_stamp_write(stamp_path, stamp))
+		printf("cannot record the firmware in %s, it is loaded again next time\n",
+			stamp_path);
+
+	return 0;
+}
+
+/* load the default firmware, outside of the startup graph */
 int loadFirmware(){
-	if (inv_load_dmp(sysfs_path, CH101_DEFAULT_FW, FIRMWARE_PATH) != 0) {
-		printf("CH101 firmware fail\n");
-		return -EINVAL;
+	long i;
+	int ret = 0;
+
+	for (i = 0; i < (long)ARRAY_SIZE(fw_defaults) && ret == 0; i++)
+		ret = prepare_default_image((void *)i);
+	if (ret == 0)
+		ret = load_default_firmware(NULL);
+	for (i = 0; i < (long)ARRAY_SIZE(fw_defaults); i++)
+		firmware_image_close(&fw_images[i]);
+
+	return ret;
+}
+
+/**
+ * read_scans() - read as many whole scans as the driver has, up to @max
+ * @fd: IIO character device
+ * @buffer: destination, at least @max * scan_bytes long
+ * @max: maximum number of scans to fetch
+ *
+ * Return: number of scans read, 0 on a short read, -errno on error.
+ **/
+static int read_scans(int fd, char *buffer, int max)
+{
+	int bytes = read(fd, buffer, max * scan_bytes);
+	int err = errno;
+	struct timespec now;
+
+	if (rawcap.fp) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		rawcap_write(&rawcap, now.tv_sec * 1000000000LL + now.tv_nsec,
+			buffer, bytes < 0 ? -err : bytes);
 	}
 
-	if (inv_load_dmp(sysfs_path, CH201_DEFAULT_FW, FIRMWARE_PATH) != 0) {
-		printf("CH201 firmware fail\n");
-		return -EINVAL;
+	if (bytes < 0)
+		return -err;
+	if (bytes % scan_bytes) {
+		printf("Expected a multiple of %d bytes, read %d\n",
+			scan_bytes, bytes);
+		return 0;
 	}
+
+	return bytes / scan_bytes;
 }
 
-void getData(int counter){
-	int target_bytes;
-	char *buffer;
-	buffer = (char *)orig_buffer;
-	long long timestamp, last_timestamp;
-	int ready;
-	int c, fp_writes;
+/*! \struct acq_thread
+ * Acquisition thread state. The thread only polls, reads and decodes scans
+ * into the frame ring; everything else runs on the consumer side.
+ */
+struct acq_thread {
+	pthread_t thread;
+	int fd;
+	sem_t ready;		/* posted for every published frame */
+	atomic_int done;
+	atomic_int stop;	/* asks the thread to return */
+	atomic_int pause;	/* same, for a restart with another setup */
+	int running;		/* thread started and not joined yet */
+	unsigned int nreads;
+	unsigned int nscans;
+	struct frame_assembler assembler;
+	struct frame_assembler_stats past;	/* earlier streams, same run */
+	struct chx01_frame overflow;	/* decode target while the ring is full */
+};
+
+static struct acq_thread acq;
+
+/* frames are assembled in place in the next free ring slot */
+static struct chx01_frame *acq_get_frame(void *ctx)
+{
+	struct chx01_frame *frame = frame_ring_write_slot(&frames);
+
+	if (frame == NULL)
+		frame = &acq.overflow;
+
+	return frame;
+}
+
+static void acq_put_frame(void *ctx, struct chx01_frame *frame, int complete)
+{
+	/* a discarded frame leaves its slot unpublished, it is simply
+	 * handed out again for the next timestamp */
+	if (!complete)
+		return;
+	if (frame == &acq.overflow) {
+		frame_ring_drop(&frames);
+		return;
+	}
+	frame_ring_publish(&frames);
+	sem_post(&acq.ready);
+}
+
+static const struct frame_assembler_ops acq_frame_ops = {
+	.get = acq_get_frame,
+	.put = acq_put_frame,
+};
+
+static void *signal_thread(void *arg)
+{
+	sigset_t *set = arg;
+	int sig;
+
+	while (sigwait(set, &sig) == 0) {
+		if (sig == SIGUSR1) {
+			latency_dump();
+			continue;
+		}
+		printf("%s, stopping\n", strsignal(sig));
+		atomic_store(&acq.stop, 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * SIGUSR1 prints the latency histograms, SIGINT and SIGTERM end a soak test
+ * or the daemon cleanly. They are blocked here, before any other thread
+ * exists so they all inherit the mask, and taken by a thread of their own:
+ * a handler would interrupt the acquisition poll() instead.
+ */
+static void start_signal_thread(void)
+{
+	static sigset_t set;
+	pthread_t thread;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	if (soak_period || daemon_socket) {
+		sigaddset(&set, SIGINT);
+		sigaddset(&set, SIGTERM);
+	}
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	if (pthread_create(&thread, NULL, signal_thread, &set)) {
+		printf("cannot start the signal thread\n");
+		return;
+	}
+	pthread_detach(thread);
+}
+
+/* point the CSV log or capture at the current segment */
+static void soak_name_log(void)
+{
+	char *base = soak_capture_base ? soak_capture_base : soak_log_base;
+
+	if (soak_segment_path(soak_path, sizeof(soak_path), base,
+			soak_segment)) {
+		printf("log file name too long: %s\n", base);
+		exit(0);
+	}
+	if (soak_capture_base)
+		capture_file = soak_path;
+	else
+		log_file = soak_path;
+}
+
+/*
+ * Called between frames by the consumer, with no algorithm running: close
+ * the log segment, open the next one and restart every algorithm instance,
+ * as a new process would, without touching the stream.
+ */
+static void soak_rotate(void)
+{
+	close_log();
+	soak_segment++;
+	soak_name_log();
+	if (start_log())
+		exit(0);
+	reset_algos();
+}
+
+/* assembler counters of the whole run, across restarts of the stream */
+static void acq_stats(struct frame_assembler_stats *st)
+{
+	st->scans = acq.past.scans + acq.assembler.stats.scans;
+	st->complete = acq.past.complete + acq.assembler.stats.complete;
+	st->incomplete = acq.past.incomplete + acq.assembler.stats.incomplete;
+	st->late = acq.past.late + acq.assembler.stats.late;
+}
+
+/* the assembler counters are plain ints of the acquisition thread, good
+ * enough for a periodic report */
+static void soak_snapshot(struct soak_stats *st, unsigned int processed,
+	unsigned int missed)
+{
+	struct frame_assembler_stats fa;
+
+	acq_stats(&fa);
+	soak_read_process(st);
+	st->frames = processed;
+	st->missed = missed;
+	st->dropped = atomic_load(&frames.dropped);
+	st->incomplete = fa.incomplete;
+}
+
+static void *acquisition_thread(void *arg)
+{
+	char *buffer = scan_buffer;
 	struct pollfd pfds[1];
-	int nfds, num_open_fds;
-	int bytes;
-	int total_bytes;
-	int i,j;
+	int ready = 1;
+	int scans, batch;
+	int s;
 	unsigned int retry = 0;
+	long long poll_ns, read_ns, timestamp;
 
-	last_timestamp = 0;
-	timestamp = 0;
-
-	pfds[0].fd = open(dev_path, O_RDONLY);
-	printf("DEVPATH: %s\n", dev_path);
+	pfds[0].fd = acq.fd;
 	pfds[0].events = (POLLIN | POLLRDNORM | POLLERR | POLLNVAL);
-	last_timestamp = 0;
-  
-	ready = 1;
-	fp_writes = 1;
-	int index = 0; //redefined in confSensors
-	int cnt = 0;
-	while (ready == 1) {
 
-		char *tmp;
-		short value;
-		char *ptr;
-		int dev_num;
+	batch = scans_per_read();
+	printf("reading up to %d scans of %d bytes per read\n",
+		batch, scan_bytes);
 
+	while (ready == 1 && !atomic_load(&acq.stop) &&
+	       !atomic_load(&acq.pause)) {
 		pfds[0].revents = 0;
-		//printf("before new polling counter=%d\n", counter);
-		nfds = 1;
 
-		ready = poll(pfds, nfds, 5000);
-		printf("counter: %d, pass fd  %d, poll 0x%x, ready=%d\n", cnt++,pfds[0].fd,pfds[0].revents, ready);
+		ready = poll(pfds, 1, 5000);
+		poll_ns = latency_now(lat_clock);
 
 		if (ready == -1)
 			printf("poll error\n");
 
 		if (pfds[0].revents & (POLLIN | POLLRDNORM)) {
-     		target_bytes = scan_bytes;
-			//printf("target bytes=%d and fd = %d\n",target_bytes,pfds[0].fd);
-
-			bytes = read(pfds[0].fd, buffer, target_bytes);
-            if(bytes < 0)
-			{
-				printf("Read IIO buffer error: %s\n", strerror(errno));
-                break;
+			scans = read_scans(pfds[0].fd, buffer, batch);
+			read_ns = latency_now(lat_clock);
+			if (scans < 0) {
+				printf("Read IIO buffer error: %s\n", strerror(-scans));
+				break;
+			} else if (scans > 0) {
+				retry = 0;
+				acq.nreads++;
+				acq.nscans += scans;
+				for (s = 0; s < scans; s++) {
+					if (!frame_assembler_push(&acq.assembler,
+							buffer + s * scan_bytes))
+						continue;
+					timestamp = chx01_scan_timestamp(&layout,
+						buffer + s * scan_bytes);
+					lat_record(LAT_POLL, timestamp, poll_ns);
+					lat_record(LAT_READ, timestamp, read_ns);
+					lat_mark(LAT_DECODE, timestamp);
+				}
+			} else {
+				if (++retry >= 6) {
+					printf("Max retry reached\n");
+					break;
+				}
 			}
-            else if (bytes == target_bytes){
-			total_bytes += bytes;
-			tmp = (char *)&timestamp;
-			memcpy(tmp, &buffer[scan_bytes - 8], 8);
-			//printf("ts %lld\n",timestamp);
-	//amplitude 2 bytes + intensity data
-	//2 bytes 224/8 = 28bytes(IQ)+mode(1 bytes)
-			target_bytes = scan_bytes-32;
-			i = 0;
-			//for (i = 0; i < 64; i++) {
-			//	printf("%d, ", buffer[i]);
-			//}
-			//printf("\n");
-			if (last_timestamp == 0)
-				last_timestamp = timestamp;
-
-			if (last_timestamp != timestamp) {
-
-				index -= 7;
-				fp_writes++;
-				// log_data(fp_writes, num_sensors, sample, log_fp,
-				// 	last_timestamp);
+		} else if (pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			printf("IIO device error, poll 0x%x\n", pfds[0].revents);
+			break;
+		}
+		/* fails like the reads once the device is gone */
+		if (sysfs_attr_write_int(&attrs.calibbias, 10) < 0)
+			break;
+	}
 
-				index = 0;
-				last_timestamp = timestamp;
-			}
+	frame_assembler_flush(&acq.assembler);
+	atomic_store(&acq.done, 1);
+	sem_post(&acq.ready);
 
-			//printf("\nindex=%d\n", index);
-			for (j = 0; j < num_sensors; j++) {
-				//printf("j = %d\n", j);
-				for (i = 0; i < 7; i++) {
-					//printf("\ni=%d\n", (i+index));
-					value = buffer[i*4+1+j*28];
-					value <<= 8;
-					value += buffer[i*4+j*28];
-					I[j][i+index] = value;
-					
-					value = buffer[i*4+3+j*28];
-					value <<= 8;
-					value += buffer[i*4+2+j*28];
-					Q[j][i+index] = value;
-					//printf("%d, %d", I[j][i], Q[j][i]);
-				}
-			}
+	return NULL;
+}
 
-			//printf("\n");
-			index += 7;
+/* start the acquisition thread on the open device for the current layout */
+static int acq_start(void)
+{
+	acq_stats(&acq.past);
+	atomic_store(&acq.done, 0);
+	atomic_store(&acq.pause, 0);
+	frame_assembler_init(&acq.assembler, &layout, &acq_frame_ops, NULL);
+	if (pthread_create(&acq.thread, NULL, acquisition_thread, NULL)) {
+		printf("cannot start acquisition thread\n");
+		return -EAGAIN;
+	}
+	acq.running = 1;
 
-			ptr = buffer + 28*num_sensors;
+	return 0;
+}
 
-			// printf("Here11");
-			for (j = 0; j < num_sensors; j++) {
-				distance[j] = ptr[1+j*2];
-				distance[j] <<= 8;
-				distance[j] += ptr[j*2];
-				
-				printf("distance[%d]=%d\n", j, distance[j]);
-			}
+static void acq_join(void)
+{
+	if (acq.running)
+		pthread_join(acq.thread, NULL);
+	acq.running = 0;
+}
 
+/* drop the scans of the old setup, until the device stayed quiet @ms */
+static void acq_drain(int ms)
+{
+	struct pollfd pfd = { .fd = acq.fd, .events = POLLIN };
+	char buf[4096];
 
-			ptr += 2*num_sensors;
+	while (poll(&pfd, 1, ms) > 0 && (pfd.revents & POLLIN))
+		if (read(acq.fd, buf, sizeof(buf)) <= 0)
+			break;
+}
 
-			for (j = 0; j < num_sensors; j++) {
-				amplitude[j] = ptr[1+j*2];
-				amplitude[j] <<= 8;
-				amplitude[j] += ptr[j*2];
-			}
+/**
+ * daemon_reconfigure() - change the sample count and frame rate in place
+ * @sample: samples per sensor
+ * @freq: frames per second
+ *
+ * Runs in the consumer, between frames, with no session open. The buffer
+ * is disabled, the setup written like confSensors() does and the buffer
+ * enabled again, the device stays open. Frames and scans of the old setup
+ * still queued are dropped.
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+static int daemon_reconfigure(int sample, int freq)
+{
+	int i;
 
-			ptr += 2*num_sensors;
+	if (sample < 1 || freq < 1)
+		return -EINVAL;
+	if (freq > 100)
+		freq = 100;
+	if (sample > 225)
+		sample = 225;
 
-			for (j = 0; j < num_sensors; j++)
-				mode[j] = ptr[j];
-			}
+	atomic_store(&acq.pause, 1);
+	acq_join();
+	while (frame_ring_read_slot(&frames))
+		frame_ring_release(&frames);
+	switch_streaming(0);
+	/* a scan may still be on its way, wait two frame periods */
+	acq_drain(2000 / log_info.frequency + 10);
+
+	for (i = 0; i < 6; i++)
+		write_attr(&attrs.position_raw[i], sample);
+	num_samples = sample;
+	layout.num_samples = sample;
+	reset_algos();
+	init_log_info(sample, freq);
+	setFreq(freq);
+	switch_streaming(1);
+
+	return acq_start();
+}
+
+static void daemon_wake(void *ctx)
+{
+	sem_post(&acq.ready);
+}
+
+/* @format csv or cap, the session log is @path */
+static int daemon_start_session(const char *format, const char *path)
+{
+	int ret;
+
+	if (strcmp(format, "csv") && strcmp(format, "cap"))
+		return -EINVAL;
+	if (snprintf(daemon_log_path, sizeof(daemon_log_path), "%s", path) >=
+			(int)sizeof(daemon_log_path))
+		return -ENAMETOOLONG;
+	capture_file = strcmp(format, "cap") ? NULL : daemon_log_path;
+	log_file = daemon_log_path;
+
+	ret = start_log();
+	if (ret)
+		return ret;
+	daemon_session = 1;
+	daemon_session_frames = 0;
+
+	return 0;
+}
+
+static void daemon_stop_session(void)
+{
+	close_log();
+	daemon_session = 0;
+}
+
+/*
+ * Control requests, one per line:
+ *   status
+ *   start csv|cap <file>	open a session log, from the next frame on
+ *   rotate <file>		next log of the same format, no frame lost
+ *   stop			close the session log, streaming goes on
+ *   reconfigure [samples=<n>] [freq=<hz>]	only without a session
+ *   quit			stop streaming and exit
+ */
+static void daemon_handle(void *ctx, char *request, char *reply, size_t len)
+{
+	char *argv[4], *save, *tok;
+	int argc = 0, sample = num_samples, freq = log_info.frequency;
+	int i, ret = 0;
+
+	for (tok = strtok_r(request, " \t", &save); tok && argc < 4;
+			tok = strtok_r(NULL, " \t", &save))
+		argv[argc++] = tok;
+
+	if (argc == 0) {
+		snprintf(reply, len, "error empty request");
+	} else if (strcmp(argv[0], "status") == 0) {
+		snprintf(reply, len, "ok device=%s samples=%d freq=%d frames=%u dropped=%u session=%s session_frames=%u",
+			device_lost ? "lost" : dev_path,
+			num_samples, log_info.frequency, daemon_frames,
+			atomic_load(&frames.dropped),
+			daemon_session ? daemon_log_path : "none",
+			daemon_session_frames);
+	} else if (strcmp(argv[0], "start") == 0 && argc == 3) {
+		if (daemon_session)
+			snprintf(reply, len, "error session running");
+		else if ((ret = daemon_start_session(argv[1], argv[2])))
+			snprintf(reply, len, "error %s", strerror(-ret));
+		else
+			snprintf(reply, len, "ok");
+	} else if (strcmp(argv[0], "rotate") == 0 && argc == 2) {
+		if (!daemon_session) {
+			snprintf(reply, len, "error no session");
+			return;
+		}
+		daemon_stop_session();
+		ret = daemon_start_session(capture_file ? "cap" : "csv",
+			argv[1]);
+		if (ret)
+			snprintf(reply, len, "error %s", strerror(-ret));
+		else
+			snprintf(reply, len, "ok");
+	} else if (strcmp(argv[0], "stop") == 0 && argc == 1) {
+		if (!daemon_session) {
+			snprintf(reply, len, "error no session");
+			return;
+		}
+		snprintf(reply, len, "ok session_frames=%u",
+			daemon_session_frames);
+		daemon_stop_session();
+	} else if (strcmp(argv[0], "reconfigure") == 0 && argc > 1) {
+		for (i = 1; i < argc && ret == 0; i++) {
+			if (strncmp(argv[i], "samples=", 8) == 0)
+				sample = atoi(argv[i] + 8);
+			else if (strncmp(argv[i], "freq=", 5) == 0)
+				freq = atoi(argv[i] + 5);
 			else
-			{
-                printf("Expected %d bytes, read %d\n",bytes,target_bytes);
-				retry++;
-				if(retry < 6)
-				{
-				  printf("Max retry reached\n");
-				  break;
-				}
-			}	
+				ret = -EINVAL;
 		}
-		setCnt(10);
+		if (daemon_session)
+			snprintf(reply, len, "error session running");
+		else if (device_lost)
+			snprintf(reply, len, "error device lost");
+		else if (ret || (ret = daemon_reconfigure(sample, freq)))
+			snprintf(reply, len, "error %s", strerror(-ret));
+		else
+			snprintf(reply, len, "ok samples=%d freq=%d",
+				num_samples, log_info.frequency);
+	} else if (strcmp(argv[0], "quit") == 0 && argc == 1) {
+		atomic_store(&acq.stop, 1);
+		snprintf(reply, len, "ok");
+	} else {
+		snprintf(reply, len, "error unknown request");
 	}
-	switch_streaming(0);
-	fclose(log_fp);
+}
 
-	if (fp_writes == counter)
-		printf("PASS: setting=%d, get=%d\n", counter, fp_writes);
-	else
-		printf("FAIL: setting=%d, get=%d\n", counter, fp_writes);
+/**
+ * device_recover() - wait for the device to come back and stream again
+ * @deadline: CLOCK_MONOTONIC time to give up at, 0 for none
+ *
+ * Runs in the consumer once the acquisition thread ended on its own and
+ * every frame it published was processed: the driver was unbound, or the
+ * stream stalled. The device is looked up again, it may come back as
+ * another iio:deviceN, the firmware is loaded if it was at startup and the
+ * same setup written before streaming resumes. The log stays open, the
+ * outage shows as a gap in the timestamps.
+ *
+ * Return: 0 once streaming again, -ECANCELED if stopped while waiting,
+ * -ENODEV if the device came back with other sensors, -errno on failure.
+ **/
+static int device_recover(long long deadline)
+{
+	unsigned int connected[6];
+	int i, ret;
+
+	acq_join();
+	close(acq.fd);
+	acq.fd = -1;
+	close_sysfs_attrs();
+	device_lost = 1;
+	memcpy(connected, sensor_connected, sizeof(connected));
+	printf("%s lost, waiting for it\n", CHIRP_NAME);
+
+	/* the node may be back already, or never have gone on a stall */
+	while (process_sysfs_request(sysfs_path) < 0 || access(dev_path, R_OK)) {
+		if (atomic_load(&acq.stop) ||
+		    (deadline && latency_now(CLOCK_MONOTONIC) >= deadline))
+			return -ECANCELED;
+		iio_watch_wait(&iio_watch, 500);
+		if (daemon_socket)
+			control_serve(&control);
+	}
+
+	if (load_fw) {
+		ret = loadFirmware();
+		if (ret)
+			return ret;
+	}
+	check_sensor_connection();
+	if (memcmp(connected, sensor_connected, sizeof(connected))) {
+		printf("%s came back with other sensors\n", CHIRP_NAME);
+		return -ENODEV;
+	}
+	for (i = 0; i < 6; i++)
+		write_attr(&attrs.position_raw[i], num_samples);
+	setFreq(log_info.frequency);
+	switch_streaming(1);
+
+	acq.fd = open(dev_path, O_RDONLY);
+	if (acq.fd < 0)
+		return -errno;
+	device_lost = 0;
+	printf("%s back, DEVPATH: %s\n", CHIRP_NAME, dev_path);
 
+	return acq_start();
 }
 
-int init(int dur, int sample, int freq){
-	printf("\n\nTDK-Robotics-RB5-chx01-app-%d.%d\n\n",VER_MAJOR, VER_MINOR);
-	// printf("RangeFinder version: %s\n", invn_algo_rangefinder_version());
+void getData(int counter){
+	struct chx01_frame *frame;
+	struct soak_stats soak_first, soak_prev, soak_now;
+	long long period_ns = log_info.frequency > 0 ?
+		1000000000LL / log_info.frequency : 0;
+	long long last_ts = 0, soak_next = 0, soak_end = 0, now;
+	struct frame_assembler_stats fa;
+	unsigned int missed = 0;
+	int hotplug = daemon_socket || soak_period;
+	char label[32], dev_dir[MAX_SYSFS_NAME_LEN];
+	int fp_writes = 0;
+	int j, ret;
+
+	acq.fd = open(dev_path, O_RDONLY);
+	printf("DEVPATH: %s\n", dev_path);
+
+	if (frame_ring_init(&frames, FRAME_RING_DEPTH,
+			sizeof(struct chx01_frame)) < 0) {
+		printf("cannot allocate frame ring\n");
+		return;
+	}
+	sem_init(&acq.ready, 0, 0);
+	acq.nreads = 0;
+	acq.nscans = 0;
+	/* opened before streaming starts, not to miss the device leaving */
+	snprintf(dev_dir, sizeof(dev_dir), "%s/dev", sysfs_root);
+	if (hotplug && iio_watch_open(&iio_watch, dev_dir, !sysfs_root[0]))
+		printf("no hotplug events, rechecking %s every 500 ms when lost\n",
+			CHIRP_NAME);
+	latency_read_clock();
+	lat_on = 1;
+	if (acq_start()) {
+		frame_ring_free(&frames);
+		return;
+	}
+	if (daemon_socket) {
+		ret = control_start(&control, daemon_socket, daemon_handle,
+			daemon_wake, NULL);
+		if (ret) {
+			printf("cannot listen on %s: %s\n", daemon_socket,
+				strerror(-ret));
+			atomic_store(&acq.stop, 1);
+			daemon_socket = NULL;
+		} else {
+			printf("control socket %s\n", daemon_socket);
+		}
+	}
+	if (soak_period) {
+		soak_snapshot(&soak_first, 0, 0);
+		soak_prev = soak_first;
+		soak_next = soak_first.time_ns + soak_period * 1000000000LL;
+		if (soak_seconds)
+			soak_end = soak_first.time_ns +
+				soak_seconds * 1000000000LL;
+	}
+
+	while (1) {
+		if (daemon_socket)
+			control_serve(&control);
+		frame = frame_ring_read_slot(&frames);
+		if (frame == NULL) {
+			if (!atomic_load(&acq.done)) {
+				sem_wait(&acq.ready);
+				continue;
+			}
+			frame = frame_ring_read_slot(&frames);
+			if (frame == NULL && hotplug && !atomic_load(&acq.stop) &&
+			    device_recover(soak_end) == 0)
+				continue;
+			if (frame == NULL)
+				break;
+		}
+		lat_mark(LAT_DEQUEUE, frame->timestamp);
+		/* frames lost anywhere, driver included, leave a gap */
+		if (soak_period && period_ns && last_ts &&
+		    frame->timestamp - last_ts > period_ns * 3 / 2)
+			missed += (frame->timestamp - last_ts + period_ns / 2) /
+				period_ns - 1;
+		last_ts = frame->timestamp;
+
+		for (j = 0; verbose && j < num_sensors; j++)
+			printf("distance[%d]=%d\n", j, frame->distance[j]);
+
+		fp_writes++;
+		log_data(fp_writes, num_sensors, num_samples, log_fp, frame);
+		frame_ring_release(&frames);
+		daemon_frames++;
+		daemon_session_frames += daemon_session;
+
+		if (!soak_period)
+			continue;
+		now = latency_now(CLOCK_MONOTONIC);
+		if (soak_end && now >= soak_end)
+			atomic_store(&acq.stop, 1);
+		if (now < soak_next || atomic_load(&acq.stop))
+			continue;
+		soak_snapshot(&soak_now, fp_writes, missed);
+		snprintf(label, sizeof(label), "segment %u", soak_segment);
+		soak_stats_print(stdout, label, &soak_prev, &soak_now);
+		soak_prev = soak_now;
+		soak_next += soak_period * 1000000000LL;
+		soak_rotate();
+	}
+
+	acq_join();
+	if (hotplug)
+		iio_watch_close(&iio_watch);
+	if (daemon_socket)
+		control_stop(&control);
+	if (soak_period) {
+		soak_snapshot(&soak_now, fp_writes, missed);
+		snprintf(label, sizeof(label), "segment %u", soak_segment);
+		soak_stats_print(stdout, label, &soak_prev, &soak_now);
+		soak_stats_print(stdout, "total", &soak_first, &soak_now);
+	}
+	if (acq.fd >= 0)
+		close(acq.fd);
+	if (!device_lost)
+		switch_streaming(0);
+	close_log();
+
+	acq_stats(&fa);
+	printf("%u scans in %u reads\n", acq.nscans, acq.nreads);
+	printf("frames: complete %u, incomplete %u, late scans %u\n",
+		fa.complete, fa.incomplete, fa.late);
+	printf("frame ring: capacity %u, pushed %u, dropped %u, high water %u\n",
+		frame_ring_capacity(&frames), atomic_load(&frames.pushed),
+		atomic_load(&frames.dropped), atomic_load(&frames.high_water));
+	algo_stats_dump();
+	worker_pool_stats_dump(&algo_pool, stdout);
+	sem_destroy(&acq.ready);
+	frame_ring_free(&frames);
+	if (sysfs_trace_on)
+		sysfs_trace_dump(stdout);
+
+	printf("frames: expected %d, processed %d\n", counter, fp_writes);
+	latency_dump();
+}
 
+/*! \struct startup_config
+ * Arguments and result of the configuration startup step.
+ */
+struct startup_config {
+	int dur;
+	int sample;
+	int freq;
+	int counter;
+};
+
+static int discover_device(void *arg)
+{
 	if (process_sysfs_request(sysfs_path) < 0) {
 		printf("Cannot find %s sysfs path\n", CHIRP_NAME);
-		exit(0);
+		return -ENODEV;
 	}
 
 	// printf("%s sysfs path: %s, dev path=%s\n",CHIRP_NAME, sysfs_path, dev_path);
+	return 0;
+}
 
-	if(loadFirmware() == -EINVAL){
-		return -EINVAL;
+static int configure_sensors(void *arg)
+{
+	struct startup_config *cfg = arg;
+
+	cfg->counter = confSensors(cfg->dur, cfg->sample, cfg->freq);
+
+	return 0;
+}
+
+/*
+ * Startup graph: finding the device and checking both firmware images
+ * against the manifest run concurrently, the firmware load waits for all
+ * three and the sensor configuration for the firmware.
+ */
+int init(int dur, int sample, int freq){
+	struct startup_config cfg = { dur, sample, freq, 0 };
+	struct startup_step steps[STARTUP_MAX_STEPS] = {
+		{ .name = "discovery", .run = discover_device },
+	};
+	unsigned int configure_deps = STARTUP_STEP(0);
+	int n = 1, ret;
+	long i;
+
+	printf("\n\nTDK-Robotics-RB5-chx01-app-%d.%d\n\n",VER_MAJOR, VER_MINOR);
+	start_signal_thread();
+	// printf("RangeFinder version: %s\n", invn_algo_rangefinder_version());
+
+	if (load_fw) {
+		for (i = 0; i < (long)ARRAY_SIZE(fw_defaults); i++) {
+			steps[n].name = i ? "ch201 image" : "ch101 image";
+			steps[n].run = prepare_default_image;
+			steps[n].arg = (void *)i;
+			n++;
+		}
+		steps[n].name = "firmware";
+		steps[n].run = load_default_firmware;
+		steps[n].deps = STARTUP_STEP(n) - 1;
+		configure_deps = STARTUP_STEP(n);
+		n++;
 	}
+	steps[n].name = "configuration";
+	steps[n].run = configure_sensors;
+	steps[n].arg = &cfg;
+	steps[n].deps = configure_deps;
+	n++;
+
+	ret = startup_run(steps, n);
+	for (i = 0; i < (long)ARRAY_SIZE(fw_defaults); i++)
+		firmware_image_close(&fw_images[i]);
+	startup_print(stdout, steps, n);
+	if (load_fw)
+		printf("firmware %s\n", firmware_status);
+
+	if (steps[0].ret)
+		exit(0);
+	if (ret)
+		return -EINVAL;
+
+	return cfg.counter;
+}
 
-	int counter = confSensors(dur,sample,freq);
+/* frame assembled by the single-threaded getData2()/pollData() paths */
+static struct chx01_frame poll_frame;
+static struct frame_assembler poll_assembler;
 
-	return counter;
+static struct chx01_frame *poll_get_frame(void *ctx)
+{
+	return &poll_frame;
+}
 
+static void poll_put_frame(void *ctx, struct chx01_frame *frame, int complete)
+{
 }
 
+static const struct frame_assembler_ops poll_frame_ops = {
+	.get = poll_get_frame,
+	.put = poll_put_frame,
+};
+
 void getData2(int counter){
-	int target_bytes;
-	char *buffer;
-	buffer = (char *)orig_buffer;
-	long long timestamp, last_timestamp;
+	char *buffer = scan_buffer;
 	int ready;
-	int c, fp_writes;
+	int fp_writes;
 	struct pollfd pfds[1];
-	int nfds, num_open_fds;
-	int bytes;
-	int total_bytes;
-	int i,j;
-	unsigned int retry = 0;
-
-	last_timestamp = 0;
-	timestamp = 0;
+	int nfds;
+	int scans;
 
 	pfds[0].fd = open(dev_path, O_RDONLY);
 	printf("DEVPATH: %s\n", dev_path);
 	pfds[0].events = (POLLIN | POLLRDNORM | POLLERR | POLLNVAL);
-	last_timestamp = 0;
-  
+
 	ready = 1;
 	fp_writes = 1;
-	int index = 0; //redefined in confSensors
-
-	
-
-	char *tmp;
-	short value;
-	char *ptr;
-	int dev_num;
+	frame_assembler_init(&poll_assembler, &layout, &poll_frame_ops, NULL);
 
 	pfds[0].revents = 0;
 	//printf("before new polling counter=%d\n", counter);
@@ -1196,102 +1983,21 @@ void getData2(int counter){
 		printf("poll error\n");
 
 	if (pfds[0].revents & (POLLIN | POLLRDNORM)) {
-		target_bytes = scan_bytes;
-		//printf("target bytes=%d and fd = %d\n",target_bytes,pfds[0].fd);
-
-		bytes = read(pfds[0].fd, buffer, target_bytes);
-		if(bytes < 0)
-		{
-			printf("Read IIO buffer error: %s\n", strerror(errno));
+		scans = read_scans(pfds[0].fd, buffer, 1);
+		if (scans < 0) {
+			printf("Read IIO buffer error: %s\n", strerror(-scans));
+			return;
+		} else if (scans > 0) {
+			if (frame_assembler_push(&poll_assembler, buffer))
+				fp_writes++;
+		} else {
+			printf("Max retry reached\n");
 			return;
 		}
-		else if (bytes == target_bytes){
-		total_bytes += bytes;
-		tmp = (char *)&timestamp;
-		memcpy(tmp, &buffer[scan_bytes - 8], 8);
-		//printf("ts %lld\n",timestamp);
-	//amplitude 2 bytes + intensity data
-	//2 bytes 224/8 = 28bytes(IQ)+mode(1 bytes)
-		target_bytes = scan_bytes-32;
-		i = 0;
-		//for (i = 0; i < 64; i++) {
-		//	printf("%d, ", buffer[i]);
-		//}
-		//printf("\n");
-		if (last_timestamp == 0)
-			last_timestamp = timestamp;
-
-		if (last_timestamp != timestamp) {
-
-			index -= 7;
-			fp_writes++;
-			// log_data(fp_writes, num_sensors, sample, log_fp,
-			// 	last_timestamp);
-
-			index = 0;
-			last_timestamp = timestamp;
-		}
-
-		//printf("\nindex=%d\n", index);
-		for (j = 0; j < num_sensors; j++) {
-			//printf("j = %d\n", j);
-			for (i = 0; i < 7; i++) {
-				//printf("\ni=%d\n", (i+index));
-				value = buffer[i*4+1+j*28];
-				value <<= 8;
-				value += buffer[i*4+j*28];
-				I[j][i+index] = value;
-				
-				value = buffer[i*4+3+j*28];
-				value <<= 8;
-				value += buffer[i*4+2+j*28];
-				Q[j][i+index] = value;
-				//printf("%d, %d", I[j][i], Q[j][i]);
-			}
-		}
-
-		//printf("\n");
-		index += 7;
-
-		ptr = buffer + 28*num_sensors;
-
-		// printf("Here11");
-		for (j = 0; j < num_sensors; j++) {
-			distance[j] = ptr[1+j*2];
-			distance[j] <<= 8;
-			distance[j] += ptr[j*2];
-			
-			printf("distance[%d]=%d\n", j, distance[j]);
-		}
-
-
-		ptr += 2*num_sensors;
-
-		for (j = 0; j < num_sensors; j++) {
-			amplitude[j] = ptr[1+j*2];
-			amplitude[j] <<= 8;
-			amplitude[j] += ptr[j*2];
-		}
-
-		ptr += 2*num_sensors;
-
-		for (j = 0; j < num_sensors; j++)
-			mode[j] = ptr[j];
-		}
-		else
-		{
-			printf("Expected %d bytes, read %d\n",bytes,target_bytes);
-			retry++;
-			if(retry < 6)
-			{
-				printf("Max retry reached\n");
-				return;
-			}
-		}	
 	}
 
 	switch_streaming(0);
-	fclose(log_fp);
+	close_log();
 
 	if (fp_writes == counter)
 	printf("PASS: setting=%d, get=%d\n", counter, fp_writes);
@@ -1300,79 +2006,50 @@ void getData2(int counter){
 
 }
 
+
 void getPositionRelativeData(int chirp_sensor_number){
 	
 	printf("Start of getPositionRelativeData\n");
-	// Global array of file paths
-	char* filePaths[] = {FILE_PATH_0, FILE_PATH_1, FILE_PATH_2, FILE_PATH_3, FILE_PATH_4, FILE_PATH_5};
-	
-	int i;
-	FILE *fp;
-	char file_name[100];
 
-	strcpy(file_name,filePaths[chirp_sensor_number]);
+	int dist;
 
-	fp = fopen(file_name, "rt");
-	// printf("filename:: %s :\n", file_name);
-	// printf("Check Sensor Connection :: sysfs_path:: %s :\n", sysfs_path);
-	if (fp == NULL) {
-		printf("error opening %s\n", file_name);
+	if (sysfs_attr_read_int(&attrs.position_raw[chirp_sensor_number],
+			&dist) < 0) {
+		printf("error opening %s\n",
+			attrs.position_raw[chirp_sensor_number].path);
 		exit(0);
-	} else {
-		//printf("open %s OK\n", file_name);
 	}
 
-	uint32_t dist;
-
-	fscanf(fp, "%d", &dist);
-	fclose(fp);
-
 	if (dist){
 		printf("Sensor #%d, Dist: %d\n",chirp_sensor_number,dist);
 	}
 	else{
 		printf("Sensor #%d, Not Connected\n",chirp_sensor_number);
 	}
-	
-	return 0;
 }
 
 void pollData(int frequency){
 	//set frequency
 	//poll infinitely 
 
-	int target_bytes;
-	char *buffer;
-	buffer = (char *)orig_buffer;
-	long long timestamp, last_timestamp;
+	char *buffer = scan_buffer;
 	int ready;
-	int c, fp_writes;
 	struct pollfd pfds[1];
-	int nfds, num_open_fds;
-	int bytes;
-	int total_bytes;
-	int i,j;
+	int nfds;
+	int scans, batch;
+	int s;
 	unsigned int retry = 0;
 
-	last_timestamp = 0;
-	timestamp = 0;
-
 	pfds[0].fd = open(dev_path, O_RDONLY);
 	printf("DEVPATH: %s\n", dev_path);
 	pfds[0].events = (POLLIN | POLLRDNORM | POLLERR | POLLNVAL);
-	last_timestamp = 0;
-  
+
+	batch = scans_per_read();
+	frame_assembler_init(&poll_assembler, &layout, &poll_frame_ops, NULL);
 	ready = 1;
-	fp_writes = 1;
-	int index = 0; //redefined in confSensors
 	int cnt = 0;
 	// setCnt(10);
 	while (1) {
-		char *tmp;
-		short value;
-		char *ptr;
-		int dev_num;
-
 		pfds[0].revents = 0;
 		//printf("before new polling counter=%d\n", counter);
 		nfds = 1;
@@ -1383,149 +2060,291 @@ void pollData(int frequency){
 			printf("poll error\n");
 
 		if (pfds[0].revents & (POLLIN | POLLRDNORM)) {
-     		target_bytes = scan_bytes;
-			//printf("target bytes=%d and fd = %d\n",target_bytes,pfds[0].fd);
-			bytes = read(pfds[0].fd, buffer, target_bytes);
-            if(bytes < 0)
-			{
-				printf("Read IIO buffer error: %s\n", strerror(errno));
-                break;
-			}
-            else if (bytes == target_bytes){
-			total_bytes += bytes;
-			tmp = (char *)&timestamp;
-			memcpy(tmp, &buffer[scan_bytes - 8], 8);
-			//printf("ts %lld\n",timestamp);
-	//amplitude 2 bytes + intensity data
-	//2 bytes 224/8 = 28bytes(IQ)+mode(1 bytes)
-			target_bytes = scan_bytes-32;
-			i = 0;
-			//for (i = 0; i < 64; i++) {
-			//	printf("%d, ", buffer[i]);
-			//}
-			//printf("\n");
-			if (last_timestamp == 0)
-				last_timestamp = timestamp;
-
-			if (last_timestamp != timestamp) {
-
-				index -= 7;
-				fp_writes++;
-				// log_data(fp_writes, num_sensors, sample, log_fp,
-				// 	last_timestamp);
-
-				index = 0;
-				last_timestamp = timestamp;
-			}
-
-			//printf("\nindex=%d\n", index);
-			for (j = 0; j < num_sensors; j++) {
-				//printf("j = %d\n", j);
-				for (i = 0; i < 7; i++) {
-					//printf("\ni=%d\n", (i+index));
-					value = buffer[i*4+1+j*28];
-					value <<= 8;
-					value += buffer[i*4+j*28];
-					I[j][i+index] = value;
-					
-					value = buffer[i*4+3+j*28];
-					value <<= 8;
-					value += buffer[i*4+2+j*28];
-					Q[j][i+index] = value;
-					//printf("%d, %d", I[j][i], Q[j][i]);
+			scans = read_scans(pfds[0].fd, buffer, batch);
+			if (scans < 0) {
+				printf("Read IIO buffer error: %s\n", strerror(-scans));
+				break;
+			} else if (scans > 0) {
+				retry = 0;
+				for (s = 0; s < scans; s++)
+					frame_assembler_push(&poll_assembler,
+						buffer + s * scan_bytes);
+			} else {
+				if (++retry >= 6) {
+					printf("Max retry reached\n");
+					break;
 				}
 			}
-
-			//printf("\n");
-			index += 7;
-
-			ptr = buffer + 28*num_sensors;
-
-			// printf("Here11");
-			for (j = 0; j < num_sensors; j++) {
-				distance[j] = ptr[1+j*2];
-				distance[j] <<= 8;
-				distance[j] += ptr[j*2];
-				
-				printf("distance[%d]=%d\n", j, distance[j]);
-			}
-
-
-			ptr += 2*num_sensors;
-
-			for (j = 0; j < num_sensors; j++) {
-				amplitude[j] = ptr[1+j*2];
-				amplitude[j] <<= 8;
-				amplitude[j] += ptr[j*2];
-			}
-
-			ptr += 2*num_sensors;
-
-			for (j = 0; j < num_sensors; j++)
-				mode[j] = ptr[j];
-			}	
-			else
-			{
-                printf("Expected %d bytes, read %d\n",bytes,target_bytes);
-				retry++;
-				if(retry < 6)
-				{
-				  printf("Max retry reached\n");
-				  break;
-				}
-			}	
 		}
 		// setCnt(10);
 	}
 	switch_streaming(0);
-	fclose(log_fp);
+	close_log();
 }
 
 void setFreq(int freq){
-
-	char* fn = "/sys/bus/iio/devices/iio:device0/sampling_frequency";
 	//sets freq
-	fp = fopen(fn, "wt");
-	if (fp == NULL) {
-		printf("error opening %s\n", fn);
-		exit(0);
-	} else {
-		printf("set freq open %s OK\n", fn);
-	}
-	fprintf(fp, "%d", freq);
-	fclose(fp);
+	write_attr(&attrs.sampling_frequency, freq);
+	printf("set freq %d on %s\n", freq, attrs.sampling_frequency.path);
 }
 
+/* counter controls how many times it will run. Called once per poll, so
+ * this is a single pwrite() on an already open attribute. */
 void setCnt(int cnt){
-	char* fn = "/sys/bus/iio/devices/iio:device0/calibbias";
-	printf("counter=%d\n", cnt);
-
-	// counter controls how many times it will run.
-	// snprintf(fn, 100, "%s/calibbias", sysfs_path);
-	fp = fopen(fn, "wt");
-	if (fp == NULL) {
-		printf("error opening %s\n", fn);
+	write_attr(&attrs.calibbias, cnt);
+}
+
+
+
+static void start_algo_pool(void)
+{
+	if (algo_workers <= 0)
+		algo_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (worker_pool_init(&algo_pool, algo_workers, algo_cpus,
+			algo_ncpus) < 0) {
+		printf("Cannot start the algorithm workers\n");
 		exit(0);
-	} else {
-		printf("open %s OK\n", fn);
 	}
-	fprintf(fp, "%d", cnt);
-	fclose(fp);
 }
 
+static struct chx01_frame replay_frame;
+
+/**
+ * replayData() - run a recorded session through the algorithms
+ * @path: CSV log or binary capture
+ *
+ * The sensor setup comes from the recording. Frames keep their original
+ * timestamps and go through the same log_data()/run_algos() path as live
+ * ones, unpaced or on a clock scaled by -x. A log is written only if -l or
+ * -c was given.
+ **/
+static void replayData(const char *path)
+{
+	struct replay_source src;
+	struct chx01_frame *frame = &replay_frame;
+	struct timespec start, end;
+	unsigned int frames = 0;
+	double seconds;
+	int ret, i;
+
+	ret = replay_open(&src, path, replay_speed);
+	if (ret) {
+		printf("cannot replay %s: %s\n", path, strerror(-ret));
+		return;
+	}
+
+	num_sensors = src.info.num_sensors;
+	num_samples = src.info.num_samples;
+	for (i = 0; i < 6; i++) {
+		sensor_connected[i] = src.info.sensor_connected[i];
+		op_freq[i] = src.info.op_freq[i];
+		port_map[i] = src.info.port_map[i];
+		sensor_connection[i] = src.info.sensor_connection[i];
+	}
+	reset_algos();
+	if (log_requested) {
+		log_info = src.info;
+		start_log();
+	}
+
+	printf("replaying %s %s: %d sensors, %d samples, %d Hz, %s\n",
+		replay_kind_name(&src), path, num_sensors,
+		num_samples, src.info.frequency,
+		replay_speed > 0 ? "paced" : "as fast as possible");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((ret = replay_next(&src, frame)) > 0) {
+		frames++;
+		if (log_requested)
+			log_data(frames, num_sensors, num_samples, log_fp,
+				frame);
+		else
+			run_algos(num_sensors, num_samples, frame);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret < 0)
+		printf("replay stopped at frame %u: %s\n", frames,
+			strerror(-ret));
+
+	close_log();
+	if (src.kind == REPLAY_RAW) {
+		printf("raw reads: %u, %llu bytes, %u errors, %u torn\n",
+			src.raw.reads, src.raw.bytes, src.raw_errors,
+			src.raw_torn);
+		printf("frames: complete %u, incomplete %u, late scans %u\n",
+			src.assembler.stats.complete,
+			src.assembler.stats.incomplete,
+			src.assembler.stats.late);
+	}
+	replay_close(&src);
+
+	seconds = elapsed_ns(&start, &end) / 1e9;
+	printf("replay: %u frames in %.3f s, %.1f frames/s\n", frames,
+		seconds, seconds > 0 ? frames / seconds : 0);
+	algo_stats_dump();
+	worker_pool_stats_dump(&algo_pool, stdout);
+}
+
+enum {
+	OPT_FORCE_FIRMWARE = 256,
+};
 
+static const struct option long_options[] = {
+	{ "force-firmware", no_argument, NULL, OPT_FORCE_FIRMWARE },
+	{ NULL, 0, NULL, 0 },
+};
 
 int main(int argc, char *argv[])
 {
 	int dur = 10;
 	int sample = 500;
 	int freq = 5;
+	int opt;
+
+	memcpy(port_map, chx01_port_map, sizeof(port_map));
+	while ((opt = getopt_long(argc, argv,
+			"hd:s:f:l:c:w:W:P:S:nb:tvr:p:x:j:A:CF::D:ORL:U:",
+			long_options, NULL)) != -1) {
+		switch (opt) {
+		case OPT_FORCE_FIRMWARE:
+			force_firmware = 1;
+			break;
+		case 'd':
+			dur = atoi(optarg);
+			break;
+		case 's':
+			sample = atoi(optarg);
+			break;
+		case 'f':
+			freq = atoi(optarg);
+			break;
+		case 'l':
+			log_file = optarg;
+			log_requested = 1;
+			break;
+		case 'c':
+			capture_file = optarg;
+			log_requested = 1;
+			break;
+		case 'w':
+			raw_file = optarg;
+			break;
+		case 'p':
+			replay_file = optarg;
+			break;
+		case 'x':
+			replay_speed = atof(optarg);
+			break;
+		case 'W':
+			log_buffer_kib = atoi(optarg);
+			break;
+		case 'P':
+			log_prealloc_mib = atoi(optarg);
+			break;
+		case 'S':
+			log_sync_every = atoi(optarg);
+			break;
+		case 'n':
+			load_fw = 0;
+			break;
+		case 'b':
+			scan_batch = atoi(optarg);
+			break;
+		case 't':
+			sysfs_trace_on = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'r':
+			sysfs_root = optarg;
+			break;
+		case 'j':
+			algo_workers = atoi(optarg);
+			break;
+		case 'A':
+			algo_ncpus = worker_pool_parse_cpus(optarg, algo_cpus,
+				ARRAY_SIZE(algo_cpus));
+			if (algo_ncpus < 0) {
+				print_help();
+				return 0;
+			}
+			break;
+		case 'C':
+			do_cliff = 1;
+			break;
+		case 'F':
+			do_floor_type = 1;
+			if (optarg)
+				floor_distance_mm = atoi(optarg);
+			break;
+		case 'D':
+			floor_sensors = chx01_parse_ports(optarg);
+			if (floor_sensors == 0) {
+				print_help();
+				return 0;
+			}
+			break;
+		case 'O':
+			do_obstacle_detect = 1;
+			break;
+		case 'R':
+			do_range_finder = 1;
+			break;
+		case 'U':
+			daemon_socket = optarg;
+			break;
+		case 'L':
+			soak_period = atoi(optarg);
+			if (soak_period <= 0) {
+				print_help();
+				return 0;
+			}
+			break;
+		case 'h':
+		default:
+			print_help();
+			return 0;
+		}
+	}
+
+	if (replay_file) {
+		start_algo_pool();
+		replayData(replay_file);
+		worker_pool_destroy(&algo_pool);
+		return 0;
+	}
+
+	if (daemon_socket && (soak_period || raw_file)) {
+		printf("-U cannot be used with -L or -w\n");
+		return 0;
+	}
+	if (soak_period) {
+		/* a single raw capture would grow for the whole test */
+		if (raw_file) {
+			printf("-w cannot be used with -L\n");
+			return 0;
+		}
+		soak_seconds = dur;
+		soak_log_base = log_file;
+		soak_capture_base = capture_file;
+		soak_name_log();
+	}
+
 	int counter = init(dur,sample,freq);
+	if (counter < 0) {
+		//the sensors are not configured, there is nothing to stream
+		printf("startup failed, exiting\n");
+		exit(0);
+	}
+
+	start_algo_pool();
 
 	setCnt(10);
-	setFreq(5);
+	setFreq(freq);
 
 	getData(counter);
+	worker_pool_destroy(&algo_pool);
 
 	// getData2(counter);
 
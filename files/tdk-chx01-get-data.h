@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_GET_DATA_H_
+#define _TDK_CHX01_GET_DATA_H_
+
+/*
+ * Session API of libtdk-chx01-get-data.so. A session owns one ch101 IIO
+ * device: its sysfs attributes, sensor setup, character device, frame
+ * assembler, InvenSense algorithm states and log. Nothing is shared between
+ * sessions, so several of them can run at once, one per thread or device.
+ * A session itself is not locked, call it from one thread at a time.
+ *
+ *   chx01_session_create(&s, "", 0);
+ *   chx01_session_configure(s, &cfg);
+ *   chx01_session_log_open(s, "/usr/chirp.csv", CHX01_LOG_CSV);
+ *   chx01_session_start(s);
+ *   while (chx01_session_next_frame(s, &frame, 1000) > 0)
+ *           ...
+ *   chx01_session_stop(s);
+ *   chx01_session_destroy(s);
+ *
+ * Frames come out as struct chx01_frame, with the distances and amplitudes
+ * of the RangeFinder when it runs, and are logged like the application
+ * logs them.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_NUM_SENSORS		6
+#define MAX_NUM_SAMPLES		450
+
+#define CHX01_FW_NAME_LEN	32
+
+/* InvenSense algorithms run on the frames */
+enum algo_kind {
+	ALGO_RANGE,
+	ALGO_FLOOR_TYPE,
+	ALGO_CLIFF,
+	ALGO_KINDS,
+};
+
+#define ALGO_FLAG(kind)		(1u << (kind))
+
+/*! \struct chx01_frame
+ * One measurement of all connected sensors, i.e. every scan sharing the same
+ * IIO timestamp. IQ samples are kept interleaved per sensor,
+ * iq[j][2*i] = I[i] and iq[j][2*i+1] = Q[i], which is what the InvenSense
+ * algorithms take as iq_buffer.
+ */
+struct chx01_frame {
+	long long timestamp;
+	int index;		/* IQ samples filled so far */
+	int16_t iq[MAX_NUM_SENSORS][2 * MAX_NUM_SAMPLES];
+	unsigned short distance[MAX_NUM_SENSORS];
+	unsigned short amplitude[MAX_NUM_SENSORS];
+	char mode[MAX_NUM_SENSORS];
+};
+
+/*! \struct chx01_log_info
+ * Sensor setup a log was recorded with, everything needed besides the
+ * frames themselves to write the CSV log. Port arrays are indexed like
+ * sensor_connected[], scan-order arrays like the frame.
+ */
+struct chx01_log_info {
+	int num_sensors;			/* sensors in scan order */
+	int num_samples;			/* IQ samples per sensor */
+	int frequency;				/* measurements per second */
+	int sensor_connected[MAX_NUM_SENSORS];	/* per port */
+	uint32_t op_freq[MAX_NUM_SENSORS];	/* per port, Hz */
+	int8_t port_map[MAX_NUM_SENSORS];	/* per port, ID in the log */
+	char sensor_connection[MAX_NUM_SENSORS];	/* scan order to port */
+	char firmware[MAX_NUM_SENSORS][CHX01_FW_NAME_LEN];	/* per port, "" if not loaded */
+};
+
+/*! \struct frame_assembler_stats
+ * Frame assembler counters.
+ */
+struct frame_assembler_stats {
+	unsigned int scans;		/* scans pushed */
+	unsigned int complete;		/* frames emitted */
+	unsigned int incomplete;	/* frames torn by a timestamp change */
+	unsigned int late;		/* scans received after their frame was full */
+};
+
+struct chx01_session;
+
+/*! \struct chx01_session_config
+ * Measurement setup, the same for every connected sensor.
+ */
+struct chx01_session_config {
+	int num_samples;	/* IQ samples per sensor, capped at 225 */
+	int frequency;		/* measurements per second, capped at 100 */
+	int scans_per_read;	/* read() batch and IIO watermark, 0: one frame */
+	unsigned int algos;	/* ALGO_FLAG() of the algorithms to run on
+				 * each frame, 0: driver distances only */
+	unsigned int floor_sensors;	/* sensor_connected[] bitmask of the
+					 * floor type sensors, 0: port 6 */
+	int floor_distance_mm;	/* of the floor type sensors, 0: 33 */
+};
+
+/*! \struct chx01_session_result
+ * Algorithm outputs of the last frame, in scan order. Negative where the
+ * algorithm did not run on the sensor or failed.
+ */
+struct chx01_session_result {
+	int range_status[MAX_NUM_SENSORS];
+	int floor_type[MAX_NUM_SENSORS];	/* 0 soft, 1 hard */
+	int cliff[MAX_NUM_SENSORS];		/* 0 floor, 1 ambiguous, 2 cliff */
+};
+
+enum chx01_log_format {
+	CHX01_LOG_CSV,		/* same CSV log as the application */
+	CHX01_LOG_CAPTURE,	/* binary capture, see tdk-chx01-cap2csv */
+};
+
+/**
+ * chx01_session_create() - open a session on a ch101 device
+ * @sp: new session
+ * @root: prefix of the sysfs and /dev paths, "" on the target, the root of
+ *	tdk-chx01-emu otherwise
+ * @nth: 0 for the ch101 device with the lowest iio:deviceN, 1 for the next
+ *
+ * Return: 0 on success, -ENODEV if there is no such device, -errno on
+ * failure.
+ **/
+int chx01_session_create(struct chx01_session **sp, const char *root,
+	int nth);
+
+/**
+ * chx01_session_load_firmware() - load one firmware image into the sensors
+ * @s: session, not streaming
+ * @dir: directory of the image and of its manifest, with a trailing slash
+ * @name: image name, e.g. ch101_gpr_rxopt_v41b.bin
+ *
+ * The image is checked against the manifest before it is written.
+ *
+ * Return: 0 on success, -ESRCH if not in the manifest, -EMSGSIZE or
+ * -EBADMSG if it does not match it, -errno on failure.
+ **/
+int chx01_session_load_firmware(struct chx01_session *s, const char *dir,
+	const char *name);
+
+/**
+ * chx01_session_configure() - detect the sensors and write the setup
+ * @s: session, not streaming
+ * @cfg: setup
+ *
+ * The algorithm states start over.
+ *
+ * Return: 0 on success, -ENODEV if no sensor answers, -EBUSY while
+ * streaming or logging, -errno on failure.
+ **/
+int chx01_session_configure(struct chx01_session *s,
+	const struct chx01_session_config *cfg);
+
+/* enable the buffer, the device is opened on the first start */
+int chx01_session_start(struct chx01_session *s);
+
+/**
+ * chx01_session_next_frame() - wait for the next complete frame
+ * @s: streaming session
+ * @frame: destination
+ * @timeout_ms: longest wait for data, -1 for none
+ *
+ * The configured algorithms run on the frame before it is logged and
+ * returned, see chx01_session_result().
+ *
+ * Return: 1 with a frame, 0 on timeout, -ENODEV once the device is gone,
+ * -errno on failure.
+ **/
+int chx01_session_next_frame(struct chx01_session *s,
+	struct chx01_frame *frame, int timeout_ms);
+
+/* algorithm outputs of the last frame returned by next_frame */
+void chx01_session_result(const struct chx01_session *s,
+	struct chx01_session_result *r);
+
+/**
+ * chx01_session_log_open() - log every frame returned by next_frame
+ * @s: configured session
+ * @path: file name, truncated if it exists
+ * @format: CSV log or binary capture
+ *
+ * The file is written by a thread of its own, a slow storage does not
+ * delay the frames.
+ *
+ * Return: 0 on success, -EBUSY if a log is already open, -EINVAL if not
+ * configured, -errno on failure.
+ **/
+int chx01_session_log_open(struct chx01_session *s, const char *path,
+	enum chx01_log_format format);
+
+/* Return: 0, or the first error writing the log */
+int chx01_session_log_close(struct chx01_session *s);
+
+/* disable the buffer and drop the queued scans, the setup is kept and the
+ * device stays open until destroy */
+int chx01_session_stop(struct chx01_session *s);
+
+/* stops the session and closes the log if needed */
+void chx01_session_destroy(struct chx01_session *s);
+
+/* sensor setup of a configured session */
+const struct chx01_log_info *chx01_session_info(const struct chx01_session *s);
+
+/* assembler counters since the session was created */
+void chx01_session_stats(const struct chx01_session *s,
+	struct frame_assembler_stats *st);
+
+/* sysfs directory of the device, e.g. /sys/bus/iio/devices/iio:device4 */
+const char *chx01_session_device(const struct chx01_session *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
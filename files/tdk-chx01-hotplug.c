@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tdk-chx01-hotplug.h"
+
+#define IIO_WATCH_BUF		4096
+
+int iio_device_is(const char *iio_dir, int num, const char *name)
+{
+	char path[256], found[64];
+	FILE *fp;
+	int ret;
+
+	if (num < 0)
+		return 0;
+	snprintf(path, sizeof(path), "%s" IIO_DEV_PREFIX "%d/name", iio_dir,
+		num);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+	ret = fscanf(fp, "%63s", found);
+	fclose(fp);
+
+	return ret == 1 && strcmp(found, name) == 0;
+}
+
+int iio_device_find(const char *iio_dir, const char *name, int nth)
+{
+	const struct dirent *ent;
+	DIR *dp;
+	int prev = -1, best = -1, num, i;
+	char c;
+
+	dp = opendir(iio_dir);
+	if (dp == NULL)
+		return -errno;
+
+	/* readdir() order is arbitrary, take the indexes in turn */
+	for (i = 0; i <= nth; i++) {
+		best = -1;
+		rewinddir(dp);
+		while ((ent = readdir(dp)) != NULL) {
+			if (sscanf(ent->d_name, IIO_DEV_PREFIX "%d%c", &num,
+					&c) != 1)
+				continue;
+			if (num <= prev || (best >= 0 && num >= best))
+				continue;
+			if (iio_device_is(iio_dir, num, name))
+				best = num;
+		}
+		if (best < 0)
+			break;
+		prev = best;
+	}
+	closedir(dp);
+
+	return best < 0 ? -ENODEV : best;
+}
+
+static int open_uevent(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,		/* kernel events, not udev's */
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int iio_watch_open(struct iio_watch *w, const char *dev_dir, int uevents)
+{
+	w->uevent = uevents ? open_uevent() : -1;
+	w->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w->inotify >= 0 && inotify_add_watch(w->inotify, dev_dir,
+			IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO |
+			IN_MOVED_FROM) < 0) {
+		close(w->inotify);
+		w->inotify = -1;
+	}
+	if (w->inotify < 0 && w->uevent < 0)
+		return -ENODEV;
+
+	return 0;
+}
+
+/* the device nodes come and go as iio:deviceN */
+static int read_inotify(int fd)
+{
+	char buf[IIO_WATCH_BUF]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+	int found = 0;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			/* events were lost, assume ours was one of them */
+			if (ev->mask & IN_Q_OVERFLOW)
+				found = 1;
+			if (ev->len && strncmp(ev->name, IIO_DEV_PREFIX,
+					strlen(IIO_DEV_PREFIX)) == 0)
+				found = 1;
+		}
+	}
+
+	return found;
+}
+
+/* "ACTION@DEVPATH" then NUL separated KEY=value pairs */
+static int read_uevent(int fd)
+{
+	char buf[IIO_WATCH_BUF];
+	ssize_t len;
+	char *p;
+	int found = 0;
+
+	while ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = '\0';
+		for (p = buf; p < buf + len; p += strlen(p) + 1) {
+			if (strcmp(p, "SUBSYSTEM=iio") == 0)
+				found = 1;
+		}
+	}
+
+	return found;
+}
+
+int iio_watch_wait(struct iio_watch *w, int timeout_ms)
+{
+	struct pollfd pfds[2];
+	int n = 0, ret, found = 0;
+
+	if (w->inotify >= 0) {
+		pfds[n].fd = w->inotify;
+		pfds[n++].events = POLLIN;
+	}
+	if (w->uevent >= 0) {
+		pfds[n].fd = w->uevent;
+		pfds[n++].events = POLLIN;
+	}
+
+	ret = poll(pfds, n, timeout_ms);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+	if (w->inotify >= 0)
+		found |= read_inotify(w->inotify);
+	if (w->uevent >= 0)
+		found |= read_uevent(w->uevent);
+
+	return found;
+}
+
+void iio_watch_close(struct iio_watch *w)
+{
+	if (w->inotify >= 0)
+		close(w->inotify);
+	if (w->uevent >= 0)
+		close(w->uevent);
+	w->inotify = -1;
+	w->uevent = -1;
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_HOTPLUG_H_
+#define _TDK_CHX01_HOTPLUG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IIO_DEV_PREFIX		"iio:device"
+
+/*! \struct iio_watch
+ * Notification of IIO devices coming and going. The /dev node of a device
+ * is created and removed by devtmpfs, which inotify sees, while sysfs does
+ * not report new directories at all. Kernel uevents cover setups where
+ * /dev is not devtmpfs.
+ */
+struct iio_watch {
+	int inotify;		/* watch on the /dev directory, -1 if none */
+	int uevent;		/* NETLINK_KOBJECT_UEVENT socket, -1 if none */
+};
+
+/**
+ * iio_device_is() - check a cached device index
+ * @iio_dir: IIO devices directory, with a trailing slash
+ * @num: N of iio:deviceN
+ * @name: expected driver name
+ *
+ * Return: 1 if iio:device@num exists and is named @name, 0 otherwise.
+ **/
+int iio_device_is(const char *iio_dir, int num, const char *name);
+
+/**
+ * iio_device_find() - look a device up by name
+ * @iio_dir: IIO devices directory, with a trailing slash
+ * @name: driver name
+ * @nth: 0 for the device of that name with the lowest index, 1 for the next
+ *
+ * Return: N of iio:deviceN, -ENODEV if there is no such device, -errno if
+ * @iio_dir cannot be read.
+ **/
+int iio_device_find(const char *iio_dir, const char *name, int nth);
+
+/**
+ * iio_watch_open() - start watching for IIO devices
+ * @w: watch
+ * @dev_dir: directory of the device nodes, /dev or the emulator's
+ * @uevents: also listen to kernel uevents, only meaningful on a real /sys
+ *
+ * Return: 0 if at least one notification source is open, -errno otherwise.
+ **/
+int iio_watch_open(struct iio_watch *w, const char *dev_dir, int uevents);
+
+/**
+ * iio_watch_wait() - wait for an IIO device to be added or removed
+ * @w: watch
+ * @timeout_ms: longest wait, events may be missed before the watch opened
+ *
+ * Return: 1 on an IIO event, 0 on timeout or unrelated events, -errno on
+ * failure.
+ **/
+int iio_watch_wait(struct iio_watch *w, int timeout_ms);
+
+void iio_watch_close(struct iio_watch *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "tdk-chx01-latency.h"
+
+#define LAT_HALF	(LAT_SUB_COUNT / 2)
+#define LAT_LIMIT	((1LL << LAT_MAX_BITS) - 1)
+
+static const struct {
+	const char *name;
+	clockid_t clock;
+} lat_clocks[] = {
+	{ "realtime",		CLOCK_REALTIME },
+	{ "monotonic",		CLOCK_MONOTONIC },
+	{ "monotonic_raw",	CLOCK_MONOTONIC_RAW },
+	{ "realtime_coarse",	CLOCK_REALTIME_COARSE },
+	{ "monotonic_coarse",	CLOCK_MONOTONIC_COARSE },
+	{ "boottime",		CLOCK_BOOTTIME },
+	{ "tai",		CLOCK_TAI },
+};
+
+int latency_clock_parse(const char *name, clockid_t *clock)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(lat_clocks) / sizeof(lat_clocks[0]); i++) {
+		if (strcmp(name, lat_clocks[i].name) == 0) {
+			*clock = lat_clocks[i].clock;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+long long latency_now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned int bucket_index(long long ns)
+{
+	int shift;
+
+	if (ns < LAT_SUB_COUNT)
+		return (unsigned int)ns;
+	if (ns > LAT_LIMIT)
+		ns = LAT_LIMIT;
+	shift = 63 - __builtin_clzll((unsigned long long)ns) -
+		(LAT_SUB_BITS - 1);
+
+	return shift * LAT_HALF + (unsigned int)(ns >> shift);
+}
+
+/* largest value of the bucket */
+static long long bucket_value(unsigned int index)
+{
+	int shift;
+
+	if (index < LAT_SUB_COUNT)
+		return index;
+	shift = index / LAT_HALF - 1;
+
+	return ((long long)(index - shift * LAT_HALF + 1) << shift) - 1;
+}
+
+void latency_hist_record(struct latency_hist *h, long long ns)
+{
+	long long max;
+
+	if (ns < 0) {
+		atomic_fetch_add_explicit(&h->negative, 1,
+			memory_order_relaxed);
+		return;
+	}
+
+	atomic_fetch_add_explicit(&h->counts[bucket_index(ns)], 1,
+		memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+
+	max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max,
+			&max, ns, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+long long latency_hist_percentile(const struct latency_hist *h, double p)
+{
+	unsigned long long target, seen = 0;
+	unsigned int total = atomic_load(&h->total);
+	long long max = atomic_load(&h->max);
+	unsigned int i;
+
+	if (total == 0)
+		return 0;
+
+	target = (unsigned long long)(p / 100 * total + 0.999999);
+	if (target < 1)
+		target = 1;
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += atomic_load_explicit(&h->counts[i],
+			memory_order_relaxed);
+		if (seen >= target)
+			return bucket_value(i) < max ? bucket_value(i) : max;
+	}
+
+	/* a sample landed while counting */
+	return max;
+}
+
+void latency_print_header(FILE *fp)
+{
+	fprintf(fp, "  %-18s %8s %10s %10s %10s %10s\n", "stage", "count",
+		"p50 us", "p99 us", "p99.9 us", "max us");
+}
+
+void latency_hist_print(FILE *fp, const char *name,
+	const struct latency_hist *h)
+{
+	unsigned int negative = atomic_load(&h->negative);
+
+	fprintf(fp, "  %-18s %8u %10.1f %10.1f %10.1f %10.1f", name,
+		atomic_load(&h->total),
+		latency_hist_percentile(h, 50) / 1000.0,
+		latency_hist_percentile(h, 99) / 1000.0,
+		latency_hist_percentile(h, 99.9) / 1000.0,
+		atomic_load(&h->max) / 1000.0);
+	if (negative)
+		fprintf(fp, "  (%u before the timestamp)", negative);
+	fputc('\n', fp);
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_LATENCY_H_
+#define _TDK_CHX01_LATENCY_H_
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-linear buckets: values below LAT_SUB_COUNT ns are exact, above that
+ * each power of two is split in LAT_SUB_COUNT / 2 buckets, so a value is
+ * known within 1/64 of itself. Values from 2^LAT_MAX_BITS ns, about 18
+ * minutes, land in the last bucket.
+ */
+#define LAT_SUB_BITS	7
+#define LAT_SUB_COUNT	(1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS	40
+#define LAT_BUCKETS	((LAT_MAX_BITS - LAT_SUB_BITS + 2) * (LAT_SUB_COUNT / 2))
+
+/*! \struct latency_hist
+ * Latency histogram in ns. Recording is lock free and may be done from any
+ * thread while another one prints the histogram.
+ */
+struct latency_hist {
+	atomic_uint counts[LAT_BUCKETS];
+	atomic_uint total;
+	atomic_uint negative;		/* samples before their reference */
+	atomic_llong max;
+};
+
+/**
+ * latency_clock_parse() - map an IIO current_timestamp_clock name
+ * @name: realtime, monotonic, monotonic_raw, realtime_coarse,
+ *	monotonic_coarse, boottime or tai
+ * @clock: matching clock id
+ *
+ * Return: 0 on success, -EINVAL on an unknown name.
+ **/
+int latency_clock_parse(const char *name, clockid_t *clock);
+
+/* now on @clock, in ns */
+long long latency_now(clockid_t clock);
+
+/**
+ * latency_hist_record() - add one sample
+ * @h: histogram
+ * @ns: latency, a negative one is only counted
+ **/
+void latency_hist_record(struct latency_hist *h, long long ns);
+
+/**
+ * latency_hist_percentile() - value below which @p percent of the samples are
+ * @h: histogram
+ * @p: percentile, 0 to 100
+ *
+ * Return: upper edge of the bucket holding the percentile, clamped to the
+ * largest sample, 0 when the histogram is empty.
+ **/
+long long latency_hist_percentile(const struct latency_hist *h, double p);
+
+/* print the table header for latency_hist_print() lines */
+void latency_print_header(FILE *fp);
+
+/* print the count, p50, p99, p99.9 and max of @h in us on one line */
+void latency_hist_print(FILE *fp, const char *name,
+	const struct latency_hist *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdk-chx01-logger.h"
+
+#define LOG_STREAM_BUFFER	(64 * 1024)
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* writer side: one queued buffer to the file */
+static void logger_flush_buffer(struct async_logger *lg, int idx)
+{
+	size_t len = lg->lens[idx];
+	long long start = now_us(), elapsed;
+	int ret;
+
+	if (lg->prealloc && lg->offset + (off_t)len > lg->allocated) {
+		/* not all filesystems support it, preallocation is a hint */
+		if (fallocate(lg->fd, FALLOC_FL_KEEP_SIZE, lg->allocated,
+				lg->prealloc) == 0)
+			lg->allocated += lg->prealloc;
+		else
+			lg->prealloc = 0;
+	}
+
+	ret = write_all(lg->fd, lg->bufs[idx], len);
+	if (ret == 0) {
+		lg->offset += len;
+		lg->stats.bytes += len;
+		lg->stats.writes++;
+		if (lg->sync_every && ++lg->unsynced >= lg->sync_every) {
+			if (fdatasync(lg->fd))
+				ret = -errno;
+			lg->stats.syncs++;
+			lg->unsynced = 0;
+		}
+	}
+	if (ret && atomic_load(&lg->error) == 0) {
+		atomic_store(&lg->error, ret);
+		printf("log writer: %s, dropping log data\n", strerror(-ret));
+	}
+
+	elapsed = now_us() - start;
+	if (elapsed > lg->stats.max_write_us)
+		lg->stats.max_write_us = elapsed;
+}
+
+static void *logger_thread(void *arg)
+{
+	struct async_logger *lg = arg;
+	int idx;
+
+	pthread_mutex_lock(&lg->lock);
+	for (;;) {
+		while (lg->head == lg->tail && !lg->stop)
+			pthread_cond_wait(&lg->filled, &lg->lock);
+		if (lg->head == lg->tail)
+			break;
+		idx = lg->head % ASYNC_LOG_BUFFERS;
+		pthread_mutex_unlock(&lg->lock);
+
+		logger_flush_buffer(lg, idx);
+
+		pthread_mutex_lock(&lg->lock);
+		lg->head++;
+		pthread_cond_signal(&lg->drained);
+	}
+	pthread_mutex_unlock(&lg->lock);
+
+	return NULL;
+}
+
+/* producer side: queue the active buffer and move to the next free one */
+static void logger_submit(struct async_logger *lg)
+{
+	pthread_mutex_lock(&lg->lock);
+	lg->tail++;
+	pthread_cond_signal(&lg->filled);
+	if (lg->tail - lg->head >= ASYNC_LOG_BUFFERS) {
+		lg->stats.stalls++;
+		do
+			pthread_cond_wait(&lg->drained, &lg->lock);
+		while (lg->tail - lg->head >= ASYNC_LOG_BUFFERS);
+	}
+	pthread_mutex_unlock(&lg->lock);
+
+	lg->lens[lg->tail % ASYNC_LOG_BUFFERS] = 0;
+}
+
+int async_logger_open(struct async_logger *lg, const char *path,
+	size_t buf_size, off_t prealloc, unsigned int sync_every)
+{
+	int i, ret;
+
+	memset(lg, 0, sizeof(*lg));
+	lg->buf_size = buf_size;
+	lg->prealloc = prealloc;
+	lg->sync_every = sync_every;
+
+	for (i = 0; i < ASYNC_LOG_BUFFERS; i++) {
+		/* page aligned, the writes go straight to the page cache */
+		if (posix_memalign((void **)&lg->bufs[i], 4096, buf_size)) {
+			ret = -ENOMEM;
+			goto err_free;
+		}
+	}
+
+	lg->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (lg->fd < 0) {
+		ret = -errno;
+		goto err_free;
+	}
+
+	pthread_mutex_init(&lg->lock, NULL);
+	pthread_cond_init(&lg->filled, NULL);
+	pthread_cond_init(&lg->drained, NULL);
+	ret = pthread_create(&lg->thread, NULL, logger_thread, lg);
+	if (ret) {
+		ret = -ret;
+		close(lg->fd);
+		goto err_free;
+	}
+
+	return 0;
+
+err_free:
+	for (i = 0; i < ASYNC_LOG_BUFFERS; i++)
+		free(lg->bufs[i]);
+	memset(lg, 0, sizeof(*lg));
+	lg->fd = -1;
+	return ret;
+}
+
+int async_logger_write(struct async_logger *lg, const void *data, size_t len)
+{
+	const char *p = data;
+	size_t n;
+	int idx;
+
+	while (len) {
+		idx = lg->tail % ASYNC_LOG_BUFFERS;
+		n = lg->buf_size - lg->lens[idx];
+		if (n > len)
+			n = len;
+		memcpy(lg->bufs[idx] + lg->lens[idx], p, n);
+		lg->lens[idx] += n;
+		p += n;
+		len -= n;
+		if (lg->lens[idx] == lg->buf_size)
+			logger_submit(lg);
+	}
+
+	return atomic_load(&lg->error);
+}
+
+static ssize_t logger_stream_write(void *cookie, const char *buf, size_t size)
+{
+	/* errors are reported by async_logger_close() */
+	async_logger_write(cookie, buf, size);
+
+	return size;
+}
+
+static int logger_stream_close(void *cookie)
+{
+	struct async_logger *lg = cookie;
+
+	lg->stream = NULL;
+
+	return 0;
+}
+
+FILE *async_logger_stream(struct async_logger *lg)
+{
+	cookie_io_functions_t io = {
+		.write = logger_stream_write,
+		.close = logger_stream_close,
+	};
+
+	lg->stream = fopencookie(lg, "w", io);
+	if (lg->stream)
+		setvbuf(lg->stream, NULL, _IOFBF, LOG_STREAM_BUFFER);
+
+	return lg->stream;
+}
+
+int async_logger_close(struct async_logger *lg)
+{
+	int i;
+
+	if (lg->fd < 0)
+		return 0;
+
+	if (lg->stream)
+		fclose(lg->stream);
+
+	pthread_mutex_lock(&lg->lock);
+	if (lg->lens[lg->tail % ASYNC_LOG_BUFFERS])
+		lg->tail++;
+	lg->stop = 1;
+	pthread_cond_signal(&lg->filled);
+	pthread_mutex_unlock(&lg->lock);
+	pthread_join(lg->thread, NULL);
+
+	if (lg->sync_every && lg->unsynced && fdatasync(lg->fd) == 0)
+		lg->stats.syncs++;
+	if (close(lg->fd) && atomic_load(&lg->error) == 0)
+		atomic_store(&lg->error, -errno);
+	lg->fd = -1;
+
+	pthread_cond_destroy(&lg->drained);
+	pthread_cond_destroy(&lg->filled);
+	pthread_mutex_destroy(&lg->lock);
+	for (i = 0; i < ASYNC_LOG_BUFFERS; i++) {
+		free(lg->bufs[i]);
+		lg->bufs[i] = NULL;
+	}
+
+	return atomic_load(&lg->error);
+}
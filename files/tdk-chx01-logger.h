@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_LOGGER_H_
+#define _TDK_CHX01_LOGGER_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASYNC_LOG_BUFFERS	4
+
+/*! \struct async_logger_stats
+ * Async logger counters.
+ */
+struct async_logger_stats {
+	unsigned long long bytes;	/* bytes written to the file */
+	unsigned int writes;		/* write() calls */
+	unsigned int syncs;		/* fdatasync() calls */
+	unsigned int stalls;		/* producer waited for a free buffer */
+	unsigned int max_write_us;	/* longest write() + fdatasync() */
+};
+
+/*! \struct async_logger
+ * Log file written by its own thread. The producer copies data into the
+ * active buffer; full buffers are queued and written whole with a single
+ * write() each, so a slow flush to storage never blocks the producer until
+ * every buffer is waiting.
+ */
+struct async_logger {
+	int fd;
+	size_t buf_size;
+	char *bufs[ASYNC_LOG_BUFFERS];
+	size_t lens[ASYNC_LOG_BUFFERS];
+	unsigned int head;		/* next buffer to write */
+	unsigned int tail;		/* buffer being filled */
+	pthread_mutex_t lock;
+	pthread_cond_t filled;		/* a buffer was queued, or stop */
+	pthread_cond_t drained;		/* a buffer was written */
+	pthread_t thread;
+	int stop;
+	atomic_int error;		/* first write error, -errno, set by the
+					 * writer thread */
+	off_t offset;			/* bytes written */
+	off_t allocated;		/* bytes preallocated */
+	off_t prealloc;			/* preallocation step, 0: none */
+	unsigned int sync_every;	/* fdatasync() every n buffers, 0: never */
+	unsigned int unsynced;
+	struct async_logger_stats stats;
+	FILE *stream;
+};
+
+/**
+ * async_logger_open() - create the log file and start the writer thread
+ * @lg: logger
+ * @path: file name, truncated if it exists
+ * @buf_size: size of each of the ASYNC_LOG_BUFFERS buffers
+ * @prealloc: reserve file space ahead in steps of this many bytes with
+ *            fallocate(), 0 to disable
+ * @sync_every: fdatasync() after this many buffers, 0 to never sync
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int async_logger_open(struct async_logger *lg, const char *path,
+	size_t buf_size, off_t prealloc, unsigned int sync_every);
+
+/* copy @len bytes into the log, Return: 0, or the first write error */
+int async_logger_write(struct async_logger *lg, const void *data, size_t len);
+
+/**
+ * async_logger_stream() - stdio stream writing into the logger
+ * @lg: logger
+ *
+ * fclose() on the stream flushes it into the logger but leaves the logger
+ * open.
+ *
+ * Return: the stream, NULL on failure.
+ **/
+FILE *async_logger_stream(struct async_logger *lg);
+
+/**
+ * async_logger_close() - write what is left, stop the thread, close the file
+ * @lg: logger
+ *
+ * Return: 0 on success, the first write error otherwise.
+ **/
+int async_logger_close(struct async_logger *lg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdk-chx01-pool.h"
+
+static void queue_push(struct pool_worker *w, struct pool_task *task)
+{
+	pthread_mutex_lock(&w->lock);
+	w->queue[w->tail++ % POOL_QUEUE_DEPTH] = task;
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* owner side, newest task first */
+static struct pool_task *queue_pop(struct pool_worker *w)
+{
+	struct pool_task *task = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->tail != w->head)
+		task = w->queue[--w->tail % POOL_QUEUE_DEPTH];
+	pthread_mutex_unlock(&w->lock);
+
+	return task;
+}
+
+/* thief side, oldest task first */
+static struct pool_task *queue_steal(struct pool_worker *w)
+{
+	struct pool_task *task = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->tail != w->head)
+		task = w->queue[w->head++ % POOL_QUEUE_DEPTH];
+	pthread_mutex_unlock(&w->lock);
+
+	return task;
+}
+
+/* run tasks until every queue is empty */
+static void pool_drain(struct worker_pool *pool, int id)
+{
+	struct pool_worker *self = &pool->workers[id];
+	struct pool_task *task;
+	int i;
+
+	for (;;) {
+		task = queue_pop(self);
+		for (i = 1; task == NULL && i < pool->nworkers; i++) {
+			task = queue_steal(&pool->workers[(id + i) % pool->nworkers]);
+			if (task)
+				self->stolen++;
+		}
+		if (task == NULL)
+			return;
+
+		task->fn(task->arg);
+		self->executed++;
+
+		if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+			pthread_mutex_lock(&pool->lock);
+			pthread_cond_broadcast(&pool->done);
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+}
+
+static void *pool_thread(void *data)
+{
+	struct pool_worker *self = data;
+	struct worker_pool *pool = self->pool;
+	unsigned int seen = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stop && pool->generation == seen)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		seen = pool->generation;
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		pool_drain(pool, self->id);
+	}
+
+	return NULL;
+}
+
+static void pool_pin(struct pool_worker *w)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	if (pthread_setaffinity_np(w->thread, sizeof(set), &set))
+		printf("worker pool: cannot pin to CPU %d\n", w->cpu);
+}
+
+int worker_pool_init(struct worker_pool *pool, int nworkers, const int *cpus,
+	int ncpus)
+{
+	struct pool_worker *w;
+	int i, ret;
+
+	memset(pool, 0, sizeof(*pool));
+	if (nworkers < 1)
+		nworkers = 1;
+	if (nworkers > POOL_MAX_WORKERS)
+		nworkers = POOL_MAX_WORKERS;
+
+	if (posix_memalign((void **)&pool->workers, POOL_CACHE_LINE,
+			nworkers * sizeof(*pool->workers)))
+		return -ENOMEM;
+	memset(pool->workers, 0, nworkers * sizeof(*pool->workers));
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	atomic_init(&pool->pending, 0);
+
+	for (i = 0; i < nworkers; i++) {
+		w = &pool->workers[i];
+		pthread_mutex_init(&w->lock, NULL);
+		w->pool = pool;
+		w->id = i;
+		w->cpu = -1;
+		if (i == 0)
+			continue;
+
+		ret = pthread_create(&w->thread, NULL, pool_thread, w);
+		if (ret) {
+			pool->nworkers = i;
+			worker_pool_destroy(pool);
+			return -ret;
+		}
+		pool->nworkers = i + 1;
+
+		if (cpus && ncpus > 0) {
+			w->cpu = cpus[(i - 1) % ncpus];
+			pool_pin(w);
+		}
+	}
+	pool->nworkers = nworkers;
+
+	return 0;
+}
+
+void worker_pool_destroy(struct worker_pool *pool)
+{
+	int i;
+
+	if (pool->workers == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_mutex_destroy(&pool->workers[i].lock);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->nworkers = 0;
+}
+
+void worker_pool_run(struct worker_pool *pool, struct pool_task *tasks,
+	int count)
+{
+	int i;
+
+	if (count <= 0)
+		return;
+
+	if (pool->nworkers <= 1) {
+		for (i = 0; i < count; i++)
+			tasks[i].fn(tasks[i].arg);
+		if (pool->workers)
+			pool->workers[0].executed += count;
+		return;
+	}
+
+	if (count > POOL_QUEUE_DEPTH)
+		count = POOL_QUEUE_DEPTH;
+
+	atomic_store(&pool->pending, count);
+	for (i = 0; i < count; i++)
+		queue_push(&pool->workers[i % pool->nworkers], &tasks[i]);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	pool_drain(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (atomic_load(&pool->pending))
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int worker_pool_parse_cpus(const char *arg, int *cpus, int max)
+{
+	int n = 0;
+	long first, last;
+	char *end;
+
+	do {
+		first = strtol(arg, &end, 10);
+		if (end == arg || first < 0 || first >= CPU_SETSIZE)
+			return -EINVAL;
+		last = first;
+		if (*end == '-') {
+			arg = end + 1;
+			last = strtol(arg, &end, 10);
+			if (end == arg || last < first || last >= CPU_SETSIZE)
+				return -EINVAL;
+		}
+		for (; first <= last && n < max; first++)
+			cpus[n++] = first;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? -EINVAL : n;
+}
+
+void worker_pool_stats_dump(const struct worker_pool *pool, FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "worker pool: %d workers\n", pool->nworkers);
+	for (i = 0; i < pool->nworkers; i++) {
+		const struct pool_worker *w = &pool->workers[i];
+
+		fprintf(fp, "  worker %d: cpu %d, tasks %u, stolen %u\n",
+			i, w->cpu, w->executed, w->stolen);
+	}
+}
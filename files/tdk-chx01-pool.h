@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_POOL_H_
+#define _TDK_CHX01_POOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_MAX_WORKERS	16
+#define POOL_QUEUE_DEPTH	64
+#define POOL_CACHE_LINE		64
+
+/*! \struct pool_task
+ * One unit of work, run once by whichever worker gets to it first.
+ */
+struct pool_task {
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+struct worker_pool;
+
+/*! \struct pool_worker
+ * A worker and its task queue. The owner pops from the tail, idle workers
+ * steal from the head.
+ */
+struct pool_worker {
+	pthread_mutex_t lock;
+	unsigned int head, tail;
+	struct pool_task *queue[POOL_QUEUE_DEPTH];
+	struct worker_pool *pool;
+	int id;
+	pthread_t thread;
+	int cpu;			/* pinned CPU, -1 if not pinned */
+	unsigned int executed;		/* tasks run by this worker */
+	unsigned int stolen;		/* tasks taken from other queues */
+} __attribute__((aligned(POOL_CACHE_LINE)));
+
+/*! \struct worker_pool
+ * Fixed set of threads running batches of independent tasks. Worker 0 is
+ * the thread calling worker_pool_run(), which works on the batch too.
+ */
+struct worker_pool {
+	int nworkers;
+	struct pool_worker *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* new batch or shutdown */
+	pthread_cond_t done;		/* batch finished */
+	unsigned int generation;	/* batches started */
+	int stop;
+	atomic_int pending;		/* tasks of the batch not finished */
+};
+
+/**
+ * worker_pool_init() - start the pool threads
+ * @pool: pool
+ * @nworkers: number of workers including the calling thread, 1 runs every
+ *            task on the caller
+ * @cpus: CPUs the extra threads are pinned to, in turn, or NULL
+ * @ncpus: number of entries in @cpus
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int worker_pool_init(struct worker_pool *pool, int nworkers, const int *cpus,
+	int ncpus);
+
+/* stop and join the pool threads */
+void worker_pool_destroy(struct worker_pool *pool);
+
+/**
+ * worker_pool_run() - run a batch of tasks and wait for all of them
+ * @pool: pool
+ * @tasks: tasks, must stay valid until the call returns
+ * @count: number of tasks, at most POOL_QUEUE_DEPTH
+ *
+ * Tasks are dealt round-robin to the workers. A worker that runs out of
+ * tasks steals from the others, so one slow task does not hold back the
+ * rest of the batch.
+ **/
+void worker_pool_run(struct worker_pool *pool, struct pool_task *tasks,
+	int count);
+
+/**
+ * worker_pool_parse_cpus() - parse a CPU list such as "4-7" or "0,2,4"
+ * @arg: CPU list
+ * @cpus: parsed CPUs
+ * @max: capacity of @cpus
+ *
+ * Return: number of CPUs, or -EINVAL.
+ **/
+int worker_pool_parse_cpus(const char *arg, int *cpus, int max);
+
+/* print per-worker counters */
+void worker_pool_stats_dump(const struct worker_pool *pool, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdk-chx01-rawcap.h"
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int rawcap_create_stream(struct rawcap_file *rc, FILE *fp,
+	const struct chx01_log_info *info, int scan_bytes)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	int ret;
+
+	memset(rc, 0, sizeof(*rc));
+	rc->fp = fp;
+	rc->writing = 1;
+	rc->info = *info;
+	rc->scan_bytes = scan_bytes;
+
+	capture_encode_header(header, RAWCAP_MAGIC, info, scan_bytes);
+	if (fwrite(header, sizeof(header), 1, fp) != 1) {
+		ret = -errno;
+		rawcap_close(rc);
+		return ret;
+	}
+
+	return 0;
+}
+
+int rawcap_write(struct rawcap_file *rc, long long time_ns, const void *data,
+	int result)
+{
+	unsigned char h[RAWCAP_RECORD_HEADER];
+
+	put_le32(h, (uint64_t)time_ns);
+	put_le32(h + 4, (uint64_t)time_ns >> 32);
+	put_le32(h + 8, result);
+	put_le32(h + 12, 0);
+
+	if (fwrite(h, sizeof(h), 1, rc->fp) != 1)
+		return -errno;
+	if (result > 0 && fwrite(data, result, 1, rc->fp) != 1)
+		return -errno;
+	rc->reads++;
+	if (result > 0)
+		rc->bytes += result;
+
+	return 0;
+}
+
+int rawcap_open(struct rawcap_file *rc, const char *path)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	size_t scan_bytes;
+
+	memset(rc, 0, sizeof(*rc));
+	rc->fp = fopen(path, "rb");
+	if (rc->fp == NULL)
+		return -errno;
+
+	if (fread(header, sizeof(header), 1, rc->fp) != 1 ||
+	    capture_decode_header(header, RAWCAP_MAGIC, &rc->info,
+			&scan_bytes) ||
+	    scan_bytes == 0 || scan_bytes > MAX_CH_IIO_BUFFER) {
+		rawcap_close(rc);
+		return -EINVAL;
+	}
+	rc->scan_bytes = scan_bytes;
+
+	rc->data = malloc(RAWCAP_MAX_READ);
+	if (rc->data == NULL) {
+		rawcap_close(rc);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int rawcap_read(struct rawcap_file *rc, struct rawcap_record *rec)
+{
+	unsigned char h[RAWCAP_RECORD_HEADER];
+	size_t n;
+
+	n = fread(h, 1, sizeof(h), rc->fp);
+	if (n == 0)
+		return ferror(rc->fp) ? -EIO : 0;
+	if (n != sizeof(h))
+		return -EINVAL;
+
+	rec->time_ns = (long long)(get_le32(h) |
+		(uint64_t)get_le32(h + 4) << 32);
+	rec->result = (int32_t)get_le32(h + 8);
+	rec->data = rc->data;
+	if (rec->result > RAWCAP_MAX_READ)
+		return -EINVAL;
+	if (rec->result > 0 &&
+	    fread(rc->data, rec->result, 1, rc->fp) != 1)
+		return -EINVAL;
+
+	rc->reads++;
+	if (rec->result > 0)
+		rc->bytes += rec->result;
+
+	return 1;
+}
+
+int rawcap_close(struct rawcap_file *rc)
+{
+	int ret = 0;
+
+	if (rc->fp) {
+		if (rc->writing && fflush(rc->fp))
+			ret = -errno;
+		if (fclose(rc->fp) && ret == 0)
+			ret = -errno;
+	}
+	free(rc->data);
+	rc->fp = NULL;
+	rc->data = NULL;
+
+	return ret;
+}
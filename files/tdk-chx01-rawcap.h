@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_RAWCAP_H_
+#define _TDK_CHX01_RAWCAP_H_
+
+#include <stdio.h>
+
+#include "tdk-chx01-capture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw IIO capture, every read() of the device as returned, all fields
+ * little-endian:
+ *
+ * header, CAPTURE_HEADER_SIZE bytes, laid out like the capture header with
+ *   magic "CHX01RAW" and the scan size in place of the record size
+ *
+ * then one record per read():
+ *   u64 receive time, CLOCK_MONOTONIC in ns
+ *   i32 read() result, bytes or -errno
+ *   u32 reserved, 0
+ *   the bytes read, verbatim, when the result is positive
+ */
+#define RAWCAP_MAGIC		"CHX01RAW"
+#define RAWCAP_RECORD_HEADER	16
+#define RAWCAP_MAX_READ		(1 << 20)
+
+/*! \struct rawcap_record
+ * One read() of the device, as recorded.
+ */
+struct rawcap_record {
+	long long time_ns;	/* monotonic receive time */
+	int result;		/* bytes read or -errno */
+	const char *data;	/* @result bytes, valid until the next read */
+};
+
+/*! \struct rawcap_file
+ * An open raw capture, either being written or being read.
+ */
+struct rawcap_file {
+	FILE *fp;
+	int writing;
+	struct chx01_log_info info;
+	int scan_bytes;
+	char *data;		/* read buffer, RAWCAP_MAX_READ bytes */
+	unsigned int reads;
+	unsigned long long bytes;
+};
+
+/**
+ * rawcap_create_stream() - start a raw capture on an open stream
+ * @rc: raw capture
+ * @fp: stream, closed by rawcap_close() including on failure
+ * @info: sensor setup
+ * @scan_bytes: size of one scan
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int rawcap_create_stream(struct rawcap_file *rc, FILE *fp,
+	const struct chx01_log_info *info, int scan_bytes);
+
+/**
+ * rawcap_write() - record one read() of the device
+ * @rc: raw capture
+ * @time_ns: monotonic time the read returned
+ * @data: buffer passed to read()
+ * @result: read() return value, or -errno
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int rawcap_write(struct rawcap_file *rc, long long time_ns, const void *data,
+	int result);
+
+/**
+ * rawcap_open() - open a raw capture and parse its header
+ * @rc: raw capture
+ * @path: file name
+ *
+ * Return: 0 on success, -EINVAL if the file is not a raw capture, -errno on
+ * other failures.
+ **/
+int rawcap_open(struct rawcap_file *rc, const char *path);
+
+/**
+ * rawcap_read() - next recorded read()
+ * @rc: raw capture opened with rawcap_open()
+ * @rec: destination
+ *
+ * Return: 1 if a record was read, 0 at the end of the file, -EINVAL on a
+ * truncated or corrupt record.
+ **/
+int rawcap_read(struct rawcap_file *rc, struct rawcap_record *rec);
+
+/* flush and close, Return: 0 on success, -errno if a write failed */
+int rawcap_close(struct rawcap_file *rc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
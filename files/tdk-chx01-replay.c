@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdk-chx01-replay.h"
+
+static int file_kind(const char *path)
+{
+	char magic[8];
+	FILE *fp;
+	int ret = REPLAY_CSV;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return -errno;
+	if (fread(magic, sizeof(magic), 1, fp) == 1) {
+		if (memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0)
+			ret = REPLAY_CAPTURE;
+		else if (memcmp(magic, RAWCAP_MAGIC, sizeof(magic)) == 0)
+			ret = REPLAY_RAW;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+static struct chx01_frame *raw_get_frame(void *ctx)
+{
+	struct replay_source *src = ctx;
+
+	return src->raw_frame;
+}
+
+static void raw_put_frame(void *ctx, struct chx01_frame *frame, int complete)
+{
+}
+
+static const struct frame_assembler_ops raw_frame_ops = {
+	.get = raw_get_frame,
+	.put = raw_put_frame,
+};
+
+static int raw_open(struct replay_source *src, const char *path)
+{
+	struct chx01_scan_layout layout;
+	int ret;
+
+	ret = rawcap_open(&src->raw, path);
+	if (ret)
+		return ret;
+	src->info = src->raw.info;
+
+	src->raw_frame = malloc(sizeof(*src->raw_frame));
+	if (src->raw_frame == NULL) {
+		rawcap_close(&src->raw);
+		return -ENOMEM;
+	}
+
+	layout.scan_bytes = src->raw.scan_bytes;
+	layout.num_sensors = src->info.num_sensors;
+	layout.num_samples = src->info.num_samples;
+	frame_assembler_init(&src->assembler, &layout, &raw_frame_ops, src);
+
+	return 0;
+}
+
+int replay_open(struct replay_source *src, const char *path, double speed)
+{
+	int ret;
+
+	memset(src, 0, sizeof(*src));
+	src->speed = speed;
+
+	ret = file_kind(path);
+	if (ret < 0)
+		return ret;
+	src->kind = ret;
+
+	switch (src->kind) {
+	case REPLAY_CAPTURE:
+		ret = capture_open(&src->cap, path);
+		src->info = src->cap.info;
+		break;
+	case REPLAY_RAW:
+		ret = raw_open(src, path);
+		break;
+	default:
+		ret = chx01_csv_open(&src->csv, path);
+		src->info = src->csv.info;
+		break;
+	}
+
+	return ret;
+}
+
+/* push recorded scans until one completes a frame, like the acquisition
+ * thread does with live reads */
+static int raw_next(struct replay_source *src, struct chx01_frame *frame)
+{
+	int scan_bytes = src->raw.scan_bytes;
+	const char *scan;
+	int ret;
+
+	for (;;) {
+		if (src->rec_pos >= src->rec.result) {
+			ret = rawcap_read(&src->raw, &src->rec);
+			if (ret <= 0) {
+				frame_assembler_flush(&src->assembler);
+				return ret;
+			}
+			src->rec_pos = 0;
+			if (src->rec.result < 0)
+				src->raw_errors++;
+			/* read_scans() drops such reads as a whole */
+			if (src->rec.result > 0 &&
+			    src->rec.result % scan_bytes) {
+				src->raw_torn++;
+				src->rec.result = 0;
+			}
+			continue;
+		}
+
+		scan = src->rec.data + src->rec_pos;
+		src->rec_pos += scan_bytes;
+		if (frame_assembler_push(&src->assembler, scan)) {
+			*frame = *src->raw_frame;
+			return 1;
+		}
+	}
+}
+
+/* sleep until the frame is due on the scaled clock */
+static void replay_pace(struct replay_source *src, long long timestamp)
+{
+	struct timespec due = src->start;
+	long long ns;
+
+	if (src->frames == 0) {
+		src->first_timestamp = timestamp;
+		clock_gettime(CLOCK_MONOTONIC, &src->start);
+		return;
+	}
+
+	ns = (timestamp - src->first_timestamp) / src->speed;
+	if (ns <= 0)
+		return;
+	due.tv_sec += ns / 1000000000LL;
+	due.tv_nsec += ns % 1000000000LL;
+	if (due.tv_nsec >= 1000000000L) {
+		due.tv_nsec -= 1000000000L;
+		due.tv_sec++;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) ==
+			EINTR)
+		;
+}
+
+int replay_next(struct replay_source *src, struct chx01_frame *frame)
+{
+	int ret;
+
+	switch (src->kind) {
+	case REPLAY_CAPTURE:
+		ret = capture_read_frame(&src->cap, frame);
+		break;
+	case REPLAY_RAW:
+		ret = raw_next(src, frame);
+		break;
+	default:
+		ret = chx01_csv_read_frame(&src->csv, frame);
+		break;
+	}
+	if (ret <= 0)
+		return ret;
+
+	if (src->speed > 0)
+		replay_pace(src, frame->timestamp);
+	src->frames++;
+
+	return 1;
+}
+
+void replay_close(struct replay_source *src)
+{
+	switch (src->kind) {
+	case REPLAY_CAPTURE:
+		capture_close(&src->cap);
+		break;
+	case REPLAY_RAW:
+		rawcap_close(&src->raw);
+		free(src->raw_frame);
+		src->raw_frame = NULL;
+		break;
+	default:
+		chx01_csv_close(&src->csv);
+		break;
+	}
+}
+
+const char *replay_kind_name(const struct replay_source *src)
+{
+	static const char * const names[] = {
+		[REPLAY_CSV] = "CSV log",
+		[REPLAY_CAPTURE] = "capture",
+		[REPLAY_RAW] = "raw capture",
+	};
+
+	return names[src->kind];
+}
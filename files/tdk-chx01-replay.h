@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_REPLAY_H_
+#define _TDK_CHX01_REPLAY_H_
+
+#include <time.h>
+
+#include "tdk-chx01-capture.h"
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-frame.h"
+#include "tdk-chx01-rawcap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum replay_kind {
+	REPLAY_CSV,
+	REPLAY_CAPTURE,
+	REPLAY_RAW,
+};
+
+/*! \struct replay_source
+ * Recorded session played back frame by frame, from a CSV log, a binary
+ * capture or a raw IIO capture, either as fast as possible or paced on the
+ * recorded timestamps. Raw captures go through the frame assembler again,
+ * so decoding and torn frames are replayed bit-exactly.
+ */
+struct replay_source {
+	enum replay_kind kind;
+	struct capture_file cap;
+	struct chx01_csv_reader csv;
+	struct rawcap_file raw;
+	struct rawcap_record rec;	/* raw read being split into scans */
+	int rec_pos;			/* next scan in rec */
+	unsigned int raw_errors;	/* recorded read() errors */
+	unsigned int raw_torn;		/* reads not a multiple of a scan */
+	struct frame_assembler assembler;
+	struct chx01_frame *raw_frame;	/* frame being assembled */
+	struct chx01_log_info info;	/* setup the session was recorded with */
+	double speed;			/* 0: unpaced, 1: real time, 2: twice... */
+	long long first_timestamp;	/* recorded time of the first frame */
+	struct timespec start;		/* wall clock of the first frame */
+	unsigned int frames;
+};
+
+/**
+ * replay_open() - open a recorded session
+ * @src: source
+ * @path: CSV log, capture or raw capture, told apart by the magic
+ * @speed: clock scale, 0 to replay as fast as possible
+ *
+ * Return: 0 on success, -EINVAL if the file is neither, -errno otherwise.
+ **/
+int replay_open(struct replay_source *src, const char *path, double speed);
+
+/**
+ * replay_next() - next frame, once its scaled recorded time has come
+ * @src: source
+ * @frame: destination, with its original timestamp
+ *
+ * Return: 1 if a frame was read, 0 at the end, -errno on error.
+ **/
+int replay_next(struct replay_source *src, struct chx01_frame *frame);
+
+void replay_close(struct replay_source *src);
+
+/* "CSV log", "capture" or "raw capture" */
+const char *replay_kind_name(const struct replay_source *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_RING_H_
+#define _TDK_CHX01_RING_H_
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define FRAME_RING_ALIGN	64
+
+/*! \struct frame_ring
+ * Fixed-capacity, lock-free single-producer/single-consumer ring of frames.
+ * The producer fills a slot in place and publishes it, the consumer uses it
+ * in place and releases it, so frames are never copied. head and tail live
+ * on separate cache lines so the two threads do not false-share.
+ */
+struct frame_ring {
+	_Alignas(FRAME_RING_ALIGN) atomic_uint head;	/* written by producer */
+	_Alignas(FRAME_RING_ALIGN) atomic_uint tail;	/* written by consumer */
+	_Alignas(FRAME_RING_ALIGN) atomic_uint pushed;
+	atomic_uint dropped;
+	atomic_uint high_water;
+	unsigned int mask;
+	size_t slot_size;
+	char *slots;
+};
+
+/**
+ * frame_ring_init() - allocate a ring
+ * @ring: ring to set up
+ * @capacity: number of slots, rounded up to a power of two
+ * @slot_size: size of one frame, rounded up to a cache line
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ **/
+static inline int frame_ring_init(struct frame_ring *ring,
+	unsigned int capacity, size_t slot_size)
+{
+	unsigned int n = 1;
+	void *mem;
+
+	while (n < capacity)
+		n <<= 1;
+	slot_size = (slot_size + FRAME_RING_ALIGN - 1) &
+		~(size_t)(FRAME_RING_ALIGN - 1);
+
+	if (posix_memalign(&mem, FRAME_RING_ALIGN, n * slot_size))
+		return -ENOMEM;
+	memset(mem, 0, n * slot_size);
+
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->pushed, 0);
+	atomic_init(&ring->dropped, 0);
+	atomic_init(&ring->high_water, 0);
+	ring->mask = n - 1;
+	ring->slot_size = slot_size;
+	ring->slots = mem;
+
+	return 0;
+}
+
+static inline void frame_ring_free(struct frame_ring *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+static inline unsigned int frame_ring_capacity(const struct frame_ring *ring)
+{
+	return ring->mask + 1;
+}
+
+/* frames published and not yet released, safe to call from any thread */
+static inline unsigned int frame_ring_occupancy(struct frame_ring *ring)
+{
+	return atomic_load_explicit(&ring->head, memory_order_acquire) -
+		atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/**
+ * frame_ring_write_slot() - producer: get the next free slot to fill
+ * @ring: ring
+ *
+ * Return: pointer to the slot, or NULL if the ring is full.
+ **/
+static inline void *frame_ring_write_slot(struct frame_ring *ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head,
+		memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ring->tail,
+		memory_order_acquire);
+
+	if (head - tail > ring->mask)
+		return NULL;
+
+	return ring->slots + (size_t)(head & ring->mask) * ring->slot_size;
+}
+
+/* producer: make the slot returned by frame_ring_write_slot() visible */
+static inline void frame_ring_publish(struct frame_ring *ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head,
+		memory_order_relaxed) + 1;
+	unsigned int used = head - atomic_load_explicit(&ring->tail,
+		memory_order_relaxed);
+
+	atomic_store_explicit(&ring->head, head, memory_order_release);
+	atomic_fetch_add_explicit(&ring->pushed, 1, memory_order_relaxed);
+	if (used > atomic_load_explicit(&ring->high_water,
+			memory_order_relaxed))
+		atomic_store_explicit(&ring->high_water, used,
+			memory_order_relaxed);
+}
+
+/* producer: account for a frame thrown away because the ring was full */
+static inline void frame_ring_drop(struct frame_ring *ring)
+{
+	atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+}
+
+/**
+ * frame_ring_read_slot() - consumer: get the oldest published frame
+ * @ring: ring
+ *
+ * Return: pointer to the slot, or NULL if the ring is empty.
+ **/
+static inline void *frame_ring_read_slot(struct frame_ring *ring)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail,
+		memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ring->head,
+		memory_order_acquire);
+
+	if (head == tail)
+		return NULL;
+
+	return ring->slots + (size_t)(tail & ring->mask) * ring->slot_size;
+}
+
+/* consumer: hand the slot returned by frame_ring_read_slot() back */
+static inline void frame_ring_release(struct frame_ring *ring)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail,
+		memory_order_relaxed);
+
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,623 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Session API, see tdk-chx01-get-data.h. Same device handling as the
+ * application, with every piece of state in the session.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tdk-chx01-algo.h"
+#include "tdk-chx01-capture.h"
+#include "tdk-chx01-firmware.h"
+#include "tdk-chx01-get-data.h"
+#include "tdk-chx01-hotplug.h"
+#include "tdk-chx01-logger.h"
+#include "tdk-chx01-sysfs.h"
+
+#define SESSION_NAME		"ch101"
+#define SESSION_IIO_DIR		"/sys/bus/iio/devices/"
+#define SESSION_MAX_SAMPLES	225
+#define SESSION_MAX_FREQUENCY	100
+#define SESSION_BUFFER_LENGTH	2000
+/* the driver measures this many more times after each read, like setCnt() */
+#define SESSION_COUNT		10
+#define SESSION_FLOOR_SENSORS	(1 << 2)	/* port 6, like -D */
+#define SESSION_FLOOR_MM	33
+#define SESSION_LOG_BUFFER	(1 << 20)	/* like -W 1024 */
+
+enum session_state {
+	SESSION_CREATED,
+	SESSION_CONFIGURED,
+	SESSION_STREAMING,
+};
+
+/*! \struct chx01_session
+ * Everything the application keeps in globals for its single device.
+ */
+struct chx01_session {
+	enum session_state state;
+	char dir[SYSFS_ATTR_PATH_LEN];		/* sysfs directory */
+	char dev_path[SYSFS_ATTR_PATH_LEN];	/* character device */
+	int fd;					/* open from start to destroy */
+	struct {
+		struct sysfs_attr proximity_en[MAX_NUM_SENSORS];
+		struct sysfs_attr distance_en[MAX_NUM_SENSORS];
+		struct sysfs_attr intensity_en[MAX_NUM_SENSORS];
+		struct sysfs_attr position_en[MAX_NUM_SENSORS];
+		struct sysfs_attr position_raw[MAX_NUM_SENSORS];
+		struct sysfs_attr timestamp_en;
+		struct sysfs_attr buffer_length;
+		struct sysfs_attr buffer_watermark;
+		struct sysfs_attr buffer_enable;
+		struct sysfs_attr calibbias;
+		struct sysfs_attr sampling_frequency;
+	} attrs;
+	char firmware[MAX_NUM_SENSORS][CHX01_FW_NAME_LEN];	/* per port */
+	struct chx01_log_info info;
+	struct chx01_scan_layout layout;
+	int batch;				/* scans per read() */
+	struct frame_assembler assembler;
+	struct frame_assembler_stats stats;	/* earlier streams */
+	struct chx01_frame frame;		/* being assembled */
+	int complete;				/* frame is a complete one */
+	char *scans;				/* last read */
+	int nscans, next;			/* scans read, next to push */
+	struct algo_arena *arena;
+	unsigned int algos;			/* ALGO_FLAG() of the ones to run */
+	unsigned int floor_sensors;
+	unsigned int floor_mm;
+	struct chx01_session_result result;	/* of the last frame */
+	struct async_logger logger;
+	FILE *log_fp;				/* NULL: no log */
+	enum chx01_log_format log_format;
+	struct chx01_csv csv;
+	struct capture_file capture;
+	int log_error;				/* first write error */
+};
+
+static void init_attrs(struct chx01_session *s)
+{
+	const char *dir = s->dir;
+	int i;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		sysfs_attr_init(&s->attrs.proximity_en[i], O_WRONLY,
+			"%s/scan_elements/in_proximity%d_en", dir, i);
+		sysfs_attr_init(&s->attrs.distance_en[i], O_WRONLY,
+			"%s/scan_elements/in_distance%d_en", dir, i + 6);
+		sysfs_attr_init(&s->attrs.intensity_en[i], O_WRONLY,
+			"%s/scan_elements/in_intensity%d_en", dir, i + 12);
+		sysfs_attr_init(&s->attrs.position_en[i], O_WRONLY,
+			"%s/scan_elements/in_positionrelative%d_en", dir, i + 18);
+		sysfs_attr_init(&s->attrs.position_raw[i], O_RDWR,
+			"%s/in_positionrelative%d_raw", dir, i + 18);
+	}
+	sysfs_attr_init(&s->attrs.timestamp_en, O_WRONLY,
+		"%s/scan_elements/in_timestamp_en", dir);
+	sysfs_attr_init(&s->attrs.buffer_length, O_WRONLY,
+		"%s/buffer/length", dir);
+	sysfs_attr_init(&s->attrs.buffer_watermark, O_WRONLY,
+		"%s/buffer/watermark", dir);
+	sysfs_attr_init(&s->attrs.buffer_enable, O_WRONLY,
+		"%s/buffer/enable", dir);
+	sysfs_attr_init(&s->attrs.calibbias, O_WRONLY, "%s/calibbias", dir);
+	sysfs_attr_init(&s->attrs.sampling_frequency, O_WRONLY,
+		"%s/sampling_frequency", dir);
+}
+
+static void close_attrs(struct chx01_session *s)
+{
+	struct sysfs_attr *attr = (struct sysfs_attr *)&s->attrs;
+	size_t i;
+
+	for (i = 0; i < sizeof(s->attrs) / sizeof(*attr); i++)
+		sysfs_attr_close(&attr[i]);
+}
+
+int chx01_session_create(struct chx01_session **sp, const char *root,
+	int nth)
+{
+	char iio_dir[SYSFS_ATTR_PATH_LEN];
+	struct chx01_session *s;
+	int num;
+
+	if (snprintf(iio_dir, sizeof(iio_dir), "%s" SESSION_IIO_DIR, root) >=
+			(int)sizeof(iio_dir))
+		return -ENAMETOOLONG;
+	num = iio_device_find(iio_dir, SESSION_NAME, nth);
+	if (num < 0)
+		return num;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return -ENOMEM;
+	if (algo_arena_create(&s->arena)) {
+		free(s);
+		return -ENOMEM;
+	}
+	s->fd = -1;
+	s->logger.fd = -1;
+	if (snprintf(s->dir, sizeof(s->dir), "%s" IIO_DEV_PREFIX "%d",
+			iio_dir, num) >= (int)sizeof(s->dir) ||
+	    snprintf(s->dev_path, sizeof(s->dev_path), "%s/dev/" IIO_DEV_PREFIX
+			"%d", root, num) >= (int)sizeof(s->dev_path)) {
+		algo_arena_destroy(s->arena);
+		free(s);
+		return -ENAMETOOLONG;
+	}
+	init_attrs(s);
+	*sp = s;
+
+	return 0;
+}
+
+int chx01_session_load_firmware(struct chx01_session *s, const char *dir,
+	const char *name)
+{
+	struct firmware_manifest_entry entry;
+	struct firmware_image img;
+	char path[SYSFS_ATTR_PATH_LEN];
+	int ch201 = strncmp(name, "ch201", 5) == 0;
+	int i, writes, ret;
+
+	if (s->state == SESSION_STREAMING)
+		return -EBUSY;
+
+	snprintf(path, sizeof(path), "%s" FIRMWARE_MANIFEST, dir);
+	ret = firmware_manifest_lookup(path, name, &entry);
+	if (ret)
+		return ret;
+	if (snprintf(path, sizeof(path), "%s%s", dir, name) >=
+			(int)sizeof(path))
+		return -ENAMETOOLONG;
+	ret = firmware_image_open(&img, path);
+	if (ret)
+		return ret;
+	ret = firmware_image_check(&img, &entry);
+	if (ret == 0)
+		ret = firmware_upload(s->dir, name, &img, &writes);
+	firmware_image_close(&img);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		if ((i >= CHX01_CH201_FIRST) != ch201)
+			continue;
+		snprintf(s->firmware[i], CHX01_FW_NAME_LEN, "%s", name);
+		if (s->info.sensor_connected[i])
+			memcpy(s->info.firmware[i], s->firmware[i],
+				CHX01_FW_NAME_LEN);
+	}
+
+	return 0;
+}
+
+/* connected sensors are the ones reporting a FOP */
+static int detect_sensors(struct chx01_session *s)
+{
+	struct chx01_log_info *info = &s->info;
+	int fop, i, ret;
+
+	memset(info, 0, sizeof(*info));
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		ret = sysfs_attr_read_int(&s->attrs.position_raw[i], &fop);
+		if (ret)
+			return ret;
+		info->port_map[i] = chx01_port_map[i];
+		if (fop <= 0)
+			continue;
+		info->sensor_connected[i] = 1;
+		info->op_freq[i] = fop;
+		info->sensor_connection[info->num_sensors++] = i;
+		memcpy(info->firmware[i], s->firmware[i], CHX01_FW_NAME_LEN);
+	}
+
+	return info->num_sensors ? 0 : -ENODEV;
+}
+
+int chx01_session_configure(struct chx01_session *s,
+	const struct chx01_session_config *cfg)
+{
+	struct chx01_log_info *info = &s->info;
+	int sample = cfg->num_samples, freq = cfg->frequency;
+	int i, ret;
+
+	if (s->state == SESSION_STREAMING || s->log_fp)
+		return -EBUSY;
+	if (sample < 1 || freq < 1)
+		return -EINVAL;
+	if (sample > SESSION_MAX_SAMPLES)
+		sample = SESSION_MAX_SAMPLES;
+	if (freq > SESSION_MAX_FREQUENCY)
+		freq = SESSION_MAX_FREQUENCY;
+
+	/* once: an emulated attribute reads back the sample count after */
+	if (s->state == SESSION_CREATED) {
+		ret = detect_sensors(s);
+		if (ret)
+			return ret;
+	}
+	info->num_samples = sample;
+	info->frequency = freq;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		ret = sysfs_attr_write_int(&s->attrs.position_raw[i], sample);
+		if (ret)
+			return ret;
+	}
+	ret = sysfs_attr_write_int(&s->attrs.sampling_frequency, freq);
+	if (ret)
+		return ret;
+
+	s->layout.num_sensors = info->num_sensors;
+	s->layout.num_samples = sample;
+	s->layout.scan_bytes = chx01_scan_bytes(info->num_sensors);
+	s->batch = cfg->scans_per_read > 0 ? cfg->scans_per_read :
+		chx01_scans_per_frame(&s->layout);
+	if (s->batch > MAX_SCANS_PER_FRAME)
+		s->batch = MAX_SCANS_PER_FRAME;
+
+	free(s->scans);
+	s->scans = malloc((size_t)s->batch * s->layout.scan_bytes);
+	if (s->scans == NULL)
+		return -ENOMEM;
+
+	s->algos = cfg->algos;
+	s->floor_sensors = cfg->floor_sensors ? cfg->floor_sensors :
+		SESSION_FLOOR_SENSORS;
+	s->floor_mm = cfg->floor_distance_mm > 0 ? cfg->floor_distance_mm :
+		SESSION_FLOOR_MM;
+	algo_arena_reset(s->arena);
+	s->state = SESSION_CONFIGURED;
+
+	return 0;
+}
+
+/* scan elements of the connected sensors on or all off, like the app */
+static int enable_scan_elements(struct chx01_session *s, int on)
+{
+	int i, en, ret = 0;
+
+	for (i = 0; i < MAX_NUM_SENSORS && ret == 0; i++) {
+		en = s->info.sensor_connected[i] & on;
+		ret = sysfs_attr_write_int(&s->attrs.proximity_en[i], en);
+		if (ret == 0)
+			ret = sysfs_attr_write_int(&s->attrs.distance_en[i], en);
+		if (ret == 0)
+			ret = sysfs_attr_write_int(&s->attrs.intensity_en[i], en);
+		if (ret == 0)
+			ret = sysfs_attr_write_int(&s->attrs.position_en[i], en);
+	}
+	if (ret == 0)
+		ret = sysfs_attr_write_int(&s->attrs.timestamp_en, on);
+
+	return ret;
+}
+
+static struct chx01_frame *session_get_frame(void *ctx)
+{
+	struct chx01_session *s = ctx;
+
+	return &s->frame;
+}
+
+static void session_put_frame(void *ctx, struct chx01_frame *frame,
+	int complete)
+{
+	struct chx01_session *s = ctx;
+
+	s->complete = complete;
+}
+
+static const struct frame_assembler_ops session_frame_ops = {
+	.get = session_get_frame,
+	.put = session_put_frame,
+};
+
+int chx01_session_start(struct chx01_session *s)
+{
+	int ret;
+
+	if (s->state != SESSION_CONFIGURED)
+		return s->state == SESSION_STREAMING ? -EBUSY : -EINVAL;
+
+	ret = enable_scan_elements(s, 1);
+	if (ret == 0)
+		ret = sysfs_attr_write_int(&s->attrs.buffer_length,
+			SESSION_BUFFER_LENGTH);
+	if (ret == 0)
+		ret = sysfs_attr_write_int(&s->attrs.buffer_watermark,
+			s->batch);
+	if (ret == 0)
+		ret = sysfs_attr_write_int(&s->attrs.buffer_enable, 1);
+	if (ret)
+		return ret;
+
+	if (s->fd < 0)
+		s->fd = open(s->dev_path, O_RDONLY | O_CLOEXEC);
+	if (s->fd < 0) {
+		ret = -errno;
+		sysfs_attr_write_int(&s->attrs.buffer_enable, 0);
+		return ret;
+	}
+	frame_assembler_init(&s->assembler, &s->layout, &session_frame_ops, s);
+	s->nscans = 0;
+	s->next = 0;
+	s->state = SESSION_STREAMING;
+
+	return 0;
+}
+
+/* the driver only hands out whole scans */
+static int read_scans(struct chx01_session *s)
+{
+	int len = s->batch * s->layout.scan_bytes;
+	int bytes = read(s->fd, s->scans, len);
+
+	if (bytes < 0)
+		return -errno;
+	if (bytes == 0)
+		return -ENODEV;
+	if (bytes % s->layout.scan_bytes)
+		return -EIO;
+	s->nscans = bytes / s->layout.scan_bytes;
+	s->next = 0;
+
+	return 0;
+}
+
+/* the application runs the same calls on its worker pool */
+static void run_algos(struct chx01_session *s, struct chx01_frame *frame)
+{
+	struct chx01_session_result *r = &s->result;
+	const struct chx01_log_info *info = &s->info;
+	struct algo_call calls[ALGO_MAX_CALLS];
+	uint64_t time_us = frame->timestamp / 1000;
+	int i, n, dev, rx, samples = info->num_samples;
+
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		r->range_status[i] = -1;
+		r->floor_type[i] = -1;
+		r->cliff[i] = -1;
+	}
+	if (s->algos == 0)
+		return;
+
+	n = algo_plan(info->sensor_connection, info->num_sensors, frame->mode,
+		s->algos, s->floor_sensors, calls);
+	for (i = 0; i < n; i++) {
+		dev = calls[i].dev_num;
+		rx = info->sensor_connection[dev];
+		switch (calls[i].kind) {
+		case ALGO_RANGE:
+			r->range_status[dev] = algo_range(s->arena,
+				info->op_freq[rx], calls[i].tx, rx, time_us,
+				frame->iq[dev], samples, &frame->distance[dev],
+				&frame->amplitude[dev]);
+			break;
+		case ALGO_FLOOR_TYPE:
+			r->floor_type[dev] = algo_floor_type(s->arena, rx,
+				info->op_freq[rx], s->floor_mm, time_us,
+				frame->iq[dev], samples, NULL);
+			break;
+		case ALGO_CLIFF:
+			r->cliff[dev] = algo_cliff(s->arena, calls[i].tx, rx,
+				time_us, frame->iq[dev], samples);
+			break;
+		case ALGO_KINDS:
+			break;
+		}
+	}
+}
+
+static void log_frame(struct chx01_session *s,
+	const struct chx01_frame *frame)
+{
+	int ret;
+
+	if (s->log_fp == NULL)
+		return;
+	if (s->log_format == CHX01_LOG_CAPTURE)
+		ret = capture_write_frame(&s->capture, frame);
+	else
+		ret = chx01_csv_frame(&s->csv, s->log_fp, frame);
+	if (ret && s->log_error == 0)
+		s->log_error = ret;
+}
+
+int chx01_session_next_frame(struct chx01_session *s,
+	struct chx01_frame *frame, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = s->fd, .events = POLLIN };
+	int ret;
+
+	if (s->state != SESSION_STREAMING)
+		return -EINVAL;
+
+	for (;;) {
+		while (s->next < s->nscans) {
+			if (!frame_assembler_push(&s->assembler, s->scans +
+					s->next++ * s->layout.scan_bytes))
+				continue;
+			if (!s->complete)
+				continue;
+			run_algos(s, &s->frame);
+			log_frame(s, &s->frame);
+			memcpy(frame, &s->frame, sizeof(*frame));
+			return 1;
+		}
+
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0)
+			return errno == EINTR ? 0 : -errno;
+		if (ret == 0)
+			return 0;
+		if (!(pfd.revents & POLLIN))
+			return -ENODEV;
+		ret = read_scans(s);
+		if (ret == 0)
+			ret = sysfs_attr_write_int(&s->attrs.calibbias,
+				SESSION_COUNT);
+		if (ret)
+			return ret;
+	}
+}
+
+static void add_stats(struct frame_assembler_stats *to,
+	const struct frame_assembler_stats *from)
+{
+	to->scans += from->scans;
+	to->complete += from->complete;
+	to->incomplete += from->incomplete;
+	to->late += from->late;
+}
+
+/* drop the scans still queued, until the device stayed quiet @ms */
+static void drain(struct chx01_session *s, int ms)
+{
+	struct pollfd pfd = { .fd = s->fd, .events = POLLIN };
+	int len = s->batch * s->layout.scan_bytes;
+
+	while (poll(&pfd, 1, ms) > 0 && (pfd.revents & POLLIN))
+		if (read(s->fd, s->scans, len) <= 0)
+			break;
+}
+
+int chx01_session_stop(struct chx01_session *s)
+{
+	int ret;
+
+	if (s->state != SESSION_STREAMING)
+		return 0;
+
+	frame_assembler_flush(&s->assembler);
+	add_stats(&s->stats, &s->assembler.stats);
+	memset(&s->assembler.stats, 0, sizeof(s->assembler.stats));
+	s->state = SESSION_CONFIGURED;
+
+	/* the device stays open, the next start must not see these scans */
+	ret = sysfs_attr_write_int(&s->attrs.buffer_enable, 0);
+	if (ret == 0)
+		ret = enable_scan_elements(s, 0);
+	drain(s, 2000 / s->info.frequency + 10);
+
+	return ret;
+}
+
+void chx01_session_destroy(struct chx01_session *s)
+{
+	if (s == NULL)
+		return;
+	chx01_session_stop(s);
+	chx01_session_log_close(s);
+	if (s->fd >= 0)
+		close(s->fd);
+	close_attrs(s);
+	algo_arena_destroy(s->arena);
+	free(s->scans);
+	free(s);
+}
+
+void chx01_session_result(const struct chx01_session *s,
+	struct chx01_session_result *r)
+{
+	*r = s->result;
+}
+
+int chx01_session_log_open(struct chx01_session *s, const char *path,
+	enum chx01_log_format format)
+{
+	int ret;
+
+	if (s->log_fp)
+		return -EBUSY;
+	if (s->state == SESSION_CREATED)
+		return -EINVAL;
+
+	ret = async_logger_open(&s->logger, path, SESSION_LOG_BUFFER, 0, 0);
+	if (ret)
+		return ret;
+	s->log_fp = async_logger_stream(&s->logger);
+	if (s->log_fp == NULL) {
+		async_logger_close(&s->logger);
+		return -ENOMEM;
+	}
+	s->log_format = format;
+	s->log_error = 0;
+
+	if (format == CHX01_LOG_CAPTURE) {
+		/* records are handed to the logger whole, no stdio copy */
+		setvbuf(s->log_fp, NULL, _IONBF, 0);
+		ret = capture_create_stream(&s->capture, s->log_fp, &s->info);
+	} else {
+		ret = chx01_csv_init(&s->csv, &s->info);
+		if (ret == 0)
+			ret = chx01_csv_header(&s->csv, s->log_fp);
+	}
+	if (ret)
+		chx01_session_log_close(s);
+
+	return ret;
+}
+
+int chx01_session_log_close(struct chx01_session *s)
+{
+	int ret;
+
+	if (s->log_fp == NULL)
+		return 0;
+
+	/* the capture closes its stream itself */
+	if (s->log_format == CHX01_LOG_CAPTURE) {
+		ret = capture_close(&s->capture);
+	} else {
+		ret = fclose(s->log_fp) ? -errno : 0;
+		chx01_csv_destroy(&s->csv);
+	}
+	s->log_fp = NULL;
+	if (s->log_error == 0)
+		s->log_error = ret;
+	ret = async_logger_close(&s->logger);
+	if (s->log_error == 0)
+		s->log_error = ret;
+
+	return s->log_error;
+}
+
+const struct chx01_log_info *chx01_session_info(const struct chx01_session *s)
+{
+	return &s->info;
+}
+
+void chx01_session_stats(const struct chx01_session *s,
+	struct frame_assembler_stats *st)
+{
+	*st = s->stats;
+	add_stats(st, &s->assembler.stats);
+}
+
+const char *chx01_session_device(const struct chx01_session *s)
+{
+	return s->dir;
+}
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tdk-chx01-soak.h"
+
+static long read_rss_kib(void)
+{
+	long size, resident;
+	FILE *fp = fopen("/proc/self/statm", "r");
+	int ret;
+
+	if (fp == NULL)
+		return -1;
+	ret = fscanf(fp, "%ld %ld", &size, &resident);
+	fclose(fp);
+	if (ret != 2)
+		return -1;
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int count_fds(void)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	struct dirent *ent;
+	int fds = 0;
+
+	if (dir == NULL)
+		return -1;
+	while ((ent = readdir(dir)) != NULL)
+		if (ent->d_name[0] != '.')
+			fds++;
+	closedir(dir);
+
+	/* not the one of the directory being read */
+	return fds - 1;
+}
+
+int soak_read_process(struct soak_stats *st)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	st->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	st->rss_kib = read_rss_kib();
+	st->fds = count_fds();
+
+	return st->rss_kib < 0 || st->fds < 0 ? -ENOENT : 0;
+}
+
+int soak_segment_path(char *buf, size_t len, const char *path,
+	unsigned int segment)
+{
+	const char *slash = strrchr(path, '/');
+	const char *dot = strrchr(path, '.');
+	int n;
+
+	/* a dot in a directory name or leading the file name is no extension */
+	if (dot == NULL || dot == path || (slash && dot <= slash + 1))
+		dot = path + strlen(path);
+	n = snprintf(buf, len, "%.*s_%u%s", (int)(dot - path), path, segment,
+		dot);
+
+	return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+void soak_stats_print(FILE *fp, const char *label,
+	const struct soak_stats *prev, const struct soak_stats *cur)
+{
+	double seconds = (cur->time_ns - prev->time_ns) / 1e9;
+	unsigned int frames = cur->frames - prev->frames;
+
+	fprintf(fp, "soak %s: %.1f s, %u frames, %.2f fps, missed %u, dropped %u, incomplete %u, rss %ld KiB (%+ld), fds %d (%+d)\n",
+		label, seconds, frames, seconds > 0 ? frames / seconds : 0,
+		cur->missed - prev->missed, cur->dropped - prev->dropped,
+		cur->incomplete - prev->incomplete, cur->rss_kib,
+		cur->rss_kib - prev->rss_kib, cur->fds, cur->fds - prev->fds);
+	fflush(fp);
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_SOAK_H_
+#define _TDK_CHX01_SOAK_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \struct soak_stats
+ * Health of a long run at one point in time. Two of them are compared to
+ * spot memory or fd leaks and a falling frame rate.
+ */
+struct soak_stats {
+	long long time_ns;		/* CLOCK_MONOTONIC */
+	long rss_kib;			/* resident set, -1 if unknown */
+	int fds;			/* open file descriptors, -1 if unknown */
+	unsigned int frames;		/* frames processed */
+	unsigned int missed;		/* frames missing from the timestamps */
+	unsigned int dropped;		/* frames dropped, frame ring full */
+	unsigned int incomplete;	/* partial frames discarded */
+};
+
+/**
+ * soak_read_process() - sample the time, RSS and open fds of this process
+ * @st: stats, the frame counters are left to the caller
+ *
+ * Return: 0 on success, -errno if /proc could not be read.
+ **/
+int soak_read_process(struct soak_stats *st);
+
+/**
+ * soak_segment_path() - name of one segment of a rotated file
+ * @buf: destination
+ * @len: size of @buf
+ * @path: base name, e.g. /usr/chirp.csv
+ * @segment: segment number, 3 gives /usr/chirp_3.csv
+ *
+ * Return: 0 on success, -ENAMETOOLONG if @buf is too small.
+ **/
+int soak_segment_path(char *buf, size_t len, const char *path,
+	unsigned int segment);
+
+/* print the frame rate, frame counts, RSS and fds from @prev to @cur */
+void soak_stats_print(FILE *fp, const char *label,
+	const struct soak_stats *prev, const struct soak_stats *cur);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "tdk-chx01-startup.h"
+
+/*! \struct startup_graph
+ * Shared state of the step threads of one startup_run().
+ */
+struct startup_graph {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	unsigned int done;	/* steps finished, successfully or not */
+	unsigned int failed;
+};
+
+/*! \struct startup_thread
+ * Argument of one step thread.
+ */
+struct startup_thread {
+	struct startup_graph *graph;
+	struct startup_step *step;
+	unsigned int bit;
+	pthread_t thread;
+};
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *startup_thread_fn(void *arg)
+{
+	struct startup_thread *t = arg;
+	struct startup_graph *g = t->graph;
+	struct startup_step *step = t->step;
+	int ret = -ECANCELED;
+
+	pthread_mutex_lock(&g->lock);
+	while ((g->done & step->deps) != step->deps)
+		pthread_cond_wait(&g->changed, &g->lock);
+	pthread_mutex_unlock(&g->lock);
+
+	step->start_ns = now_ns();
+	if (!(g->failed & step->deps))
+		ret = step->run(step->arg);
+	step->end_ns = now_ns();
+	step->ret = ret;
+
+	pthread_mutex_lock(&g->lock);
+	g->done |= t->bit;
+	if (ret)
+		g->failed |= t->bit;
+	pthread_cond_broadcast(&g->changed);
+	pthread_mutex_unlock(&g->lock);
+
+	return NULL;
+}
+
+int startup_run(struct startup_step *steps, int n)
+{
+	struct startup_graph graph = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.changed = PTHREAD_COND_INITIALIZER,
+	};
+	struct startup_thread threads[STARTUP_MAX_STEPS];
+	int i, ret = 0;
+
+	if (n < 1 || n > STARTUP_MAX_STEPS)
+		return -EINVAL;
+	/* only backward edges, so the graph has no cycle */
+	for (i = 0; i < n; i++)
+		if (steps[i].deps >> i)
+			return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		threads[i].graph = &graph;
+		threads[i].step = &steps[i];
+		threads[i].bit = STARTUP_STEP(i);
+		steps[i].ret = -ECANCELED;
+		steps[i].start_ns = steps[i].end_ns = 0;
+		/* without a thread the step runs here, once its
+		 * dependencies, all started before it, are done */
+		if (pthread_create(&threads[i].thread, NULL,
+				startup_thread_fn, &threads[i])) {
+			startup_thread_fn(&threads[i]);
+			threads[i].thread = 0;
+		}
+	}
+	for (i = 0; i < n; i++)
+		if (threads[i].thread)
+			pthread_join(threads[i].thread, NULL);
+
+	for (i = 0; i < n && ret == 0; i++)
+		if (steps[i].ret != -ECANCELED)
+			ret = steps[i].ret;
+	pthread_cond_destroy(&graph.changed);
+	pthread_mutex_destroy(&graph.lock);
+
+	return ret;
+}
+
+void startup_print(FILE *fp, const struct startup_step *steps, int n)
+{
+	long long first = 0, last = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (steps[i].start_ns && (!first || steps[i].start_ns < first))
+			first = steps[i].start_ns;
+		if (steps[i].end_ns > last)
+			last = steps[i].end_ns;
+	}
+
+	fprintf(fp, "startup:\n");
+	for (i = 0; i < n; i++) {
+		fprintf(fp, "  %-16s %8.1f ms, from %.1f to %.1f ms",
+			steps[i].name,
+			(steps[i].end_ns - steps[i].start_ns) / 1e6,
+			(steps[i].start_ns - first) / 1e6,
+			(steps[i].end_ns - first) / 1e6);
+		if (steps[i].ret == -ECANCELED)
+			fprintf(fp, ", skipped");
+		else if (steps[i].ret)
+			fprintf(fp, ", failed");
+		fputc('\n', fp);
+	}
+	fprintf(fp, "  %-16s %8.1f ms\n", "total", (last - first) / 1e6);
+}
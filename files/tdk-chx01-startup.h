@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_STARTUP_H_
+#define _TDK_CHX01_STARTUP_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STARTUP_MAX_STEPS	16
+#define STARTUP_STEP(n)		(1u << (n))
+
+/*! \struct startup_step
+ * One step of the startup graph. A step starts as soon as every step of
+ * @deps has succeeded, on a thread of its own, so steps without a path
+ * between them run concurrently. Steps touching the same sysfs attributes
+ * must depend on each other.
+ */
+struct startup_step {
+	const char *name;
+	int (*run)(void *arg);	/* 0 or -errno */
+	void *arg;
+	unsigned int deps;	/* STARTUP_STEP() of earlier steps */
+	/* filled in by startup_run() */
+	int ret;		/* -ECANCELED if a dependency failed */
+	long long start_ns, end_ns;	/* CLOCK_MONOTONIC */
+};
+
+/**
+ * startup_run() - run a startup graph
+ * @steps: steps, each only depending on steps before it
+ * @n: number of steps, at most STARTUP_MAX_STEPS
+ *
+ * Return: 0 when every step succeeded, otherwise the error of the first
+ * failed step, -EINVAL for an invalid graph.
+ **/
+int startup_run(struct startup_step *steps, int n);
+
+/* one line per step with its wall time and when it ran, then the total */
+void startup_print(FILE *fp, const struct startup_step *steps, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Writes synthetic sessions as raw IIO captures or binary captures, for
+ * replay with -p, and checks every frame through the scan encoder and the
+ * frame assembler on the way:
+ *
+ *   tdk-chx01-synth -n 6 -s 450 -c 1000 -t 800 -t 2000:1500:-2 -o scene.raw
+ *   tdk-chx01-get-data-app -p scene.raw -C -F
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tdk-chx01-capture.h"
+#include "tdk-chx01-rawcap.h"
+#include "tdk-chx01-synth.h"
+
+enum synth_output {
+	SYNTH_OUT_RAW,
+	SYNTH_OUT_CAPTURE,
+};
+
+static struct chx01_frame frame, decoded;
+static char scans[MAX_SCANS_PER_FRAME * MAX_CH_IIO_BUFFER];
+static int decoded_complete;
+
+static struct chx01_frame *decoded_get(void *ctx)
+{
+	return &decoded;
+}
+
+static void decoded_put(void *ctx, struct chx01_frame *f, int complete)
+{
+	decoded_complete = complete;
+}
+
+static const struct frame_assembler_ops decoded_ops = {
+	.get = decoded_get,
+	.put = decoded_put,
+};
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* mm[:amplitude[:speed]], Return: 0 or -EINVAL */
+static int parse_target(const char *arg, struct synth_target *t)
+{
+	char *end;
+
+	t->range_mm = strtol(arg, &end, 10);
+	if (end == arg || t->range_mm <= 0)
+		return -EINVAL;
+	if (*end == ':')
+		t->amplitude = strtol(end + 1, &end, 10);
+	if (*end == ':')
+		t->speed_mm = strtol(end + 1, &end, 10);
+
+	return *end ? -EINVAL : 0;
+}
+
+/* hard|soft|none[:mm] */
+static int parse_floor(const char *arg, struct synth_scene *scene)
+{
+	const char *colon = strchr(arg, ':');
+	size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+
+	if (len == 4 && !strncmp(arg, "hard", 4))
+		scene->floor = SYNTH_FLOOR_HARD;
+	else if (len == 4 && !strncmp(arg, "soft", 4))
+		scene->floor = SYNTH_FLOOR_SOFT;
+	else if (len == 4 && !strncmp(arg, "none", 4))
+		scene->floor = SYNTH_FLOOR_NONE;
+	else
+		return -EINVAL;
+	if (colon)
+		scene->floor_mm = atoi(colon + 1);
+
+	return 0;
+}
+
+/* mm[@frame] */
+static int parse_cliff(const char *arg, struct synth_scene *scene)
+{
+	char *end;
+
+	scene->cliff_mm = strtol(arg, &end, 10);
+	if (end == arg)
+		return -EINVAL;
+	if (*end == '@')
+		scene->cliff_frame = strtoul(end + 1, &end, 10);
+
+	return *end ? -EINVAL : 0;
+}
+
+static void print_help(void)
+{
+	printf("Usage: tdk-chx01-synth [options]\n");
+	printf("-h: print this help\n");
+	printf("-o file: write the session to this file. Default: only check it\n");
+	printf("-k raw|cap: raw IIO capture or binary capture. Default: raw\n");
+	printf("-n x: connected sensors, ports 0-2 CH101, 3-5 CH201. Default: 6\n");
+	printf("-s x: samples per frame. Default: 40\n");
+	printf("-f x: frames per second. Default: 5\n");
+	printf("-c x: frames. Default: 100\n");
+	printf("-b x: scans per read() in a raw capture. Default: one frame\n");
+	printf("-e x: noise seed. Default: 1\n");
+	printf("-N x: noise rms, in LSB. Default: 20\n");
+	printf("-R x[:y]: ringdown amplitude and decay in samples. Default: 4000:3\n");
+	printf("-t mm[:amp[:speed]]: target, range change per frame in mm, up to %d. Default: 1000:3000\n",
+		SYNTH_MAX_TARGETS);
+	printf("-F hard|soft|none[:mm]: floor under the floor sensors. Default: hard:33\n");
+	printf("-D list: comma-separated ports of the floor sensors. Default: 6\n");
+	printf("-K mm[@frame]: the floor drops by mm from this frame on. Default: none\n");
+	printf("-M x: multipath, percent of each echo seen at twice its range. Default: 10\n");
+}
+
+/* what the frame assembler made of the scans is not the synthesized frame */
+static int frame_differs(const struct chx01_scan_layout *layout)
+{
+	int n = layout->num_sensors, j;
+
+	if (!decoded_complete || decoded.timestamp != frame.timestamp ||
+	    memcmp(decoded.distance, frame.distance, sizeof(frame.distance[0]) * n) ||
+	    memcmp(decoded.amplitude, frame.amplitude, sizeof(frame.amplitude[0]) * n) ||
+	    memcmp(decoded.mode, frame.mode, n))
+		return 1;
+
+	for (j = 0; j < n; j++) {
+		if (memcmp(decoded.iq[j], frame.iq[j],
+				sizeof(int16_t) * 2 * layout->num_samples))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* raw capture: the scans of the session in read()s of @per_read scans */
+static int write_raw(struct rawcap_file *rc, const struct synth *syn,
+	char *buf, size_t *pending, int per_read, int flush)
+{
+	size_t chunk = (size_t)per_read * syn->layout.scan_bytes;
+	size_t done = 0;
+	int ret = 0;
+
+	while (ret == 0 && (*pending - done >= chunk ||
+			(flush && *pending > done))) {
+		if (chunk > *pending - done)
+			chunk = *pending - done;
+		ret = rawcap_write(rc, frame.timestamp, buf + done, chunk);
+		done += chunk;
+	}
+	memmove(buf, buf + done, *pending - done);
+	*pending -= done;
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct synth_scene scene;
+	struct synth syn;
+	struct frame_assembler fa;
+	struct capture_file cap;
+	struct rawcap_file rc;
+	enum synth_output output = SYNTH_OUT_RAW;
+	const char *path = NULL;
+	int num_sensors = MAX_NUM_SENSORS, samples = 40, frequency = 5;
+	int per_read = 0, targets = 0, opt, ret = 0, s;
+	unsigned int frames = 100, n, mismatches = 0;
+	long long synth_ns = 0, decode_ns = 0, t0;
+	char *pending_buf = NULL;
+	size_t len, pending = 0;
+	FILE *fp;
+
+	synth_scene_default(&scene);
+	while ((opt = getopt(argc, argv, "ho:k:n:s:f:c:b:e:N:R:t:F:D:K:M:")) != -1) {
+		switch (opt) {
+		case 'o':
+			path = optarg;
+			break;
+		case 'k':
+			if (!strcmp(optarg, "raw"))
+				output = SYNTH_OUT_RAW;
+			else if (!strcmp(optarg, "cap"))
+				output = SYNTH_OUT_CAPTURE;
+			else
+				ret = -EINVAL;
+			break;
+		case 'n':
+			num_sensors = atoi(optarg);
+			break;
+		case 's':
+			samples = atoi(optarg);
+			break;
+		case 'f':
+			frequency = atoi(optarg);
+			break;
+		case 'c':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			per_read = atoi(optarg);
+			break;
+		case 'e':
+			scene.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'N':
+			scene.noise = atoi(optarg);
+			break;
+		case 'R':
+			scene.ringdown = atoi(optarg);
+			if (strchr(optarg, ':'))
+				scene.ringdown_samples =
+					atoi(strchr(optarg, ':') + 1);
+			break;
+		case 't':
+			if (targets == SYNTH_MAX_TARGETS) {
+				ret = -EINVAL;
+				break;
+			}
+			memset(&scene.target[targets], 0,
+				sizeof(scene.target[0]));
+			scene.target[targets].amplitude = 3000;
+			ret = parse_target(optarg, &scene.target[targets]);
+			scene.num_targets = ++targets;
+			break;
+		case 'F':
+			ret = parse_floor(optarg, &scene);
+			break;
+		case 'D':
+			scene.floor_sensors = chx01_parse_ports(optarg);
+			if (scene.floor_sensors == 0)
+				ret = -EINVAL;
+			break;
+		case 'K':
+			ret = parse_cliff(optarg, &scene);
+			break;
+		case 'M':
+			scene.multipath = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_help();
+			return 0;
+		}
+		if (ret) {
+			print_help();
+			return 1;
+		}
+	}
+
+	ret = synth_init(&syn, &scene, num_sensors, samples, frequency);
+	if (ret) {
+		printf("unsupported setup: %d sensors, %d samples, %d Hz\n",
+			num_sensors, samples, frequency);
+		return 1;
+	}
+	if (per_read <= 0)
+		per_read = chx01_scans_per_frame(&syn.layout);
+
+	if (path && output == SYNTH_OUT_CAPTURE) {
+		ret = capture_create(&cap, path, &syn.info);
+	} else if (path) {
+		pending_buf = malloc(sizeof(scans) +
+			(size_t)per_read * syn.layout.scan_bytes);
+		fp = fopen(path, "wb");
+		if (pending_buf == NULL || fp == NULL)
+			ret = fp ? -ENOMEM : -errno;
+		else
+			ret = rawcap_create_stream(&rc, fp, &syn.info,
+				syn.layout.scan_bytes);
+		if (ret && fp)
+			fclose(fp);
+	}
+	if (ret) {
+		printf("cannot create %s: %s\n", path, strerror(-ret));
+		free(pending_buf);
+		return 1;
+	}
+
+	frame_assembler_init(&fa, &syn.layout, &decoded_ops, NULL);
+	for (n = 0; ret == 0 && n < frames; n++) {
+		t0 = now_ns();
+		synth_frame(&syn, n, &frame);
+		synth_ns += now_ns() - t0;
+
+		len = synth_encode(&syn, &frame, scans);
+		t0 = now_ns();
+		decoded_complete = 0;
+		for (s = 0; s < chx01_scans_per_frame(&syn.layout); s++)
+			frame_assembler_push(&fa, scans + s * syn.layout.scan_bytes);
+		decode_ns += now_ns() - t0;
+
+		if (frame_differs(&syn.layout))
+			mismatches++;
+
+		if (path == NULL)
+			continue;
+		if (output == SYNTH_OUT_CAPTURE) {
+			ret = capture_write_frame(&cap, &frame);
+		} else {
+			memcpy(pending_buf + pending, scans, len);
+			pending += len;
+			ret = write_raw(&rc, &syn, pending_buf, &pending,
+				per_read, 0);
+		}
+	}
+
+	if (path && output == SYNTH_OUT_RAW) {
+		if (ret == 0)
+			ret = write_raw(&rc, &syn, pending_buf, &pending,
+				per_read, 1);
+		if (rawcap_close(&rc) && ret == 0)
+			ret = -EIO;
+	} else if (path) {
+		if (capture_close(&cap) && ret == 0)
+			ret = -EIO;
+	}
+	free(pending_buf);
+
+	printf("%u frames of %d sensors x %d samples, %d scans each\n", n,
+		num_sensors, samples, chx01_scans_per_frame(&syn.layout));
+	if (n)
+		printf("synthesis %.1f us/frame, decode %.1f us/frame\n",
+			synth_ns / 1000.0 / n, decode_ns / 1000.0 / n);
+	printf("%u frames differ after the frame assembler\n", mismatches);
+	if (ret)
+		printf("error writing %s: %s\n", path, strerror(-ret));
+
+	return ret || mismatches;
+}
@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Synthetic baseband echoes. Each sensor receives the sum of the transducer
+ * ringdown, raised-cosine pulse echoes from the targets or the floor, their
+ * multipath copies and gaussian noise. The phase of an echo follows its
+ * round trip in wavelengths of the FOP, so a moving target rotates its I/Q
+ * phasor like a real one does.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tdk-chx01-synth.h"
+
+#define SYNTH_PULSE_SAMPLES	3.0f	/* half width of a point echo */
+#define SYNTH_SOFT_SAMPLES	6.0f	/* half width of a soft floor echo */
+#define SYNTH_SOFT_SCATTERERS	4
+#define SYNTH_SOFT_GAIN		0.35f	/* soft floor echo relative to hard */
+#define SYNTH_RINGDOWN_PHASE	0.7854f	/* pi / 4 */
+#define SYNTH_PI		3.14159265f
+
+/*! \struct synth_echo
+ * Nearest echo of a frame, reported as the driver status.
+ */
+struct synth_echo {
+	float range_mm;
+	float amplitude;
+};
+
+/* independent stream per frame and sensor, so frames can be generated in
+ * any order and from any thread */
+static uint32_t rng_seed(unsigned int seed, unsigned int n, int j)
+{
+	uint32_t x = seed * 0x9E3779B1u ^ (n + 1) * 0x85EBCA6Bu ^
+		(uint32_t)(j + 1) * 0xC2B2AE35u;
+
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+
+	return x ? x : 1;
+}
+
+static uint32_t rng_next(uint32_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+
+	return *x;
+}
+
+/* uniform in [0, 1) */
+static float rng_uniform(uint32_t *x)
+{
+	return (rng_next(x) >> 8) * (1.0f / 16777216);
+}
+
+/* zero mean, unit variance, sum of four uniforms */
+static float rng_gauss(uint32_t *x)
+{
+	float sum = rng_uniform(x) + rng_uniform(x) + rng_uniform(x) +
+		rng_uniform(x);
+
+	return (sum - 2.0f) * 1.7320508f;
+}
+
+void synth_scene_default(struct synth_scene *scene)
+{
+	memset(scene, 0, sizeof(*scene));
+	scene->seed = 1;
+	scene->noise = 20;
+	scene->ringdown = 4000;
+	scene->ringdown_samples = 3;
+	scene->multipath = 10;
+	scene->num_targets = 1;
+	scene->target[0].range_mm = 1000;
+	scene->target[0].amplitude = 3000;
+	scene->floor_sensors = 1 << 2;		/* port 6 */
+	scene->floor = SYNTH_FLOOR_HARD;
+	scene->floor_mm = 33;
+	scene->floor_amplitude = 6000;
+}
+
+int synth_init(struct synth *syn, const struct synth_scene *scene,
+	int num_sensors, int num_samples, int frequency)
+{
+	struct chx01_log_info *info = &syn->info;
+	uint32_t fop;
+	int i;
+
+	if (num_sensors < 1 || num_sensors > MAX_NUM_SENSORS ||
+	    num_samples < 1 || num_samples > MAX_NUM_SAMPLES ||
+	    frequency < 1 || scene->num_targets < 0 ||
+	    scene->num_targets > SYNTH_MAX_TARGETS ||
+	    scene->ringdown_samples < 0)
+		return -EINVAL;
+
+	memset(syn, 0, sizeof(*syn));
+	syn->scene = *scene;
+	syn->period_ns = 1000000000LL / frequency;
+
+	info->num_sensors = num_sensors;
+	info->num_samples = num_samples;
+	info->frequency = frequency;
+	for (i = 0; i < MAX_NUM_SENSORS; i++) {
+		info->port_map[i] = chx01_port_map[i];
+		if (i >= num_sensors)
+			continue;
+		fop = i < CHX01_CH201_FIRST ? CH101_FOP : CH201_FOP;
+		info->sensor_connected[i] = 1;
+		info->op_freq[i] = fop;
+		info->sensor_connection[i] = i;
+		syn->mm_per_sample[i] = chx01_sample_to_mm(fop);
+		syn->wavelength_mm[i] = CH_SPEEDOFSOUND_MPS * 1000.0f / fop;
+	}
+
+	syn->layout.num_sensors = num_sensors;
+	syn->layout.num_samples = num_samples;
+	syn->layout.scan_bytes = chx01_scan_bytes(num_sensors);
+
+	return 0;
+}
+
+/**
+ * add_echo() - add one pulse echo to the I/Q accumulator
+ * @acc: interleaved I/Q, @samples pairs
+ * @samples: samples per sensor
+ * @pos: sample of the echo peak
+ * @width: half width of the raised-cosine envelope, in samples
+ * @amp: peak amplitude
+ * @phase: carrier phase of the echo
+ **/
+static void add_echo(float *acc, int samples, float pos, float width,
+	float amp, float phase)
+{
+	float c = amp * cosf(phase), s = amp * sinf(phase);
+	float env;
+	int k = (int)ceilf(pos - width);
+	int end = (int)floorf(pos + width);
+
+	if (k < 0)
+		k = 0;
+	if (end >= samples)
+		end = samples - 1;
+	for (; k <= end; k++) {
+		env = 0.5f * (1.0f + cosf(SYNTH_PI * (k - pos) / width));
+		acc[2*k] += c * env;
+		acc[2*k + 1] += s * env;
+	}
+}
+
+/* echo from @range_mm plus its multipath copy, tracking the nearest one */
+static void add_target(const struct synth *syn, int j, float *acc,
+	float range_mm, float width, float amp, float phase_offset,
+	struct synth_echo *nearest)
+{
+	const struct synth_scene *scene = &syn->scene;
+	int samples = syn->info.num_samples;
+	float pos = range_mm / syn->mm_per_sample[j];
+	float phase = -4.0f * SYNTH_PI * range_mm / syn->wavelength_mm[j] +
+		phase_offset;
+
+	if (range_mm <= 0 || amp <= 0 || pos - width >= samples)
+		return;
+
+	add_echo(acc, samples, pos, width, amp, phase);
+	if (scene->multipath)
+		add_echo(acc, samples, 2 * pos, width,
+			amp * scene->multipath / 100, 2 * phase);
+
+	if (pos >= scene->ringdown_samples && pos < samples &&
+	    range_mm < nearest->range_mm) {
+		nearest->range_mm = range_mm;
+		nearest->amplitude = amp;
+	}
+}
+
+static float floor_range(const struct synth_scene *scene, unsigned int n)
+{
+	if (scene->cliff_mm && n >= scene->cliff_frame)
+		return scene->floor_mm + scene->cliff_mm;
+
+	return scene->floor_mm;
+}
+
+static void add_floor(const struct synth *syn, int j, unsigned int n,
+	uint32_t *rng, float *acc, struct synth_echo *nearest)
+{
+	const struct synth_scene *scene = &syn->scene;
+	float range = floor_range(scene, n);
+	float amp = scene->floor_amplitude;
+	float spread;
+	int i;
+
+	switch (scene->floor) {
+	case SYNTH_FLOOR_HARD:
+		add_target(syn, j, acc, range, SYNTH_PULSE_SAMPLES, amp, 0,
+			nearest);
+		break;
+	case SYNTH_FLOOR_SOFT:
+		/* a few scatterers around the floor range, with a random
+		 * phase, so the echo is wide and fluctuates frame to frame */
+		amp *= SYNTH_SOFT_GAIN / SYNTH_SOFT_SCATTERERS;
+		spread = SYNTH_SOFT_SAMPLES / 2 * syn->mm_per_sample[j];
+		for (i = 0; i < SYNTH_SOFT_SCATTERERS; i++)
+			add_target(syn, j, acc,
+				range + (2 * rng_uniform(rng) - 1) * spread,
+				SYNTH_SOFT_SAMPLES, amp,
+				2 * SYNTH_PI * rng_uniform(rng), nearest);
+		/* report the whole floor, not its strongest scatterer */
+		if (nearest->amplitude > 0)
+			nearest->amplitude = amp * SYNTH_SOFT_SCATTERERS;
+		break;
+	case SYNTH_FLOOR_NONE:
+		break;
+	}
+}
+
+static int16_t to_lsb(float v)
+{
+	v += v >= 0 ? 0.5f : -0.5f;
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+
+	return (int16_t)v;
+}
+
+void synth_frame(const struct synth *syn, unsigned int n,
+	struct chx01_frame *frame)
+{
+	const struct synth_scene *scene = &syn->scene;
+	int samples = syn->info.num_samples;
+	float acc[2 * MAX_NUM_SAMPLES];
+	struct synth_echo nearest;
+	const struct synth_target *t;
+	uint32_t rng;
+	float env, tau = scene->ringdown_samples;
+	int i, j, k;
+
+	frame->timestamp = SYNTH_EPOCH_NS + n * syn->period_ns;
+	frame->index = samples;
+
+	for (j = 0; j < syn->info.num_sensors; j++) {
+		memset(acc, 0, sizeof(acc[0]) * 2 * samples);
+		nearest.range_mm = 0xFFFF;
+		nearest.amplitude = 0;
+		rng = rng_seed(scene->seed, n, j);
+
+		/* decays by e every ringdown_samples, cut below 1 LSB */
+		for (k = 0; scene->ringdown && tau > 0 && k < samples; k++) {
+			env = scene->ringdown * expf(-k / tau);
+			if (env < 1)
+				break;
+			acc[2*k] += env * cosf(SYNTH_RINGDOWN_PHASE);
+			acc[2*k + 1] += env * sinf(SYNTH_RINGDOWN_PHASE);
+		}
+
+		if (scene->floor_sensors & (1u << syn->info.sensor_connection[j])) {
+			add_floor(syn, j, n, &rng, acc, &nearest);
+		} else {
+			for (i = 0; i < scene->num_targets; i++) {
+				t = &scene->target[i];
+				add_target(syn, j, acc,
+					t->range_mm + (float)t->speed_mm * n,
+					SYNTH_PULSE_SAMPLES, t->amplitude, 0,
+					&nearest);
+			}
+		}
+
+		for (k = 0; k < 2 * samples; k++) {
+			if (scene->noise)
+				acc[k] += scene->noise * rng_gauss(&rng);
+			frame->iq[j][k] = to_lsb(acc[k]);
+		}
+
+		frame->distance[j] = nearest.range_mm >= 0xFFFF ? 0xFFFF :
+			(unsigned short)(nearest.range_mm + 0.5f);
+		frame->amplitude[j] = nearest.amplitude > 0xFFFF ? 0xFFFF :
+			(unsigned short)(nearest.amplitude + 0.5f);
+		frame->mode[j] = CHX01_TX_RX_MODE;
+	}
+}
+
+size_t synth_encode(const struct synth *syn, const struct chx01_frame *frame,
+	char *buf)
+{
+	int scans = chx01_scans_per_frame(&syn->layout);
+	int s;
+
+	for (s = 0; s < scans; s++)
+		chx01_encode_scan(&syn->layout, frame, s,
+			buf + (size_t)s * syn->layout.scan_bytes);
+
+	return (size_t)scans * syn->layout.scan_bytes;
+}
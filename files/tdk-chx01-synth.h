@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_SYNTH_H_
+#define _TDK_CHX01_SYNTH_H_
+
+#include <stddef.h>
+
+#include "tdk-chx01-csv.h"
+#include "tdk-chx01-frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYNTH_MAX_TARGETS	8
+/* IIO timestamp of frame 0, in ns */
+#define SYNTH_EPOCH_NS		1000000000LL
+
+enum synth_floor {
+	SYNTH_FLOOR_NONE,
+	SYNTH_FLOOR_HARD,	/* tiles, wood: one sharp, stable echo */
+	SYNTH_FLOOR_SOFT,	/* carpet: weak, wide echo changing every frame */
+};
+
+/*! \struct synth_target
+ * Point target seen by every sensor not looking at the floor.
+ */
+struct synth_target {
+	int range_mm;		/* range of frame 0 */
+	int amplitude;		/* peak echo amplitude, LSB */
+	int speed_mm;		/* range change per frame, negative to approach */
+};
+
+/*! \struct synth_scene
+ * What the sensors see. Ranges are converted to samples with the FOP of
+ * each sensor, so CH101 and CH201 sensors see the same scene at their own
+ * resolution.
+ */
+struct synth_scene {
+	unsigned int seed;		/* noise and soft floor, same seed same frames */
+	int noise;			/* rms of the I and Q noise, LSB */
+	int ringdown;			/* transducer ringdown amplitude at sample 0 */
+	int ringdown_samples;		/* samples for the ringdown to decay by e */
+	int multipath;			/* percent of each echo seen again at twice its range */
+	int num_targets;
+	struct synth_target target[SYNTH_MAX_TARGETS];
+	unsigned int floor_sensors;	/* sensor_connection[] bitmask, like -D */
+	enum synth_floor floor;
+	int floor_mm;			/* distance of the floor sensors to the floor */
+	int floor_amplitude;		/* peak echo of a hard floor */
+	int cliff_mm;			/* floor drop, 0 for none */
+	unsigned int cliff_frame;	/* first frame over the cliff */
+};
+
+/*! \struct synth
+ * Generator for one scene and sensor setup. synth_frame() only reads it,
+ * so any number of threads may generate frames from the same generator.
+ */
+struct synth {
+	struct synth_scene scene;
+	struct chx01_log_info info;
+	struct chx01_scan_layout layout;
+	float mm_per_sample[MAX_NUM_SENSORS];	/* scan order */
+	float wavelength_mm[MAX_NUM_SENSORS];	/* scan order */
+	long long period_ns;
+};
+
+/* a forward target at 1 m, a hard floor under port 6, some noise */
+void synth_scene_default(struct synth_scene *scene);
+
+/**
+ * synth_init() - prepare a generator
+ * @syn: generator
+ * @scene: scene, copied
+ * @num_sensors: connected sensors, the first ones in port index order like
+ *	the emulator, 0-2 CH101 and 3-5 CH201
+ * @num_samples: IQ samples per sensor
+ * @frequency: frames per second, spaces the timestamps
+ *
+ * Return: 0 on success, -EINVAL on an unsupported setup.
+ **/
+int synth_init(struct synth *syn, const struct synth_scene *scene,
+	int num_sensors, int num_samples, int frequency);
+
+/**
+ * synth_frame() - synthesize one frame
+ * @syn: generator
+ * @n: frame number, the frame only depends on the scene and @n
+ * @frame: destination, complete, with the driver status: range in mm of
+ *	the nearest echo past the ringdown or 0xFFFF, its amplitude, TX_RX
+ **/
+void synth_frame(const struct synth *syn, unsigned int n,
+	struct chx01_frame *frame);
+
+/**
+ * synth_encode() - encode a frame into the scans the driver would produce
+ * @syn: generator
+ * @frame: frame from synth_frame()
+ * @buf: destination, chx01_scans_per_frame() * layout.scan_bytes bytes
+ *
+ * Return: bytes written.
+ **/
+size_t synth_encode(const struct synth *syn, const struct chx01_frame *frame,
+	char *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
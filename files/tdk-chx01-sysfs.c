@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "tdk-chx01-sysfs.h"
+
+#ifndef SYSFS_MAGIC
+#define SYSFS_MAGIC		0x62656572
+#endif
+
+#define SYSFS_TRACE_DEPTH	64
+
+/*! \struct sysfs_trace_entry
+ * One entry of the write log kept for debugging. The path is copied, the
+ * attribute may be gone by the time the log is printed.
+ */
+struct sysfs_trace_entry {
+	struct timespec ts;
+	char path[SYSFS_ATTR_PATH_LEN];
+	int value;
+	int result;
+};
+
+/* shared by every attribute of the process, e.g. of several sessions */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sysfs_trace_entry trace[SYSFS_TRACE_DEPTH];
+static unsigned int trace_head;
+
+static void sysfs_trace(const struct sysfs_attr *attr, int value, int result)
+{
+	struct sysfs_trace_entry *e;
+
+	pthread_mutex_lock(&trace_lock);
+	e = &trace[trace_head++ % SYSFS_TRACE_DEPTH];
+	clock_gettime(CLOCK_MONOTONIC, &e->ts);
+	memcpy(e->path, attr->path, sizeof(e->path));
+	e->value = value;
+	e->result = result;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void sysfs_attr_init(struct sysfs_attr *attr, int flags, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(attr->path, sizeof(attr->path), fmt, ap);
+	va_end(ap);
+
+	attr->fd = -1;
+	attr->flags = flags;
+	attr->truncate = 0;
+	attr->last = SYSFS_VALUE_UNKNOWN;
+}
+
+void sysfs_attr_close(struct sysfs_attr *attr)
+{
+	if (attr->fd >= 0)
+		close(attr->fd);
+	attr->fd = -1;
+	attr->last = SYSFS_VALUE_UNKNOWN;
+}
+
+static int sysfs_attr_open(struct sysfs_attr *attr)
+{
+	struct statfs fs;
+	struct stat st;
+
+	if (attr->fd >= 0)
+		return 0;
+
+	attr->fd = open(attr->path, attr->flags | O_CLOEXEC);
+	if (attr->fd < 0)
+		return -errno;
+
+	/* an emulated tree made of regular files needs explicit truncation,
+	 * sysfs attributes always take the whole buffer. Devices such as the
+	 * /dev/null of an absent sensor cannot be truncated. */
+	attr->truncate = fstatfs(attr->fd, &fs) == 0 &&
+		fs.f_type != SYSFS_MAGIC &&
+		fstat(attr->fd, &st) == 0 && S_ISREG(st.st_mode);
+
+	return 0;
+}
+
+int sysfs_attr_write_int(struct sysfs_attr *attr, int value)
+{
+	char buf[16];
+	int len, ret;
+
+	ret = sysfs_attr_open(attr);
+	if (ret == 0) {
+		len = snprintf(buf, sizeof(buf), "%d", value);
+		if (pwrite(attr->fd, buf, len, 0) != len)
+			ret = -errno;
+		else if (attr->truncate && ftruncate(attr->fd, len) < 0)
+			ret = -errno;
+	}
+	attr->last = ret ? SYSFS_VALUE_UNKNOWN : value;
+	sysfs_trace(attr, value, ret);
+
+	return ret;
+}
+
+int sysfs_attr_update_int(struct sysfs_attr *attr, int value)
+{
+	if (attr->fd >= 0 && attr->last == value)
+		return 0;
+
+	return sysfs_attr_write_int(attr, value);
+}
+
+int sysfs_attr_read_int(struct sysfs_attr *attr, int *value)
+{
+	char buf[32];
+	ssize_t len;
+	int ret;
+
+	ret = sysfs_attr_open(attr);
+	if (ret)
+		return ret;
+
+	len = pread(attr->fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return -errno;
+	buf[len] = '\0';
+	*value = strtol(buf, NULL, 0);
+
+	return 0;
+}
+
+void sysfs_trace_dump(FILE *fp)
+{
+	unsigned int head, n;
+
+	pthread_mutex_lock(&trace_lock);
+	head = trace_head;
+	n = head > SYSFS_TRACE_DEPTH ? head - SYSFS_TRACE_DEPTH : 0;
+	fprintf(fp, "sysfs writes: %u, last %u:\n", head, head - n);
+	for (; n < head; n++) {
+		struct sysfs_trace_entry *e = &trace[n % SYSFS_TRACE_DEPTH];
+
+		fprintf(fp, "  %ld.%06ld %s <- %d%s%s\n",
+			(long)e->ts.tv_sec, e->ts.tv_nsec / 1000,
+			e->path, e->value,
+			e->result ? ": " : "",
+			e->result ? strerror(-e->result) : "");
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright (c) 2020-2021 InvenSense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TDK_CHX01_SYSFS_H_
+#define _TDK_CHX01_SYSFS_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYSFS_ATTR_PATH_LEN	256
+#define SYSFS_VALUE_UNKNOWN	(-2147483647 - 1)
+
+/*! \struct sysfs_attr
+ * One sysfs attribute. The file is opened on first use and kept open; reads
+ * and writes are done with pread()/pwrite() at offset 0, so repeated accesses
+ * cost a single syscall with no path lookup and no stdio buffering.
+ */
+struct sysfs_attr {
+	char path[SYSFS_ATTR_PATH_LEN];
+	int fd;
+	int flags;		/* open flags, O_RDONLY, O_WRONLY or O_RDWR */
+	int truncate;		/* regular file, not sysfs: truncate on write */
+	int last;		/* last value written, for sysfs_attr_update_int() */
+};
+
+/**
+ * sysfs_attr_init() - bind an attribute to a path without opening it
+ * @attr: attribute
+ * @flags: O_RDONLY, O_WRONLY or O_RDWR
+ * @fmt: printf-style path
+ **/
+void sysfs_attr_init(struct sysfs_attr *attr, int flags, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/* close the cached fd, the attribute is reopened on next access */
+void sysfs_attr_close(struct sysfs_attr *attr);
+
+/**
+ * sysfs_attr_write_int() - write a decimal value
+ * @attr: attribute
+ * @value: value to write
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int sysfs_attr_write_int(struct sysfs_attr *attr, int value);
+
+/* same as sysfs_attr_write_int() but skips the write if @value is unchanged */
+int sysfs_attr_update_int(struct sysfs_attr *attr, int value);
+
+/**
+ * sysfs_attr_read_int() - read a decimal value
+ * @attr: attribute
+ * @value: parsed value
+ *
+ * Return: 0 on success, -errno on failure.
+ **/
+int sysfs_attr_read_int(struct sysfs_attr *attr, int *value);
+
+/* print the most recent attribute writes, oldest first */
+void sysfs_trace_dump(FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
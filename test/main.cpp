@@ -15,6 +15,7 @@
 #include "invn_algo_floor_type_fxp.h"
 #include "invn_algo_cliff_detection.h"
 #include "invn_algo_obstacleposition.h"
+#include "tdk-chx01-get-data.h"
 
 #define DEV_NUM_BOUNDARY 3
 #define TX_RX_MODE   0x10
@@ -94,24 +95,45 @@ static uint16_t floor_distance_mm = 33;
 
 
 
-extern "C" {
-	    void check_sensor_connection(void);
-		int inv_load_dmp(char *dmp_path, int dmp_version, const char *dmp_firmware_path);
-		void print_help(void);
-		int process_sysfs_request(char *data);
-		int init(int dur, int sample, int freq);
-		void getData(int counter);
-}
-
-
-
 int main(int argc, char *argv[]){
+	struct chx01_session *session;
+	struct chx01_session_config cfg = {80, 5, 0, ALGO_FLAG(ALGO_RANGE)};
+	struct chx01_frame frame;
+	const struct chx01_log_info *info;
 	int dur = 10;
-	int sample = 80;
-	int freq = 5;
-	int counter = init(dur,sample,freq);
-
-	getData(counter);
+	int counter, ret, j;
+
+	ret = chx01_session_create(&session, "", 0);
+	if (ret) {
+		printf("no ch101 device: %s\n", strerror(-ret));
+		return 1;
+	}
+	ret = chx01_session_configure(session, &cfg);
+	if (ret == 0)
+		ret = chx01_session_log_open(session, "/usr/chirp.csv",
+			CHX01_LOG_CSV);
+	if (ret == 0)
+		ret = chx01_session_start(session);
+	if (ret) {
+		printf("cannot start %s: %s\n",
+			chx01_session_device(session), strerror(-ret));
+		chx01_session_destroy(session);
+		return 1;
+	}
+
+	info = chx01_session_info(session);
+	for (counter = 0; counter < dur * cfg.frequency; counter++) {
+		ret = chx01_session_next_frame(session, &frame, 1000);
+		if (ret <= 0)
+			break;
+		for (j = 0; j < info->num_sensors; j++)
+			printf("%5u ", frame.distance[j]);
+		printf("\n");
+	}
+	if (ret < 0)
+		printf("stream ended: %s\n", strerror(-ret));
+
+	chx01_session_destroy(session);
 
 	return 0;
 